@@ -162,36 +162,58 @@ struct mp_aframe *mp_aframe_from_avframe(struct AVFrame *av_frame)
     return frame;
 }
 
-// Return a new reference to the data in frame. Returns NULL is not
-// representable (), or if input is NULL.
-// Does not copy the timestamps.
-struct AVFrame *mp_aframe_to_avframe(struct mp_aframe *frame)
+// Make frame->av_frame usable as standalone AVFrame. Returns false if not
+// representable, or if input is NULL.
+static bool prepare_avframe(struct mp_aframe *frame)
 {
     if (!frame)
-        return NULL;
+        return false;
 
     if (af_to_avformat(frame->format) != frame->av_frame->format)
-        return NULL;
+        return false;
 
     if (!mp_chmap_is_lavc(&frame->chmap))
-        return NULL;
+        return false;
 
     if (!frame->av_frame->opaque_ref && frame->speed != 1.0) {
         frame->av_frame->opaque_ref =
             av_buffer_alloc(sizeof(struct avframe_opaque));
         if (!frame->av_frame->opaque_ref)
-            return NULL;
+            return false;
 
         struct avframe_opaque *op = (void *)frame->av_frame->opaque_ref->data;
         op->speed = frame->speed;
     }
 
+    return true;
+}
+
+// Return a new reference to the data in frame. Returns NULL is not
+// representable (), or if input is NULL.
+// Does not copy the timestamps.
+struct AVFrame *mp_aframe_to_avframe(struct mp_aframe *frame)
+{
+    if (!prepare_avframe(frame))
+        return NULL;
+
     return av_frame_clone(frame->av_frame);
 }
 
+// Same as mp_aframe_to_avframe(), but unref frame. (It does so even on
+// failure.) The data references are moved to the result instead of creating
+// new ones.
 struct AVFrame *mp_aframe_to_avframe_and_unref(struct mp_aframe *frame)
 {
-    AVFrame *av = mp_aframe_to_avframe(frame);
+    AVFrame *av = NULL;
+    if (prepare_avframe(frame)) {
+        if (frame->av_frame->buf[0]) {
+            av = av_frame_alloc();
+            if (av)
+                av_frame_move_ref(av, frame->av_frame);
+        } else {
+            av = av_frame_clone(frame->av_frame);
+        }
+    }
     talloc_free(frame);
     return av;
 }
@@ -44,6 +44,8 @@
 #include "filters/user_filters.h"
 #include "options/m_option.h"
 
+#include "config.h"
+
 struct f_opts {
     float scale_nominal;
     float ms_stride;
@@ -52,6 +54,7 @@ struct f_opts {
 #define SCALE_TEMPO 1
 #define SCALE_PITCH 2
     int speed_opt;
+    int search_downmix;
 };
 
 struct priv {
@@ -89,6 +92,9 @@ struct priv {
     int num_channels;
     void *buf_pre_corr;
     void *table_window;
+    // float input of the generic search, if it can't use the above directly
+    float *search_pre_corr;
+    float *search_buf;
     int (*best_overlap_offset)(struct priv *s);
 };
 
@@ -137,55 +143,177 @@ static bool fill_queue(struct priv *s)
 
 #define UNROLL_PADDING (4 * 4)
 
-static int best_overlap_offset_float(struct priv *s)
+#if HAVE_VECTOR
+
+typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
+
+static float dot_product_float(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    if (n < 32)
+        goto rest;
+
+    const v8sf *va = (const v8sf *) a;
+    const v8sf *vb = (const v8sf *) b;
+    v8sf vsum[4] = {
+        va[0] * vb[0],
+        va[1] * vb[1],
+        va[2] * vb[2],
+        va[3] * vb[3],
+    };
+    va += 4;
+    vb += 4;
+
+    for (int i = 1; i < n / 32; i++) {
+        vsum[0] += va[0] * vb[0];
+        vsum[1] += va[1] * vb[1];
+        vsum[2] += va[2] * vb[2];
+        vsum[3] += va[3] * vb[3];
+        va += 4;
+        vb += 4;
+    }
+
+    vsum[0] += vsum[1];
+    vsum[2] += vsum[3];
+    vsum[0] += vsum[2];
+
+    float *vf = (float *) &vsum[0];
+    sum = vf[0] + vf[1] + vf[2] + vf[3] + vf[4] + vf[5] + vf[6] + vf[7];
+    a = (const float *) va;
+    b = (const float *) vb;
+
+rest:
+    for (int i = 0; i < n % 32; i++)
+        sum += *a++ * *b++;
+    return sum;
+}
+
+#else // !HAVE_VECTOR
+
+static float dot_product_float(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += *a++ * *b++;
+    return sum;
+}
+
+#endif // HAVE_VECTOR
+
+// Return the offset in frames, at which |len| values of |search| correlate best
+// with |pre_corr|. Each offset advances |search| by |step| values.
+static int best_offset(struct priv *s, const float *pre_corr,
+                       const float *search, int step, int len)
 {
     float best_corr = INT_MIN;
     int best_off = 0;
 
-    float *pw  = s->table_window;
-    float *po  = s->buf_overlap;
-    po += s->num_channels;
-    float *ppc = s->buf_pre_corr;
-    for (int i = s->num_channels; i < s->samples_overlap; i++)
-        *ppc++ = *pw++ **po++;
-
-    float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = dot_product_float(pre_corr, search, len);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
         }
-        search_start += s->num_channels;
+        search += step;
     }
 
-    return best_off * 4 * s->num_channels;
+    return best_off;
 }
 
-static int best_overlap_offset_s16(struct priv *s)
+// Number of frames in the overlap correlation, which skips the first frame.
+static int corr_frames(struct priv *s)
 {
-    int64_t best_corr = INT64_MIN;
-    int best_off = 0;
+    return s->samples_overlap / s->num_channels - 1;
+}
 
+static int best_overlap_offset_float(struct priv *s)
+{
+    int nch = s->num_channels;
+    float *pw  = s->table_window;
+    float *po  = s->buf_overlap;
+    po += nch;
+    float *search_start = (float *)s->buf_queue + nch;
+
+    if (s->opts->search_downmix) {
+        int frames = corr_frames(s);
+        for (int f = 0; f < frames; f++) {
+            float sum = 0;
+            for (int c = 0; c < nch; c++)
+                sum += po[f * nch + c];
+            s->search_pre_corr[f] = pw[f * nch] * sum;
+        }
+        for (int f = 0; f < s->frames_search + frames - 1; f++) {
+            float sum = 0;
+            for (int c = 0; c < nch; c++)
+                sum += search_start[f * nch + c];
+            s->search_buf[f] = sum;
+        }
+        return best_offset(s, s->search_pre_corr, s->search_buf, 1, frames)
+               * 4 * nch;
+    }
+
+    float *ppc = s->buf_pre_corr;
+    for (int i = nch; i < s->samples_overlap; i++)
+        *ppc++ = *pw++ **po++;
+
+    return best_offset(s, s->buf_pre_corr, search_start, nch,
+                       s->samples_overlap - nch) * 4 * nch;
+}
+
+static int best_overlap_offset_s16(struct priv *s)
+{
+    int nch = s->num_channels;
     int32_t *pw  = s->table_window;
     int16_t *po  = s->buf_overlap;
-    po += s->num_channels;
+    po += nch;
+    int16_t *search_start = (int16_t *)s->buf_queue + nch;
+
+    if (s->opts->search_downmix) {
+        int frames = corr_frames(s);
+        for (int f = 0; f < frames; f++) {
+            int32_t sum = 0;
+            for (int c = 0; c < nch; c++)
+                sum += po[f * nch + c];
+            s->search_pre_corr[f] = pw[f * nch] * (float)sum;
+        }
+        for (int f = 0; f < s->frames_search + frames - 1; f++) {
+            int32_t sum = 0;
+            for (int c = 0; c < nch; c++)
+                sum += search_start[f * nch + c];
+            s->search_buf[f] = sum;
+        }
+        return best_offset(s, s->search_pre_corr, s->search_buf, 1, frames)
+               * 2 * nch;
+    }
+
     int32_t *ppc = s->buf_pre_corr;
-    for (long i = s->num_channels; i < s->samples_overlap; i++)
+    for (long i = nch; i < s->samples_overlap; i++)
         *ppc++ = (*pw++ **po++) >> 15;
 
-    int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
+    if (HAVE_VECTOR) {
+        // The products don't fit into 32 bit lanes, so correlate in float,
+        // which can use the vectorized dot product.
+        int len = s->samples_overlap - nch;
+        int num = (s->frames_search - 1) * nch + len;
+        ppc = s->buf_pre_corr;
+        for (int i = 0; i < len; i++)
+            s->search_pre_corr[i] = ppc[i];
+        for (int i = 0; i < num; i++)
+            s->search_buf[i] = search_start[i];
+        return best_offset(s, s->search_pre_corr, s->search_buf, nch, len)
+               * 2 * nch;
+    }
+
+    int64_t best_corr = INT64_MIN;
+    int best_off = 0;
+
     for (int off = 0; off < s->frames_search; off++) {
         int64_t corr = 0;
         int16_t *ps = search_start;
         ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
+        ppc += s->samples_overlap - nch;
+        ps  += s->samples_overlap - nch;
+        long i  = -(s->samples_overlap - nch);
         do {
             corr += ppc[i + 0] * (int64_t)ps[i + 0];
             corr += ppc[i + 1] * (int64_t)ps[i + 1];
@@ -197,10 +325,10 @@ static int best_overlap_offset_s16(struct priv *s)
             best_corr = corr;
             best_off  = off;
         }
-        search_start += s->num_channels;
+        search_start += nch;
     }
 
-    return best_off * 2 * s->num_channels;
+    return best_off * 2 * nch;
 }
 
 static void output_overlap_float(struct priv *s, void *buf_out,
@@ -479,6 +607,16 @@ static bool reinit(struct mp_filter *f)
             }
             s->best_overlap_offset = best_overlap_offset_float;
         }
+        if (s->opts->search_downmix || (use_int && HAVE_VECTOR)) {
+            s->search_pre_corr = realloc(s->search_pre_corr,
+                                         s->samples_overlap * sizeof(float));
+            s->search_buf = realloc(s->search_buf,
+                (s->frames_search + frames_overlap) * nch * sizeof(float));
+            if (!s->search_pre_corr || !s->search_buf) {
+                MP_FATAL(f, "Out of memory\n");
+                return false;
+            }
+        }
     }
 
     s->bytes_per_frame = bps * nch;
@@ -551,6 +689,8 @@ static void destroy(struct mp_filter *f)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    free(s->search_pre_corr);
+    free(s->search_buf);
     TA_FREEP(&s->in);
     mp_filter_free_children(f);
 }
@@ -619,6 +759,7 @@ const struct mp_user_filter_entry af_scaletempo = {
                 {"tempo", SCALE_TEMPO},
                 {"none", 0},
                 {"both", SCALE_TEMPO | SCALE_PITCH})},
+            {"search-downmix", OPT_FLAG(search_downmix)},
             {0}
         },
     },
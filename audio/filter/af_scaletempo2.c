@@ -228,6 +228,7 @@ const struct mp_user_filter_entry af_scaletempo2 = {
             .max_playback_rate = 4.0,
             .ola_window_size_ms = 20,
             .wsola_search_interval_ms = 30,
+            .fft_search = -1,
         },
         .options = (const struct m_option[]) {
             {"search-interval",
@@ -238,6 +239,10 @@ const struct mp_user_filter_entry af_scaletempo2 = {
                 OPT_FLOAT(min_playback_rate), M_RANGE(0, FLT_MAX)},
             {"max-speed",
                 OPT_FLOAT(max_playback_rate), M_RANGE(0, FLT_MAX)},
+            {"fft-search",
+                OPT_CHOICE(fft_search, {"auto", -1}, {"no", 0}, {"yes", 1})},
+            {"threads",
+                OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
             {0}
         }
     },
@@ -1,8 +1,12 @@
 #include <float.h>
 #include <math.h>
 
+#include <libavutil/cpu.h>
+#include <libavutil/mem.h>
+
 #include "audio/chmap.h"
 #include "audio/filter/af_scaletempo2_internals.h"
+#include "misc/thread_pool.h"
 
 #include "config.h"
 
@@ -63,45 +67,47 @@ static void zero_2d_partial(float **a, int x, int y)
     }
 }
 
-// Energies of sliding windows of channels are interleaved.
-// The number windows is |input_frames| - (|frames_per_window| - 1), hence,
-// the method assumes |energy| must be, at least, of size
-// (|input_frames| - (|frames_per_window| - 1)) * |channels|.
+// Energies of sliding windows of channels, |energy[k][n]| being the window
+// starting at frame |n| of channel |k|. The number windows is
+// |input_frames| - (|frames_per_window| - 1), hence, the method assumes each
+// channel of |energy| must be, at least, of that size.
 static void multi_channel_moving_block_energies(
     float **input, int input_frames, int channels,
-    int frames_per_block, float *energy)
+    int frames_per_block, float **energy)
 {
     int num_blocks = input_frames - (frames_per_block - 1);
 
     for (int k = 0; k < channels; ++k) {
         const float* input_channel = input[k];
+        float *energy_channel = energy[k];
 
-        energy[k] = 0;
+        energy_channel[0] = 0;
 
         // First block of channel |k|.
         for (int m = 0; m < frames_per_block; ++m) {
-            energy[k] += input_channel[m] * input_channel[m];
+            energy_channel[0] += input_channel[m] * input_channel[m];
         }
 
         const float* slide_out = input_channel;
         const float* slide_in = input_channel + frames_per_block;
         for (int n = 1; n < num_blocks; ++n, ++slide_in, ++slide_out) {
-            energy[k + n * channels] = energy[k + (n - 1) * channels]
+            energy_channel[n] = energy_channel[n - 1]
                 - *slide_out * *slide_out + *slide_in * *slide_in;
         }
     }
 }
 
+// Similarity of the target block with candidate block |n|.
 static float multi_channel_similarity_measure(
-    const float* dot_prod_a_b,
-    const float* energy_a, const float* energy_b,
-    int channels)
+    float **dot_prod_a_b,
+    const float* energy_a, float **energy_b,
+    int n, int channels)
 {
     const float epsilon = 1e-12f;
     float similarity_measure = 0.0f;
-    for (int n = 0; n < channels; ++n) {
-        similarity_measure += dot_prod_a_b[n]
-            / sqrtf(energy_a[n] * energy_b[n] + epsilon);
+    for (int k = 0; k < channels; ++k) {
+        similarity_measure += dot_prod_a_b[k][n]
+            / sqrtf(energy_a[k] * energy_b[k][n] + epsilon);
     }
     return similarity_measure;
 }
@@ -195,6 +201,82 @@ static void multi_channel_dot_product(
 
 #endif // HAVE_VECTOR
 
+// Compute the dot products of |target_block| with candidate block |n| of
+// |search_block| into |dot_prods|, unless every |precomputed_step|th of them
+// was precomputed already.
+static void candidate_dot_product(
+    float **target_block, int target_block_frames,
+    float **search_block, int n, int channels,
+    float **dot_prods, int precomputed_step)
+{
+    if (n % precomputed_step == 0)
+        return;
+    float dot_prod[MP_NUM_CHANNELS];
+    multi_channel_dot_product(target_block, 0, search_block, n, channels,
+                              target_block_frames, dot_prod);
+    for (int k = 0; k < channels; ++k)
+        dot_prods[k][n] = dot_prod[k];
+}
+
+// Compute the dot products of |target_block| with all candidate blocks of
+// |search_block| at once, as circular cross-correlation via FFT, for the
+// channels of |s|. |fft_size| must be at least |search_block_size|, so no
+// wrapped-around terms enter the candidates.
+static void fft_candidate_dot_products(struct mp_scaletempo2 *p,
+                                       struct mp_scaletempo2_slice *s)
+{
+    int n_fft = p->fft_size;
+    int num_candidates = p->num_candidate_blocks;
+    AVComplexFloat *in = s->fft_in, *out = s->fft_out, *spec = s->fft_spectrum;
+    // 1/4 from splitting the packed spectra, 1/N for the unscaled inverse.
+    const float scale = 0.25f / n_fft;
+
+    for (int c = s->ch_start; c < s->ch_end; c += 2) {
+        // Each forward transform packs the target block into the real part and
+        // the search block into the imaginary part. Each inverse transform
+        // handles a pair of channels, since both correlations are real.
+        for (int i = 0; i < 2 && c + i < s->ch_end; i++) {
+            const float *target = p->target_block[c + i];
+            const float *search = p->search_block[c + i];
+            for (int k = 0; k < n_fft; k++) {
+                in[k].re = k < p->ola_window_size ? target[k] : 0;
+                in[k].im = k < p->search_block_size ? search[k] : 0;
+            }
+            s->fft_fn(s->fft, out, in, sizeof(AVComplexFloat));
+
+            // With A = Z[k] and B = conj(Z[N - k]), the spectra are
+            // T = (A + B) / 2 and S = -i (A - B) / 2. The correlation
+            // spectrum conj(T) * S is then -i/4 * conj(A + B) * (A - B).
+            for (int k = 0; k < n_fft; k++) {
+                AVComplexFloat a = out[k], b = out[(n_fft - k) & (n_fft - 1)];
+                float s_re = a.re + b.re, s_im = b.im - a.im; // conj(A + B)
+                float d_re = a.re - b.re, d_im = a.im + b.im; // A - B
+                float re = s_re * d_re - s_im * d_im;
+                float im = s_re * d_im + s_im * d_re;
+                // The second channel is added multiplied by i, which cancels
+                // the -i factor.
+                if (i == 0) {
+                    spec[k].re = im * scale;
+                    spec[k].im = -re * scale;
+                } else {
+                    spec[k].re += re * scale;
+                    spec[k].im += im * scale;
+                }
+            }
+        }
+
+        s->ifft_fn(s->ifft, out, spec, sizeof(AVComplexFloat));
+        float *dest = p->dot_prod_candidate_blocks[c];
+        for (int n = 0; n < num_candidates; n++)
+            dest[n] = out[n].re;
+        if (c + 1 < s->ch_end) {
+            dest = p->dot_prod_candidate_blocks[c + 1];
+            for (int n = 0; n < num_candidates; n++)
+                dest[n] = out[n].im;
+        }
+    }
+}
+
 // Fit the curve f(x) = a * x^2 + b * x + c such that
 //   f(-1) = y[0]
 //   f(0) = y[1]
@@ -220,27 +302,21 @@ static void quadratic_interpolation(
 // Search a subset of all candid blocks. The search is performed every
 // |decimation| frames. This reduces complexity by a factor of about
 // 1 / |decimation|. A cubic interpolation is used to have a better estimate of
-// the best match.
+// the best match. The dot products of every |decimation|th candidate block in
+// |dot_prods| must have been computed already.
 static int decimated_search(
     int decimation, struct interval exclude_interval,
-    float **target_block, int target_block_frames,
-    float **search_segment, int search_segment_frames,
+    int num_candidate_blocks,
     int channels,
-    const float *energy_target_block, const float *energy_candidate_blocks)
+    const float *energy_target_block, float **energy_candidate_blocks,
+    float **dot_prods)
 {
-    int num_candidate_blocks = search_segment_frames - (target_block_frames - 1);
-    float dot_prod [MP_NUM_CHANNELS];
     float similarity[3];  // Three elements for cubic interpolation.
 
     int n = 0;
-    multi_channel_dot_product(
-        target_block, 0,
-        search_segment, n,
-        channels,
-        target_block_frames, dot_prod);
     similarity[0] = multi_channel_similarity_measure(
-        dot_prod, energy_target_block,
-        &energy_candidate_blocks[n * channels], channels);
+        dot_prods, energy_target_block,
+        energy_candidate_blocks, n, channels);
 
     // Set the starting point as optimal point.
     float best_similarity = similarity[0];
@@ -251,14 +327,9 @@ static int decimated_search(
         return 0;
     }
 
-    multi_channel_dot_product(
-        target_block, 0,
-        search_segment, n,
-        channels,
-        target_block_frames, dot_prod);
     similarity[1] = multi_channel_similarity_measure(
-        dot_prod, energy_target_block,
-        &energy_candidate_blocks[n * channels], channels);
+        dot_prods, energy_target_block,
+        energy_candidate_blocks, n, channels);
 
     n += decimation;
     if (n >= num_candidate_blocks) {
@@ -268,15 +339,9 @@ static int decimated_search(
     }
 
     for (; n < num_candidate_blocks; n += decimation) {
-        multi_channel_dot_product(
-            target_block, 0,
-            search_segment, n,
-            channels,
-            target_block_frames, dot_prod);
-
         similarity[2] = multi_channel_similarity_measure(
-            dot_prod, energy_target_block,
-            &energy_candidate_blocks[n * channels], channels);
+            dot_prods, energy_target_block,
+            energy_candidate_blocks, n, channels);
 
         if ((similarity[1] > similarity[0] && similarity[1] >= similarity[2]) ||
             (similarity[1] >= similarity[0] && similarity[1] > similarity[2]))
@@ -312,7 +377,7 @@ static int decimated_search(
 // Search [|low_limit|, |high_limit|] of |search_segment| to find a block that
 // is most similar to |target_block|. |energy_target_block| is the energy of the
 // |target_block|. |energy_candidate_blocks| is the energy of all blocks within
-// |search_block|.
+// |search_block|. Dot products missing from |dot_prods| are computed here.
 static int full_search(
     int low_limit, int high_limit,
     struct interval exclude_interval,
@@ -320,10 +385,10 @@ static int full_search(
     float **search_block, int search_block_frames,
     int channels,
     const float* energy_target_block,
-    const float* energy_candidate_blocks)
+    float **energy_candidate_blocks,
+    float **dot_prods, int precomputed_step)
 {
     // int block_size = target_block->frames;
-    float dot_prod [sizeof(float) * MP_NUM_CHANNELS];
 
     float best_similarity = -FLT_MAX;//FLT_MIN;
     int optimal_index = 0;
@@ -332,12 +397,12 @@ static int full_search(
         if (in_interval(n, exclude_interval)) {
             continue;
         }
-        multi_channel_dot_product(target_block, 0, search_block, n, channels,
-            target_block_frames, dot_prod);
+        candidate_dot_product(target_block, target_block_frames,
+            search_block, n, channels, dot_prods, precomputed_step);
 
         float similarity = multi_channel_similarity_measure(
-            dot_prod, energy_target_block,
-            &energy_candidate_blocks[n * channels], channels);
+            dot_prods, energy_target_block,
+            energy_candidate_blocks, n, channels);
 
         if (similarity > best_similarity) {
             best_similarity = similarity;
@@ -348,69 +413,49 @@ static int full_search(
     return optimal_index;
 }
 
+// This is a compromise between complexity reduction and search accuracy. I
+// don't have a proof that down sample of order 5 is optimal.
+// One can compute a decimation factor that minimizes complexity given
+// the size of |search_block| and |target_block|. However, my experiments
+// show the rate of missing the optimal index is significant.
+// This value is chosen heuristically based on experiments.
+static const int search_decimation = 5;
+
 // Find the index of the block, within |search_block|, that is most similar
 // to |target_block|. Obviously, the returned index is w.r.t. |search_block|.
 // |exclude_interval| is an interval that is excluded from the search.
-static int compute_optimal_index(
-    float **search_block, int search_block_frames,
-    float **target_block, int target_block_frames,
-    float *energy_candidate_blocks,
-    int channels,
-    struct interval exclude_interval)
+// The energies and the dot products of the decimated search must have been
+// computed by search_slice() for all channels.
+static int compute_optimal_index(struct mp_scaletempo2 *p,
+                                 struct interval exclude_interval)
 {
-    int num_candidate_blocks = search_block_frames - (target_block_frames - 1);
-
-    // This is a compromise between complexity reduction and search accuracy. I
-    // don't have a proof that down sample of order 5 is optimal.
-    // One can compute a decimation factor that minimizes complexity given
-    // the size of |search_block| and |target_block|. However, my experiments
-    // show the rate of missing the optimal index is significant.
-    // This value is chosen heuristically based on experiments.
-    const int search_decimation = 5;
-
-    float energy_target_block [MP_NUM_CHANNELS];
-    // energy_candidate_blocks must have at least size
-    // sizeof(float) * channels * num_candidate_blocks
-
-    // Energy of all candid frames.
-    multi_channel_moving_block_energies(
-        search_block,
-        search_block_frames,
-        channels,
-        target_block_frames,
-        energy_candidate_blocks);
-
-    // Energy of target frame.
-    multi_channel_dot_product(
-        target_block, 0,
-        target_block, 0,
-        channels,
-        target_block_frames, energy_target_block);
-
     int optimal_index = decimated_search(
         search_decimation, exclude_interval,
-        target_block, target_block_frames,
-        search_block, search_block_frames,
-        channels,
-        energy_target_block,
-        energy_candidate_blocks);
+        p->num_candidate_blocks,
+        p->channels,
+        p->energy_target_block,
+        p->energy_candidate_blocks,
+        p->dot_prod_candidate_blocks);
 
     int lim_low = MPMAX(0, optimal_index - search_decimation);
-    int lim_high = MPMIN(num_candidate_blocks - 1,
+    int lim_high = MPMIN(p->num_candidate_blocks - 1,
                             optimal_index + search_decimation);
     return full_search(
         lim_low, lim_high, exclude_interval,
-        target_block, target_block_frames,
-        search_block, search_block_frames,
-        channels,
-        energy_target_block, energy_candidate_blocks);
+        p->target_block, p->ola_window_size,
+        p->search_block, p->search_block_size,
+        p->channels,
+        p->energy_target_block, p->energy_candidate_blocks,
+        p->dot_prod_candidate_blocks,
+        p->use_fft_search ? 1 : search_decimation);
 }
 
 static void peek_buffer(struct mp_scaletempo2 *p,
-    int frames, int read_offset, int write_offset, float **dest)
+    int frames, int read_offset, int write_offset, float **dest,
+    int ch_start, int ch_end)
 {
     assert(p->input_buffer_frames >= frames);
-    for (int i = 0; i < p->channels; ++i) {
+    for (int i = ch_start; i < ch_end; ++i) {
         memcpy(dest[i] + write_offset,
             p->input_buffer[i] + read_offset,
             frames * sizeof(float));
@@ -429,7 +474,7 @@ static void seek_buffer(struct mp_scaletempo2 *p, int frames)
 
 static void read_buffer(struct mp_scaletempo2 *p, int frames, float **dest)
 {
-    peek_buffer(p, frames, 0, 0, dest);
+    peek_buffer(p, frames, 0, 0, dest, 0, p->channels);
     seek_buffer(p, frames);
 }
 
@@ -508,7 +553,9 @@ static bool target_is_within_search_region(struct mp_scaletempo2 *p)
 }
 
 
+// Like peek_buffer(), for the channels of |s|.
 static void peek_audio_with_zero_prepend(struct mp_scaletempo2 *p,
+    struct mp_scaletempo2_slice *s,
     int read_offset_frames, float **dest, int dest_frames)
 {
     assert(read_offset_frames + dest_frames <= p->input_buffer_frames);
@@ -521,9 +568,84 @@ static void peek_audio_with_zero_prepend(struct mp_scaletempo2 *p,
         read_offset_frames = 0;
         num_frames_to_read -= num_zero_frames_appended;
         write_offset = num_zero_frames_appended;
-        zero_2d_partial(dest, p->channels, num_zero_frames_appended);
+        zero_2d_partial(dest + s->ch_start, s->ch_end - s->ch_start,
+                        num_zero_frames_appended);
+    }
+    peek_buffer(p, num_frames_to_read, read_offset_frames, write_offset, dest,
+                s->ch_start, s->ch_end);
+}
+
+static void run_slice_thread(void *ptr)
+{
+    struct mp_scaletempo2_slice *s = ptr;
+
+    s->fn(s->p, s);
+    mp_waiter_wakeup(&s->waiter, 0);
+}
+
+// Run fn on all channel slices in parallel, and wait until all are done.
+static void run_slices(struct mp_scaletempo2 *p,
+    void (*fn)(struct mp_scaletempo2 *p, struct mp_scaletempo2_slice *s))
+{
+    for (int n = 1; n < p->num_slices; n++) {
+        struct mp_scaletempo2_slice *s = &p->slices[n];
+
+        s->fn = fn;
+        s->waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+
+        bool r = mp_thread_pool_run(p->thread_pool, run_slice_thread, s);
+        // The pool has a thread reserved for each slice.
+        assert(r);
+    }
+
+    fn(p, &p->slices[0]);
+
+    for (int n = 1; n < p->num_slices; n++)
+        mp_waiter_wait(&p->slices[n].waiter);
+}
+
+// Extract the target and search blocks of the channels of |s|, and compute
+// everything compute_optimal_index() needs from them.
+static void search_slice(struct mp_scaletempo2 *p,
+                         struct mp_scaletempo2_slice *s)
+{
+    int ch = s->ch_start, num_ch = s->ch_end - s->ch_start;
+
+    peek_audio_with_zero_prepend(p, s,
+        p->target_block_index, p->target_block, p->ola_window_size);
+    peek_audio_with_zero_prepend(p, s,
+        p->search_block_index, p->search_block, p->search_block_size);
+
+    // Energy of all candid frames.
+    multi_channel_moving_block_energies(
+        p->search_block + ch,
+        p->search_block_size,
+        num_ch,
+        p->ola_window_size,
+        p->energy_candidate_blocks + ch);
+
+    // Energy of target frame.
+    multi_channel_dot_product(
+        p->target_block + ch, 0,
+        p->target_block + ch, 0,
+        num_ch,
+        p->ola_window_size, p->energy_target_block + ch);
+
+    if (p->use_fft_search) {
+        fft_candidate_dot_products(p, s);
+        return;
+    }
+
+    float dot_prod[MP_NUM_CHANNELS];
+    for (int n = 0; n < p->num_candidate_blocks; n += search_decimation) {
+        multi_channel_dot_product(
+            p->target_block + ch, 0,
+            p->search_block + ch, n,
+            num_ch,
+            p->ola_window_size, dot_prod);
+        for (int k = 0; k < num_ch; k++)
+            p->dot_prod_candidate_blocks[ch + k][n] = dot_prod[k];
     }
-    peek_buffer(p, num_frames_to_read, read_offset_frames, write_offset, dest);
 }
 
 static void get_optimal_block(struct mp_scaletempo2 *p)
@@ -536,13 +658,10 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
     const int exclude_interval_length_frames = 160;
     if (target_is_within_search_region(p)) {
         optimal_index = p->target_block_index;
-        peek_audio_with_zero_prepend(p,
-            optimal_index, p->optimal_block, p->ola_window_size);
+        p->blend_optimal_block = false;
     } else {
-        peek_audio_with_zero_prepend(p,
-            p->target_block_index, p->target_block, p->ola_window_size);
-        peek_audio_with_zero_prepend(p,
-            p->search_block_index, p->search_block, p->search_block_size);
+        run_slices(p, search_slice);
+
         int last_optimal = p->target_block_index
             - p->ola_hop_size - p->search_block_index;
         struct interval exclude_iterval = {
@@ -552,28 +671,36 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
 
         // |optimal_index| is in frames and it is relative to the beginning of the
         // |search_block|.
-        optimal_index = compute_optimal_index(
-            p->search_block, p->search_block_size,
-            p->target_block, p->ola_window_size,
-            p->energy_candidate_blocks,
-            p->channels,
-            exclude_iterval);
-
-        // Translate |index| w.r.t. the beginning of |audio_buffer| and extract the
-        // optimal block.
+        optimal_index = compute_optimal_index(p, exclude_iterval);
+
+        // Translate |index| w.r.t. the beginning of |audio_buffer|.
         optimal_index += p->search_block_index;
-        peek_audio_with_zero_prepend(p,
-            optimal_index, p->optimal_block, p->ola_window_size);
-
-        // Make a transition from target block to the optimal block if different.
-        // Target block has the best continuation to the current output.
-        // Optimal block is the most similar block to the target, however, it might
-        // introduce some discontinuity when over-lap-added. Therefore, we combine
-        // them for a smoother transition. The length of transition window is twice
-        // as that of the optimal-block which makes it like a weighting function
-        // where target-block has higher weight close to zero (weight of 1 at index
-        // 0) and lower weight close the end.
-        for (int k = 0; k < p->channels; ++k) {
+        p->blend_optimal_block = true;
+    }
+
+    p->optimal_block_index = optimal_index;
+    // Next target is one hop ahead of the current optimal.
+    p->target_block_index = optimal_index + p->ola_hop_size;
+}
+
+// Extract the optimal block for the channels of |s|, and overlap-and-add it to
+// |wsola_output|.
+static void overlap_add_slice(struct mp_scaletempo2 *p,
+                              struct mp_scaletempo2_slice *s)
+{
+    peek_audio_with_zero_prepend(p, s,
+        p->optimal_block_index, p->optimal_block, p->ola_window_size);
+
+    // Make a transition from target block to the optimal block if different.
+    // Target block has the best continuation to the current output.
+    // Optimal block is the most similar block to the target, however, it might
+    // introduce some discontinuity when over-lap-added. Therefore, we combine
+    // them for a smoother transition. The length of transition window is twice
+    // as that of the optimal-block which makes it like a weighting function
+    // where target-block has higher weight close to zero (weight of 1 at index
+    // 0) and lower weight close the end.
+    if (p->blend_optimal_block) {
+        for (int k = s->ch_start; k < s->ch_end; ++k) {
             float* ch_opt = p->optimal_block[k];
             float* ch_target = p->target_block[k];
             for (int n = 0; n < p->ola_window_size; ++n) {
@@ -583,8 +710,19 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
         }
     }
 
-    // Next target is one hop ahead of the current optimal.
-    p->target_block_index = optimal_index + p->ola_hop_size;
+    // Overlap-and-add.
+    for (int k = s->ch_start; k < s->ch_end; ++k) {
+        float* ch_opt_frame = p->optimal_block[k];
+        float* ch_output = p->wsola_output[k] + p->num_complete_frames;
+        for (int n = 0; n < p->ola_hop_size; ++n) {
+            ch_output[n] = ch_output[n] * p->ola_window[p->ola_hop_size + n] +
+                ch_opt_frame[n] * p->ola_window[n];
+        }
+
+        // Copy the second half to the output.
+        memcpy(&ch_output[p->ola_hop_size], &ch_opt_frame[p->ola_hop_size],
+               sizeof(*ch_opt_frame) * p->ola_hop_size);
+    }
 }
 
 static void update_output_time(struct mp_scaletempo2 *p,
@@ -621,20 +759,7 @@ static bool run_one_wsola_iteration(struct mp_scaletempo2 *p, float playback_rat
     }
 
     get_optimal_block(p);
-
-    // Overlap-and-add.
-    for (int k = 0; k < p->channels; ++k) {
-        float* ch_opt_frame = p->optimal_block[k];
-        float* ch_output = p->wsola_output[k] + p->num_complete_frames;
-        for (int n = 0; n < p->ola_hop_size; ++n) {
-            ch_output[n] = ch_output[n] * p->ola_window[p->ola_hop_size + n] +
-                ch_opt_frame[n] * p->ola_window[n];
-        }
-
-        // Copy the second half to the output.
-        memcpy(&ch_output[p->ola_hop_size], &ch_opt_frame[p->ola_hop_size],
-               sizeof(*ch_opt_frame) * p->ola_hop_size);
-    }
+    run_slices(p, overlap_add_slice);
 
     p->num_complete_frames += p->ola_hop_size;
     update_output_time(p, playback_rate, p->ola_hop_size);
@@ -699,6 +824,109 @@ bool mp_scaletempo2_frames_available(struct mp_scaletempo2 *p)
     return can_perform_wsola(p) || p->num_complete_frames > 0;
 }
 
+static void uninit_slices(struct mp_scaletempo2 *p)
+{
+    for (int n = 0; n < p->num_slices; n++) {
+        struct mp_scaletempo2_slice *s = &p->slices[n];
+        av_tx_uninit(&s->fft);
+        av_tx_uninit(&s->ifft);
+        av_freep(&s->fft_in);
+        av_freep(&s->fft_out);
+        av_freep(&s->fft_spectrum);
+    }
+    free(p->slices);
+    p->slices = NULL;
+    p->num_slices = 0;
+}
+
+// Rough cost of the direct search, which evaluates every |search_decimation|th
+// candidate and then the neighborhood of the best one, against the FFT search,
+// which needs 1.5 complex transforms plus the spectrum products per channel.
+// Both scale linearly with the channel count, so only the per-channel costs are
+// compared. The FFT is only picked with some margin, as the direct dot
+// products are vectorized and touch less memory.
+static bool want_fft_search(struct mp_scaletempo2 *p, int fft_size)
+{
+    if (p->opts->fft_search >= 0)
+        return p->opts->fft_search;
+    double direct = (p->num_candidate_blocks / (double)search_decimation
+                     + 2 * search_decimation + 1) * p->ola_window_size;
+    double fft = 1.5 * 2.5 * fft_size * log2(fft_size) + 10.0 * fft_size;
+    return direct > 1.5 * fft;
+}
+
+static bool init_slice_fft(struct mp_scaletempo2 *p,
+                           struct mp_scaletempo2_slice *s)
+{
+    const float scale = 1.0f;
+    if (av_tx_init(&s->fft, &s->fft_fn, AV_TX_FLOAT_FFT, 0, p->fft_size,
+                   &scale, 0) < 0 ||
+        av_tx_init(&s->ifft, &s->ifft_fn, AV_TX_FLOAT_FFT, 1, p->fft_size,
+                   &scale, 0) < 0)
+        return false;
+
+    s->fft_in = av_malloc_array(p->fft_size, sizeof(AVComplexFloat));
+    s->fft_out = av_malloc_array(p->fft_size, sizeof(AVComplexFloat));
+    s->fft_spectrum = av_malloc_array(p->fft_size, sizeof(AVComplexFloat));
+    return s->fft_in && s->fft_out && s->fft_spectrum;
+}
+
+// Upper limit for the automatically chosen number of slices. Every WSOLA
+// iteration synchronizes with the worker threads twice, so many small slices
+// would spend more time waiting than working.
+#define MAX_AUTO_SLICES 4
+
+static void init_slices(struct mp_scaletempo2 *p)
+{
+    uninit_slices(p);
+
+    p->fft_size = 1;
+    while (p->fft_size < p->search_block_size)
+        p->fft_size *= 2;
+    p->use_fft_search = want_fft_search(p, p->fft_size);
+
+    int slices = p->opts->threads;
+    if (slices < 1) {
+        slices = MPMIN(av_cpu_count(), MAX_AUTO_SLICES);
+        slices = MPMIN(slices, p->channels / 2);
+    }
+    slices = MPCLAMP(slices, 1, p->channels);
+    int slice_channels = (p->channels + slices - 1) / slices;
+    // The FFT search transforms channels in pairs.
+    if (p->use_fft_search)
+        slice_channels += slice_channels & 1;
+    slices = (p->channels + slice_channels - 1) / slice_channels;
+
+    int threads = slices - 1;
+    if (threads != p->num_threads) {
+        TA_FREEP(&p->thread_pool);
+        p->num_threads = 0;
+        if (threads) {
+            p->thread_pool = mp_thread_pool_create(NULL, threads, threads,
+                                                   threads);
+            if (p->thread_pool)
+                p->num_threads = threads;
+        }
+    }
+    if (threads != p->num_threads) {
+        // No threads, process everything on the caller's thread.
+        slices = 1;
+        slice_channels = p->channels;
+    }
+
+    p->num_slices = slices;
+    p->slices = calloc(slices, sizeof(p->slices[0]));
+    for (int n = 0; n < slices; n++) {
+        struct mp_scaletempo2_slice *s = &p->slices[n];
+        s->p = p;
+        s->ch_start = n * slice_channels;
+        s->ch_end = MPMIN(s->ch_start + slice_channels, p->channels);
+        // Not fatal, the direct search always works.
+        if (p->use_fft_search && !init_slice_fft(p, s))
+            p->use_fft_search = false;
+    }
+}
+
 void mp_scaletempo2_destroy(struct mp_scaletempo2 *p)
 {
     free(p->ola_window);
@@ -709,6 +937,9 @@ void mp_scaletempo2_destroy(struct mp_scaletempo2 *p)
     free(p->target_block);
     free(p->input_buffer);
     free(p->energy_candidate_blocks);
+    free(p->dot_prod_candidate_blocks);
+    uninit_slices(p);
+    TA_FREEP(&p->thread_pool);
 }
 
 void mp_scaletempo2_reset(struct mp_scaletempo2 *p)
@@ -791,6 +1022,10 @@ void mp_scaletempo2_init(struct mp_scaletempo2 *p, int channels, int rate)
     resize_input_buffer(p, 4 * MPMAX(p->ola_window_size, p->search_block_size));
     p->input_buffer_frames = 0;
 
-    p->energy_candidate_blocks = realloc(p->energy_candidate_blocks,
-        sizeof(float) * p->channels * p->num_candidate_blocks);
+    p->energy_candidate_blocks = realloc_2d(p->energy_candidate_blocks,
+        p->channels, p->num_candidate_blocks);
+    p->dot_prod_candidate_blocks = realloc_2d(p->dot_prod_candidate_blocks,
+        p->channels, p->num_candidate_blocks);
+
+    init_slices(p);
 }
@@ -29,7 +29,11 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <libavutil/tx.h>
+
+#include "audio/chmap.h"
 #include "common/common.h"
+#include "misc/thread_tools.h"
 
 struct mp_scaletempo2_opts {
     // Max/min supported playback rates for fast/slow audio. Audio outside of these
@@ -43,6 +47,26 @@ struct mp_scaletempo2_opts {
     // [-delta delta] around |output_index| * |playback_rate|. So the search
     // interval is 2 * delta.
     float wsola_search_interval_ms;
+    // Whether to correlate via FFT instead of per-candidate dot products.
+    // -1 selects it automatically based on the search and window sizes.
+    int fft_search;
+    // Number of channel slices processed in parallel, 0 for automatic.
+    int threads;
+};
+
+struct mp_scaletempo2;
+
+// A range of channels, whose per-channel work of a WSOLA iteration runs on one
+// thread.
+struct mp_scaletempo2_slice {
+    struct mp_scaletempo2 *p;
+    int ch_start, ch_end;
+    void (*fn)(struct mp_scaletempo2 *p, struct mp_scaletempo2_slice *s);
+    struct mp_waiter waiter;
+    // FFT search state, see |use_fft_search|.
+    AVTXContext *fft, *ifft;
+    av_tx_fn fft_fn, ifft_fn;
+    AVComplexFloat *fft_in, *fft_out, *fft_spectrum;
 };
 
 struct mp_scaletempo2 {
@@ -108,7 +132,27 @@ struct mp_scaletempo2 {
     float **input_buffer;
     int input_buffer_size;
     int input_buffer_frames;
-    float *energy_candidate_blocks;
+    // Energies of all candidate blocks, per channel.
+    float **energy_candidate_blocks;
+    float energy_target_block[MP_NUM_CHANNELS];
+    // Dot products of |target_block| with the candidate blocks, per channel.
+    // Only every |search_decimation|th candidate is precomputed, the others
+    // are filled in by the full search as needed.
+    float **dot_prod_candidate_blocks;
+    // FFT correlation of |target_block| against all candidate blocks at once.
+    // Precomputes all dot products if set.
+    bool use_fft_search;
+    int fft_size;
+    // Start of the optimal block in |input_buffer|, and whether it has to be
+    // blended with |target_block|.
+    int optimal_block_index;
+    bool blend_optimal_block;
+    // The channels are split into slices, all but the first of which are
+    // processed on |thread_pool|.
+    struct mp_scaletempo2_slice *slices;
+    int num_slices;
+    struct mp_thread_pool *thread_pool;
+    int num_threads;
 };
 
 void mp_scaletempo2_destroy(struct mp_scaletempo2 *p);
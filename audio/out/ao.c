@@ -182,6 +182,7 @@ static struct ao *ao_alloc(bool probing, struct mpv_global *global,
     if (!ao->priv)
         goto error;
     ao_set_gain(ao, 1.0f);
+    ao->gain_target = NAN;
     return ao;
 error:
     talloc_free(ao);
@@ -351,6 +352,47 @@ struct ao *ao_init_best(struct mpv_global *global,
     return ao;
 }
 
+// Open an AO for use with ao_add_sink(). spec is "<driver>[/<device>]", like
+// the --audio-device option. Fails if the driver can't use exactly the given
+// format, because the sink is fed the same data as the main AO.
+struct ao *ao_init_sink(struct mpv_global *global,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx,
+                        struct encode_lavc_context *encode_lavc_ctx,
+                        const char *spec, int samplerate, int format,
+                        struct mp_chmap channels)
+{
+    void *tmp = talloc_new(NULL);
+    struct mp_log *log = mp_log_new(tmp, global->log, "ao");
+    struct ao *ao = NULL;
+
+    char *name, *dev;
+    split_ao_device(tmp, (char *)spec, &name, &dev);
+    if (!name) {
+        mp_err(log, "No audio driver set for sink '%s'.\n", spec);
+        goto done;
+    }
+
+    ao = ao_init(false, global, wakeup_cb, wakeup_ctx, encode_lavc_ctx, 0,
+                 samplerate, format, channels, dev, name);
+    if (!ao) {
+        mp_err(log, "Failed to initialize audio sink '%s'\n", spec);
+        goto done;
+    }
+
+    if (ao->samplerate != samplerate || ao->format != format ||
+        !mp_chmap_equals(&ao->channels, &channels))
+    {
+        MP_ERR(ao, "Audio sink does not support %d Hz, %s channels, %s.\n",
+               samplerate, mp_chmap_to_str(&channels), af_fmt_to_str(format));
+        ao_uninit(ao);
+        ao = NULL;
+    }
+
+done:
+    talloc_free(tmp);
+    return ao;
+}
+
 // Query the AO_EVENT_*s as requested by the events parameter, and return them.
 int ao_query_and_reset_events(struct ao *ao, int events)
 {
@@ -604,50 +646,373 @@ void ao_set_gain(struct ao *ao, float gain)
     atomic_store(&ao->gain, gain);
 }
 
-#define MUL_GAIN_i(d, num_samples, gain, low, center, high)                     \
-    for (int n = 0; n < (num_samples); n++)                                     \
-        (d)[n] = MPCLAMP(                                                       \
-            ((((int64_t)((d)[n]) - (center)) * (gain) + 128) >> 8) + (center),  \
+#define GAIN_i(s, gi, low, center, high)                                        \
+    MPCLAMP(((((int64_t)(s) - (center)) * (gi) + 128) >> 8) + (center),        \
             (low), (high))
 
-#define MUL_GAIN_f(d, num_samples, gain)                                        \
-    for (int n = 0; n < (num_samples); n++)                                     \
-        (d)[n] = MPCLAMP(((d)[n]) * (gain), -1.0, 1.0)
+#define GAIN_f(s, gain) MPCLAMP((s) * (gain), -1.0, 1.0)
+
+// The LSB is always ignored.
+#if BYTE_ORDER == BIG_ENDIAN
+#define SHIFT24(x) ((3-(x))*8)
+#else
+#define SHIFT24(x) (((x)+1)*8)
+#endif
 
-static void process_plane(struct ao *ao, void *data, int num_samples)
+static inline void pack24(int pack, void *dst, int n, uint32_t val)
 {
-    float gain = atomic_load_explicit(&ao->gain, memory_order_relaxed);
-    int gi = lrint(256.0 * gain);
-    if (gi == 256)
+    uint8_t *ptr = (uint8_t *)dst + n * (pack == 1 ? 3 : 4);
+    ptr[0] = val >> SHIFT24(0);
+    ptr[1] = val >> SHIFT24(1);
+    ptr[2] = val >> SHIFT24(2);
+    if (pack == 2)
+        ptr[3] = 0;
+}
+
+// Reference implementation of ao_gain_apply(), one sample at a time. Used
+// by the unit test to check the optimized version.
+void ao_gain_apply_ref(int fmt, int pack, void *dst, void *src, int frames,
+                       int channels, float gain, float step)
+{
+    switch (fmt) {
+    case AF_FORMAT_U8:
+    case AF_FORMAT_S16:
+    case AF_FORMAT_S32:
+    case AF_FORMAT_FLOAT:
+    case AF_FORMAT_DOUBLE:
+        break;
+    default:
+        // all other sample formats are simply not supported
+        if (dst != src)
+            memcpy(dst, src, frames * channels * af_fmt_to_bytes(fmt));
+        return;
+    }
+
+    if (!step && lrint(256.0 * gain) == 256) {
+        // Not processed at all, not even clamped.
+        if (pack) {
+            for (int n = 0; n < frames * channels; n++)
+                pack24(pack, dst, n, ((int32_t *)src)[n]);
+        } else if (dst != src) {
+            memcpy(dst, src, frames * channels * af_fmt_to_bytes(fmt));
+        }
         return;
-    switch (af_fmt_from_planar(ao->format)) {
+    }
+
+    for (int f = 0; f < frames; f++) {
+        float g = gain + f * step;
+        int gi = lrint(256.0 * g);
+        for (int c = 0; c < channels; c++) {
+            int n = f * channels + c;
+            switch (fmt) {
+            case AF_FORMAT_U8:
+                ((uint8_t *)dst)[n] = GAIN_i(((uint8_t *)src)[n], gi, 0, 128, 255);
+                break;
+            case AF_FORMAT_S16:
+                ((int16_t *)dst)[n] = GAIN_i(((int16_t *)src)[n], gi,
+                                             INT16_MIN, 0, INT16_MAX);
+                break;
+            case AF_FORMAT_S32: {
+                int32_t v = GAIN_i(((int32_t *)src)[n], gi,
+                                   INT32_MIN, 0, INT32_MAX);
+                if (pack) {
+                    pack24(pack, dst, n, v);
+                } else {
+                    ((int32_t *)dst)[n] = v;
+                }
+                break;
+            }
+            case AF_FORMAT_FLOAT:
+                ((float *)dst)[n] = GAIN_f(((float *)src)[n], g);
+                break;
+            case AF_FORMAT_DOUBLE:
+                ((double *)dst)[n] = GAIN_f(((double *)src)[n], g);
+                break;
+            }
+        }
+    }
+}
+
+// Gain ramp: the gain changes with every frame, so this is not vectorized.
+// Ramps are short and happen on volume changes only.
+#define RAMP_i(type, low, center, high)                                         \
+    for (int f = 0; f < frames; f++) {                                          \
+        int gi = lrint(256.0 * (gain + f * step));                              \
+        for (int c = 0; c < channels; c++) {                                    \
+            int n = f * channels + c;                                           \
+            ((type *)dst)[n] =                                                  \
+                GAIN_i(((type *)src)[n], gi, low, center, high);                \
+        }                                                                       \
+    }
+
+#define RAMP_f(type)                                                            \
+    for (int f = 0; f < frames; f++) {                                          \
+        float g = gain + f * step;                                              \
+        for (int c = 0; c < channels; c++) {                                    \
+            int n = f * channels + c;                                           \
+            ((type *)dst)[n] = GAIN_f(((type *)src)[n], g);                     \
+        }                                                                       \
+    }
+
+static bool gain_ramp(int fmt, void *dst, void *src, int frames, int channels,
+                      float gain, float step)
+{
+    switch (fmt) {
+    case AF_FORMAT_U8:      RAMP_i(uint8_t, 0, 128, 255);                 break;
+    case AF_FORMAT_S16:     RAMP_i(int16_t, INT16_MIN, 0, INT16_MAX);     break;
+    case AF_FORMAT_S32:     RAMP_i(int32_t, INT32_MIN, 0, INT32_MAX);     break;
+    case AF_FORMAT_FLOAT:   RAMP_f(float);                                break;
+    case AF_FORMAT_DOUBLE:  RAMP_f(double);                               break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+#if HAVE_VECTOR
+
+typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
+typedef int32_t v8si __attribute__ ((vector_size (32), aligned (1)));
+typedef double v4df __attribute__ ((vector_size (32), aligned (1)));
+typedef int64_t v4di __attribute__ ((vector_size (32), aligned (1)));
+
+// Select a where mask m is set, b otherwise.
+#define SELECT(m, a, b) (((m) & (a)) | (~(m) & (b)))
+
+// Constant gain, integer formats with sample values that fit into 17 bits
+// (after subtracting the center). All intermediate results fit into int32 if
+// gi is not too large, which is the case for any reasonable volume.
+#define GAIN_V8_i(type, low, center, high)                                      \
+    for (; n + 8 <= num_samples; n += 8) {                                      \
+        v8si v;                                                                 \
+        for (int i = 0; i < 8; i++)                                             \
+            v[i] = ((type *)src)[n + i];                                        \
+        v = (((v - (center)) * gi + 128) >> 8) + (center);                      \
+        v = SELECT(v < (low), (v8si){0} + (low), v);                            \
+        v = SELECT(v > (high), (v8si){0} + (high), v);                          \
+        for (int i = 0; i < 8; i++)                                             \
+            ((type *)dst)[n + i] = v[i];                                        \
+    }
+
+static int gain_v32(int32_t *dst, int32_t *src, int num_samples, int gi)
+{
+    int n = 0;
+    for (; n + 4 <= num_samples; n += 4) {
+        v4di v = {src[n], src[n + 1], src[n + 2], src[n + 3]};
+        v = (v * gi + 128) >> 8;
+        v = SELECT(v < INT32_MIN, (v4di){0} + INT32_MIN, v);
+        v = SELECT(v > INT32_MAX, (v4di){0} + INT32_MAX, v);
+        for (int i = 0; i < 4; i++)
+            dst[n + i] = v[i];
+    }
+    return n;
+}
+
+// Constant gain for num_samples samples. Returns the number of samples done.
+static int gain_vector(int fmt, void *dst, void *src, int num_samples,
+                       float gain, int gi)
+{
+    int n = 0;
+    switch (fmt) {
     case AF_FORMAT_U8:
-        MUL_GAIN_i((uint8_t *)data, num_samples, gi, 0, 128, 255);
+        GAIN_V8_i(uint8_t, 0, 128, 255);
         break;
     case AF_FORMAT_S16:
-        MUL_GAIN_i((int16_t *)data, num_samples, gi, INT16_MIN, 0, INT16_MAX);
+        if (gi < (1 << 16))
+            GAIN_V8_i(int16_t, INT16_MIN, 0, INT16_MAX);
         break;
     case AF_FORMAT_S32:
-        MUL_GAIN_i((int32_t *)data, num_samples, gi, INT32_MIN, 0, INT32_MAX);
+        n = gain_v32(dst, src, num_samples, gi);
         break;
     case AF_FORMAT_FLOAT:
-        MUL_GAIN_f((float *)data, num_samples, gain);
+        for (; n + 8 <= num_samples; n += 8) {
+            v8sf v = *(v8sf *)((float *)src + n) * gain;
+            v8si vi = (v8si)v;
+            vi = SELECT(v < -1.0f, (v8si)((v8sf){0} - 1.0f), vi);
+            vi = SELECT(v > 1.0f, (v8si)((v8sf){0} + 1.0f), vi);
+            *(v8sf *)((float *)dst + n) = (v8sf)vi;
+        }
         break;
     case AF_FORMAT_DOUBLE:
-        MUL_GAIN_f((double *)data, num_samples, gain);
+        for (; n + 4 <= num_samples; n += 4) {
+            v4df v = *(v4df *)((double *)src + n) * (double)gain;
+            v4di vi = (v4di)v;
+            vi = SELECT(v < -1.0, (v4di)((v4df){0} - 1.0), vi);
+            vi = SELECT(v > 1.0, (v4di)((v4df){0} + 1.0), vi);
+            *(v4df *)((double *)dst + n) = (v4df)vi;
+        }
         break;
-    default:;
-        // all other sample formats are simply not supported
     }
+    return n;
 }
 
-void ao_post_process_data(struct ao *ao, void **data, int num_samples)
+#else // !HAVE_VECTOR
+
+static int gain_vector(int fmt, void *dst, void *src, int num_samples,
+                       float gain, int gi)
+{
+    return 0;
+}
+
+#endif // HAVE_VECTOR
+
+// Constant gain, scalar. Does the remainder of what gain_vector() left.
+#define GAIN_LOOP_i(type, low, center, high)                                    \
+    for (int n = 0; n < num_samples; n++)                                       \
+        ((type *)dst)[n] = GAIN_i(((type *)src)[n], gi, low, center, high)
+
+#define GAIN_LOOP_f(type)                                                       \
+    for (int n = 0; n < num_samples; n++)                                       \
+        ((type *)dst)[n] = GAIN_f(((type *)src)[n], gain)
+
+static bool gain_const(int fmt, void *dst, void *src, int num_samples,
+                       float gain, int gi)
+{
+    int done = gain_vector(fmt, dst, src, num_samples, gain, gi);
+    int bytes = af_fmt_to_bytes(fmt);
+    dst = (char *)dst + done * bytes;
+    src = (char *)src + done * bytes;
+    num_samples -= done;
+
+    switch (fmt) {
+    case AF_FORMAT_U8:      GAIN_LOOP_i(uint8_t, 0, 128, 255);              break;
+    case AF_FORMAT_S16:     GAIN_LOOP_i(int16_t, INT16_MIN, 0, INT16_MAX);  break;
+    case AF_FORMAT_S32:     GAIN_LOOP_i(int32_t, INT32_MIN, 0, INT32_MAX);  break;
+    case AF_FORMAT_FLOAT:   GAIN_LOOP_f(float);                             break;
+    case AF_FORMAT_DOUBLE:  GAIN_LOOP_f(double);                            break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+static void pack_plane(int pack, void *dst, int32_t *src, int num_samples)
+{
+    if (pack == 2) {
+        // Store whole words; same byte layout as pack24().
+        for (int n = 0; n < num_samples; n++) {
+            uint32_t val = src[n];
+#if BYTE_ORDER == BIG_ENDIAN
+            val &= ~(uint32_t)0xFF;
+#else
+            val >>= 8;
+#endif
+            memcpy((uint8_t *)dst + n * 4, &val, 4);
+        }
+    } else {
+        for (int n = 0; n < num_samples; n++)
+            pack24(pack, dst, n, src[n]);
+    }
+}
+
+// Apply the gain to frames*channels samples of the sample format fmt (must not
+// be planar; pass each plane separately with channels=1), reading from src and
+// writing to dst. dst and src can be the same, unless pack is set. The gain
+// of the first frame is gain, and increases by step with each following frame.
+// If pack is not 0, fmt must be AF_FORMAT_S32, and the output is packed to 24
+// bit (pack=1), or 24 bit with 8 bit MSB padding (pack=2). Formats other than
+// U8/S16/S32/FLOAT/DOUBLE are copied unchanged.
+void ao_gain_apply(int fmt, int pack, void *dst, void *src, int frames,
+                   int channels, float gain, float step)
+{
+    int gi = lrint(256.0 * gain);
+    int num_samples = frames * channels;
+
+    if (!pack) {
+        bool done = false;
+        if (step) {
+            done = gain_ramp(fmt, dst, src, frames, channels, gain, step);
+        } else if (gi != 256) {
+            done = gain_const(fmt, dst, src, num_samples, gain, gi);
+        }
+        if (!done && dst != src)
+            memcpy(dst, src, num_samples * af_fmt_to_bytes(fmt));
+        return;
+    }
+
+    assert(fmt == AF_FORMAT_S32);
+    if (!step && gi == 256) {
+        pack_plane(pack, dst, src, num_samples);
+        return;
+    }
+
+    // Gain into a small buffer that stays in the cache, then pack.
+    int32_t tmp[256];
+    int block = MPMAX(MP_ARRAY_SIZE(tmp) / channels, 1) * channels;
+    assert(block <= MP_ARRAY_SIZE(tmp));
+    for (int n = 0; n < num_samples; n += block) {
+        int count = MPMIN(block, num_samples - n);
+        if (step) {
+            gain_ramp(fmt, tmp, (int32_t *)src + n, count / channels, channels,
+                      gain + n / channels * step, step);
+        } else {
+            gain_const(fmt, tmp, (int32_t *)src + n, count, gain, gi);
+        }
+        pack_plane(pack, (uint8_t *)dst + n * (pack == 1 ? 3 : 4), tmp, count);
+    }
+}
+
+// Length of the ramp when the gain changes, in seconds.
+#define GAIN_RAMP_DURATION 0.01
+
+// Apply the AO gain to all planes, reading from src, writing to dst. If the
+// gain changed, ramp to the new gain. pack as in ao_gain_apply().
+static void process_gain(struct ao *ao, int pack, void **dst, void **src,
+                         int num_samples)
 {
+    float gain = atomic_load_explicit(&ao->gain, memory_order_relaxed);
+    if (isnan(ao->gain_target)) {
+        // Initial state or after reset: no ramp.
+        ao->gain_cur = ao->gain_target = gain;
+        ao->gain_ramp = 0;
+    } else if (gain != ao->gain_target) {
+        ao->gain_target = gain;
+        ao->gain_ramp = MPMAX(lrint(ao->samplerate * GAIN_RAMP_DURATION), 1);
+        ao->gain_step = (gain - ao->gain_cur) / ao->gain_ramp;
+    }
+
+    int fmt = af_fmt_from_planar(ao->format);
     bool planar = af_fmt_is_planar(ao->format);
     int planes = planar ? ao->channels.num : 1;
-    int plane_samples = num_samples * (planar ? 1: ao->channels.num);
-    for (int n = 0; n < planes; n++)
-        process_plane(ao, data[n], plane_samples);
+    int channels = planar ? 1 : ao->channels.num;
+    int dst_stride = (pack ? (pack == 1 ? 3 : 4) : af_fmt_to_bytes(fmt)) * channels;
+    int src_stride = af_fmt_to_bytes(fmt) * channels;
+
+    int pos = 0;
+    while (pos < num_samples) {
+        int frames = num_samples - pos;
+        float start = ao->gain_cur;
+        float step = 0;
+        if (ao->gain_ramp) {
+            frames = MPMIN(frames, ao->gain_ramp);
+            step = ao->gain_step;
+            start += step;
+        }
+        for (int n = 0; n < planes; n++) {
+            ao_gain_apply(fmt, pack, (char *)dst[n] + pos * dst_stride,
+                          (char *)src[n] + pos * src_stride, frames, channels,
+                          start, step);
+        }
+        if (ao->gain_ramp) {
+            ao->gain_ramp -= frames;
+            ao->gain_cur = ao->gain_ramp ? ao->gain_cur + step * frames
+                                         : ao->gain_target;
+        }
+        pos += frames;
+    }
+}
+
+void ao_post_process_data(struct ao *ao, void **data, int num_samples)
+{
+    process_gain(ao, 0, data, data, num_samples);
+}
+
+// Same as ao_post_process_data(), but read the samples from src, and write the
+// result to dst. This is done in a single pass, and dst can be the same as src.
+void ao_post_process_copy(struct ao *ao, void **dst, void **src,
+                          int num_samples)
+{
+    process_gain(ao, 0, dst, src, num_samples);
 }
 
 static int get_conv_type(struct ao_convert_fmt *fmt)
@@ -674,13 +1039,6 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
     return get_conv_type(fmt) != 0;
 }
 
-// The LSB is always ignored.
-#if BYTE_ORDER == BIG_ENDIAN
-#define SHIFT24(x) ((3-(x))*8)
-#else
-#define SHIFT24(x) (((x)+1)*8)
-#endif
-
 static void convert_plane(int type, void *data, int num_samples)
 {
     switch (type) {
@@ -705,6 +1063,26 @@ static void convert_plane(int type, void *data, int num_samples)
     }
 }
 
+// Combination of ao_post_process_copy() and ao_convert_inplace(), which reads
+// the samples from src, and writes the processed and converted samples to dst,
+// in a single pass. fmt->src_fmt and fmt->channels must be the same as the AO
+// parameters. dst must not overlap with src, unless no conversion is needed.
+void ao_post_process_convert(struct ao *ao, struct ao_convert_fmt *fmt,
+                             void **dst, void **src, int num_samples)
+{
+    int type = get_conv_type(fmt);
+    if (type == 0) {
+        ao_post_process_copy(ao, dst, src, num_samples);
+        return;
+    }
+
+    assert(type > 0);
+    assert(ao->format == fmt->src_fmt);
+    assert(ao->channels.num == fmt->channels);
+
+    process_gain(ao, type, dst, src, num_samples);
+}
+
 // data[n] contains the pointer to the first sample of the n-th plane, in the
 // format implied by fmt->src_fmt. src_fmt also controls whether the data is
 // all in one plane, or if there is a plane per channel.
@@ -98,6 +98,11 @@ struct ao *ao_init_best(struct mpv_global *global,
                         void (*wakeup_cb)(void *ctx), void *wakeup_ctx,
                         struct encode_lavc_context *encode_lavc_ctx,
                         int samplerate, int format, struct mp_chmap channels);
+struct ao *ao_init_sink(struct mpv_global *global,
+                        void (*wakeup_cb)(void *ctx), void *wakeup_ctx,
+                        struct encode_lavc_context *encode_lavc_ctx,
+                        const char *spec, int samplerate, int format,
+                        struct mp_chmap channels);
 void ao_uninit(struct ao *ao);
 void ao_get_format(struct ao *ao,
                    int *samplerate, int *format, struct mp_chmap *channels);
@@ -114,6 +119,8 @@ void ao_drain(struct ao *ao);
 bool ao_is_playing(struct ao *ao);
 struct mp_async_queue;
 struct mp_async_queue *ao_get_queue(struct ao *ao);
+void ao_add_sink(struct ao *ao, struct ao *sink);
+struct ao *ao_get_sink(struct ao *ao, int index);
 int ao_query_and_reset_events(struct ao *ao, int events);
 int ao_add_events(struct ao *ao, int events);
 void ao_unblock(struct ao *ao);
@@ -208,6 +208,7 @@ const struct ao_driver audio_out_null = {
     .get_state = get_state,
     .set_pause = set_pause,
     .write     = audio_write,
+    .write_direct = true,
     .start     = start,
     .priv_size = sizeof(struct priv),
     .priv_defaults = &(const struct priv) {
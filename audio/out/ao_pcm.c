@@ -21,6 +21,9 @@
 
 #include "config.h"
 
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,25 +38,53 @@
 #include "internal.h"
 #include "common/msg.h"
 #include "osdep/endian.h"
+#include "osdep/threads.h"
 
 #ifdef __MINGW32__
 // for GetFileType to detect pipes
 #include <windows.h>
 #include <io.h>
+#else
+#include <unistd.h>
 #endif
 
+// Maximum amount of data the writer thread writes with a single fwrite().
+// Smaller chunks free ring space earlier.
+#define WRITE_CHUNK (256 * 1024)
+
 struct priv {
     char *outputfilename;
     int waveheader;
     int append;
+    int rf64;
+    int sync;
+    double buffer;
     uint64_t data_length;
     FILE *fp;
+
+    // Writer thread, used if buffer > 0. The audio thread appends to the ring,
+    // the writer thread removes data from it. The ring contents are accessed
+    // without lock, as each side only touches its own part of the ring.
+    bool thread_valid;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    uint8_t *ring;
+    size_t ring_size;
+    // All following fields are protected by lock.
+    size_t ring_rpos;   // read position (byte offset)
+    size_t ring_used;   // number of queued bytes starting at ring_rpos
+    bool write_error;
+    bool terminate;
 };
 
 #define WAV_ID_RIFF 0x46464952 /* "RIFF" */
 #define WAV_ID_WAVE 0x45564157 /* "WAVE" */
 #define WAV_ID_FMT  0x20746d66 /* "fmt " */
 #define WAV_ID_DATA 0x61746164 /* "data" */
+#define WAV_ID_RF64 0x34364652 /* "RF64" */
+#define WAV_ID_DS64 0x34367364 /* "ds64" */
+#define WAV_ID_JUNK 0x4b4e554a /* "JUNK" */
 #define WAV_ID_PCM  0x0001
 #define WAV_ID_FLOAT_PCM  0x0003
 #define WAV_ID_FORMAT_EXTENSIBLE 0xfffe
@@ -70,18 +101,41 @@ static void fput32le(uint32_t val, FILE *fp)
     fwrite(bytes, 1, 4, fp);
 }
 
-static void write_wave_header(struct ao *ao, FILE *fp, uint64_t data_length)
+static void fput64le(uint64_t val, FILE *fp)
+{
+    fput32le(val, fp);
+    fput32le(val >> 32, fp);
+}
+
+// If rf64 is set, the header reserves space for a ds64 chunk with a JUNK
+// chunk, and is turned into a RF64 header if data_length exceeds what the 32
+// bit WAV size fields can hold.
+static void write_wave_header(struct ao *ao, FILE *fp, uint64_t data_length,
+                              bool rf64)
 {
     uint16_t fmt = ao->format == AF_FORMAT_FLOAT ? WAV_ID_FLOAT_PCM : WAV_ID_PCM;
     int bits = af_fmt_to_bytes(ao->format) * 8;
+    int block_align = ao->channels.num * (bits / 8);
+    // 'WAVE' + 'fmt ' + 4 + 40 + data chunk hdr (8) [+ ds64/JUNK chunk (36)]
+    uint64_t riff_length = 12 + 40 + 8 + (rf64 ? 36 : 0) + data_length;
+    bool is_rf64 = rf64 && riff_length > 0xffffffff;
 
     // Master RIFF chunk
-    fput32le(WAV_ID_RIFF, fp);
-    // RIFF chunk size: 'WAVE' + 'fmt ' + 4 + 40 +
-    // data chunk hdr (8) + data length
-    fput32le(12 + 40 + 8 + data_length, fp);
+    fput32le(is_rf64 ? WAV_ID_RF64 : WAV_ID_RIFF, fp);
+    // RIFF chunk size
+    fput32le(is_rf64 ? 0xffffffff : riff_length, fp);
     fput32le(WAV_ID_WAVE, fp);
 
+    if (rf64) {
+        // ds64 chunk with the real 64 bit sizes, or JUNK placeholder
+        fput32le(is_rf64 ? WAV_ID_DS64 : WAV_ID_JUNK, fp);
+        fput32le(28, fp);
+        fput64le(is_rf64 ? riff_length : 0, fp);
+        fput64le(is_rf64 ? data_length : 0, fp);
+        fput64le(is_rf64 ? data_length / block_align : 0, fp);
+        fput32le(0, fp); // table length
+    }
+
     // Format chunk
     fput32le(WAV_ID_FMT, fp);
     fput32le(40, fp);
@@ -89,7 +143,7 @@ static void write_wave_header(struct ao *ao, FILE *fp, uint64_t data_length)
     fput16le(ao->channels.num, fp);
     fput32le(ao->samplerate, fp);
     fput32le(ao->bps, fp);
-    fput16le(ao->channels.num * (bits / 8), fp);
+    fput16le(block_align, fp);
     fput16le(bits, fp);
 
     // Extension chunk
@@ -104,7 +158,68 @@ static void write_wave_header(struct ao *ao, FILE *fp, uint64_t data_length)
 
     // Data chunk
     fput32le(WAV_ID_DATA, fp);
-    fput32le(data_length, fp);
+    fput32le(is_rf64 ? 0xffffffff : data_length, fp);
+}
+
+static bool sync_file(FILE *fp)
+{
+    if (fflush(fp))
+        return false;
+#ifdef __MINGW32__
+    return _commit(_fileno(fp)) == 0;
+#elif defined(__linux__)
+    return fdatasync(fileno(fp)) == 0;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
+
+static void *writer_thread(void *arg)
+{
+    struct ao *ao = arg;
+    struct priv *priv = ao->priv;
+    mpthread_set_name("ao/pcm");
+
+    pthread_mutex_lock(&priv->lock);
+    while (1) {
+        if (!priv->ring_used) {
+            if (priv->terminate)
+                break;
+            pthread_cond_wait(&priv->wakeup, &priv->lock);
+            continue;
+        }
+
+        // Write everything that was queued at this point as one batch.
+        size_t batch = priv->ring_used;
+        while (batch) {
+            size_t pos = priv->ring_rpos;
+            size_t len = MPMIN(MPMIN(batch, priv->ring_size - pos), WRITE_CHUNK);
+            bool error = priv->write_error;
+            pthread_mutex_unlock(&priv->lock);
+
+            if (!error && fwrite(priv->ring + pos, len, 1, priv->fp) != 1) {
+                MP_ERR(ao, "Error writing to file, discarding further data.\n");
+                error = true;
+            }
+            // The audio thread might be waiting for free space.
+            ao_wakeup_playthread(ao);
+
+            pthread_mutex_lock(&priv->lock);
+            priv->write_error |= error;
+            priv->ring_rpos = (pos + len) % priv->ring_size;
+            priv->ring_used -= len;
+            batch -= len;
+        }
+
+        if (priv->sync && !priv->write_error) {
+            pthread_mutex_unlock(&priv->lock);
+            if (!sync_file(priv->fp))
+                MP_WARN(ao, "Syncing the file failed.\n");
+            pthread_mutex_lock(&priv->lock);
+        }
+    }
+    pthread_mutex_unlock(&priv->lock);
+    return NULL;
 }
 
 static int init(struct ao *ao)
@@ -160,10 +275,27 @@ static int init(struct ao *ao)
         return -1;
     }
     if (priv->waveheader)  // Reserve space for wave header
-        write_wave_header(ao, priv->fp, 0x7ffff000);
+        write_wave_header(ao, priv->fp, 0x7ffff000, priv->rf64);
     ao->untimed = true;
     ao->device_buffer = 1 << 16;
 
+    if (priv->buffer > 0) {
+        int samples = MPMAX(lrint(priv->buffer * ao->samplerate), 1024);
+        priv->ring_size = (size_t)samples * ao->channels.num *
+                          af_fmt_to_bytes(ao->format);
+        priv->ring = talloc_size(priv, priv->ring_size);
+        pthread_mutex_init(&priv->lock, NULL);
+        pthread_cond_init(&priv->wakeup, NULL);
+        if (pthread_create(&priv->thread, NULL, writer_thread, ao)) {
+            MP_ERR(ao, "Failed to create writer thread.\n");
+            pthread_cond_destroy(&priv->wakeup);
+            pthread_mutex_destroy(&priv->lock);
+            fclose(priv->fp);
+            return -1;
+        }
+        priv->thread_valid = true;
+    }
+
     return 0;
 }
 
@@ -172,6 +304,17 @@ static void uninit(struct ao *ao)
 {
     struct priv *priv = ao->priv;
 
+    if (priv->thread_valid) {
+        // Let the writer thread write out everything that is still queued.
+        pthread_mutex_lock(&priv->lock);
+        priv->terminate = true;
+        pthread_cond_signal(&priv->wakeup);
+        pthread_mutex_unlock(&priv->lock);
+        pthread_join(priv->thread, NULL);
+        pthread_cond_destroy(&priv->wakeup);
+        pthread_mutex_destroy(&priv->lock);
+    }
+
     if (priv->waveheader) {    // Rewrite wave header
         bool broken_seek = false;
 #ifdef __MINGW32__
@@ -183,12 +326,12 @@ static void uninit(struct ao *ao)
         if (broken_seek || fseek(priv->fp, 0, SEEK_SET) != 0)
             MP_ERR(ao, "Could not seek to start, WAV size headers not updated!\n");
         else {
-            if (priv->data_length > 0xfffff000) {
+            if (priv->data_length > 0xfffff000 && !priv->rf64) {
                 MP_ERR(ao, "File larger than allowed for "
                        "WAV files, may play truncated!\n");
                 priv->data_length = 0xfffff000;
             }
-            write_wave_header(ao, priv->fp, priv->data_length);
+            write_wave_header(ao, priv->fp, priv->data_length, priv->rf64);
         }
     }
     fclose(priv->fp);
@@ -197,17 +340,49 @@ static void uninit(struct ao *ao)
 static bool audio_write(struct ao *ao, void **data, int samples)
 {
     struct priv *priv = ao->priv;
-    int len = samples * ao->sstride;
+    size_t len = (size_t)samples * ao->sstride;
+
+    if (!priv->thread_valid) {
+        bool ok = fwrite(data[0], len, 1, priv->fp) == 1;
+        if (ok && priv->sync)
+            ok = sync_file(priv->fp);
+        priv->data_length += len;
+        return ok;
+    }
 
-    fwrite(data[0], len, 1, priv->fp);
-    priv->data_length += len;
+    pthread_mutex_lock(&priv->lock);
+    size_t wpos = (priv->ring_rpos + priv->ring_used) % priv->ring_size;
+    bool error = priv->write_error;
+    assert(len <= priv->ring_size - priv->ring_used);
+    pthread_mutex_unlock(&priv->lock);
+
+    // The writer thread doesn't touch the free part of the ring.
+    uint8_t *src = data[0];
+    size_t part = MPMIN(len, priv->ring_size - wpos);
+    memcpy(priv->ring + wpos, src, part);
+    memcpy(priv->ring, src + part, len - part);
 
-    return true;
+    pthread_mutex_lock(&priv->lock);
+    priv->ring_used += len;
+    pthread_cond_signal(&priv->wakeup);
+    pthread_mutex_unlock(&priv->lock);
+
+    priv->data_length += len;
+    return !error;
 }
 
 static void get_state(struct ao *ao, struct mp_pcm_state *state)
 {
+    struct priv *priv = ao->priv;
+
     state->free_samples = ao->device_buffer;
+    if (priv->thread_valid) {
+        pthread_mutex_lock(&priv->lock);
+        size_t free_bytes = priv->ring_size - priv->ring_used;
+        pthread_mutex_unlock(&priv->lock);
+        state->free_samples = MPMIN(state->free_samples,
+                                    free_bytes / ao->sstride);
+    }
     state->queued_samples = 0;
     state->delay = 0;
 }
@@ -236,14 +411,21 @@ const struct ao_driver audio_out_pcm = {
     .get_state = get_state,
     .set_pause = set_pause,
     .write     = audio_write,
+    .write_direct = true,
     .start     = start,
     .reset     = reset,
     .priv_size = sizeof(struct priv),
-    .priv_defaults = &(const struct priv) { .waveheader = 1 },
+    .priv_defaults = &(const struct priv) {
+        .waveheader = 1,
+        .buffer = 2,
+    },
     .options = (const struct m_option[]) {
         {"file", OPT_STRING(outputfilename), .flags = M_OPT_FILE},
         {"waveheader", OPT_FLAG(waveheader)},
         {"append", OPT_FLAG(append)},
+        {"rf64", OPT_FLAG(rf64)},
+        {"buffer", OPT_DOUBLE(buffer), M_RANGE(0, 60)},
+        {"sync", OPT_FLAG(sync)},
         {0}
     },
     .options_prefix = "ao-pcm",
@@ -46,9 +46,6 @@ struct buffer_state {
     pthread_mutex_t pt_lock;
     pthread_cond_t pt_wakeup;
 
-    // Access from AO driver's thread only.
-    char *convert_buffer;
-
     // Immutable.
     struct mp_async_queue *queue;
 
@@ -61,6 +58,7 @@ struct buffer_state {
     bool streaming;             // AO streaming active
     bool playing;               // logically playing audio from buffer
     bool paused;                // logically paused
+    bool started;               // ao_start() called since last ao_reset()
 
     int64_t end_time_us;        // absolute output time of last played sample
 
@@ -81,6 +79,8 @@ struct buffer_state {
 
 static void *playthread(void *arg);
 
+static void resume_sink(struct ao *ao);
+
 void ao_wakeup_playthread(struct ao *ao)
 {
     struct buffer_state *p = ao->buffer_state;
@@ -114,27 +114,80 @@ struct mp_async_queue *ao_get_queue(struct ao *ao)
     return p->queue;
 }
 
+// Make sink an additional output of ao (see ao_get_sink()). The sink is
+// started, paused, reset, drained and destroyed along with ao. Software
+// volume is not applied to sinks.
+void ao_add_sink(struct ao *ao, struct ao *sink)
+{
+    assert(!ao->is_sink && !sink->num_sinks);
+    assert(ao->samplerate == sink->samplerate && ao->format == sink->format);
+
+    // The sink's queue is filled in lockstep with the one of ao, so it must
+    // be able to hold at least as much, or it would lose audio while ao is
+    // still buffering. Leave some room for when the sink is a bit late.
+    struct buffer_state *p = sink->buffer_state;
+    struct mp_async_queue_config cfg = {
+        .sample_unit = AQUEUE_UNIT_SAMPLES,
+        .max_samples = MPMAX(sink->buffer, ao->buffer * 2),
+        .max_bytes = INT64_MAX,
+    };
+    mp_async_queue_set_config(p->queue, cfg);
+
+    sink->is_sink = true;
+    MP_TARRAY_APPEND(ao, ao->sinks, ao->num_sinks, sink);
+}
+
+// Return the index-th sink added with ao_add_sink(), or NULL. The sink's queue
+// (ao_get_queue()) needs to be fed with the same data as the queue of ao.
+struct ao *ao_get_sink(struct ao *ao, int index)
+{
+    return index < ao->num_sinks ? ao->sinks[index] : NULL;
+}
+
+// Make sure p->pending contains audio data. Returns false if no data is
+// available.
+static bool fetch_pending(struct ao *ao, bool *eof)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    while (!p->pending || !mp_aframe_get_size(p->pending)) {
+        TA_FREEP(&p->pending);
+        struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
+        if (!frame.type)
+            return false; // we can't/don't want to block
+        if (frame.type != MP_FRAME_AUDIO) {
+            if (frame.type == MP_FRAME_EOF)
+                *eof = true;
+            mp_frame_unref(&frame);
+            continue;
+        }
+        p->pending = frame.data;
+    }
+
+    return true;
+}
+
 // Special behavior with data==NULL: caller uses p->pending.
-static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
+// If fmt is not NULL, data uses the format described by it (see
+// ao_read_data_converted()). The audio is copied, processed and converted in
+// a single pass from the queued frames to data.
+static int read_buffer(struct ao *ao, struct ao_convert_fmt *fmt, void **data,
+                       int samples, bool *eof)
 {
     struct buffer_state *p = ao->buffer_state;
     int pos = 0;
     *eof = false;
 
+    int planes = ao->num_planes;
+    int dst_sstride = ao->sstride;
+    if (fmt) {
+        bool planar = af_fmt_is_planar(fmt->src_fmt);
+        dst_sstride = fmt->dst_bits / 8 * (planar ? 1 : fmt->channels);
+    }
+
     while (p->playing && !p->paused && pos < samples) {
-        if (!p->pending || !mp_aframe_get_size(p->pending)) {
-            TA_FREEP(&p->pending);
-            struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
-            if (!frame.type)
-                break; // we can't/don't want to block
-            if (frame.type != MP_FRAME_AUDIO) {
-                if (frame.type == MP_FRAME_EOF)
-                    *eof = true;
-                mp_frame_unref(&frame);
-                continue;
-            }
-            p->pending = frame.data;
-        }
+        if (!fetch_pending(ao, eof))
+            break;
 
         if (!data)
             break;
@@ -142,9 +195,13 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
         int copy = mp_aframe_get_size(p->pending);
         uint8_t **fdata = mp_aframe_get_data_ro(p->pending);
         copy = MPMIN(copy, samples - pos);
-        for (int n = 0; n < ao->num_planes; n++) {
-            memcpy((char *)data[n] + pos * ao->sstride,
-                   fdata[n], copy * ao->sstride);
+        void *dst[MP_NUM_CHANNELS];
+        for (int n = 0; n < planes; n++)
+            dst[n] = (char *)data[n] + pos * dst_sstride;
+        if (fmt) {
+            ao_post_process_convert(ao, fmt, dst, (void **)fdata, copy);
+        } else {
+            ao_post_process_copy(ao, dst, (void **)fdata, copy);
         }
         mp_aframe_skip_samples(p->pending, copy);
         pos += copy;
@@ -161,32 +218,30 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
     }
 
     // pad with silence (underflow/paused/eof)
-    for (int n = 0; n < ao->num_planes; n++) {
-        af_fill_silence((char *)data[n] + pos * ao->sstride,
-                        (samples - pos) * ao->sstride,
-                        ao->format);
+    for (int n = 0; n < planes; n++) {
+        char *dst = (char *)data[n] + pos * dst_sstride;
+        int size = (samples - pos) * dst_sstride;
+        if (fmt) {
+            memset(dst, 0, size); // only signed formats are converted
+        } else {
+            af_fill_silence(dst, size, ao->format);
+        }
     }
 
-    ao_post_process_data(ao, data, pos);
     return pos;
 }
 
-// Read the given amount of samples in the user-provided data buffer. Returns
-// the number of samples copied. If there is not enough data (buffer underrun
-// or EOF), return the number of samples that could be copied, and fill the
-// rest of the user-provided buffer with silence.
-// This basically assumes that the audio device doesn't care about underruns.
-// If this is called in paused mode, it will always return 0.
-// The caller should set out_time_us to the expected delay until the last sample
-// reaches the speakers, in microseconds, using mp_time_us() as reference.
-int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+static int read_data(struct ao *ao, struct ao_convert_fmt *fmt, void **data,
+                     int samples, int64_t out_time_us)
 {
     struct buffer_state *p = ao->buffer_state;
     assert(!ao->driver->write);
 
     pthread_mutex_lock(&p->lock);
 
-    int pos = read_buffer(ao, data, samples, &(bool){0});
+    resume_sink(ao);
+
+    int pos = read_buffer(ao, fmt, data, samples, &(bool){0});
 
     if (pos > 0)
         p->end_time_us = out_time_us;
@@ -203,42 +258,31 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     return pos;
 }
 
+// Read the given amount of samples in the user-provided data buffer. Returns
+// the number of samples copied. If there is not enough data (buffer underrun
+// or EOF), return the number of samples that could be copied, and fill the
+// rest of the user-provided buffer with silence.
+// This basically assumes that the audio device doesn't care about underruns.
+// If this is called in paused mode, it will always return 0.
+// The caller should set out_time_us to the expected delay until the last sample
+// reaches the speakers, in microseconds, using mp_time_us() as reference.
+int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+{
+    return read_data(ao, NULL, data, samples, out_time_us);
+}
+
 // Same as ao_read_data(), but convert data according to *fmt.
 // fmt->src_fmt and fmt->channels must be the same as the AO parameters.
 int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
                            void **data, int samples, int64_t out_time_us)
 {
-    struct buffer_state *p = ao->buffer_state;
-    void *ndata[MP_NUM_CHANNELS] = {0};
-
     if (!ao_need_conversion(fmt))
         return ao_read_data(ao, data, samples, out_time_us);
 
     assert(ao->format == fmt->src_fmt);
     assert(ao->channels.num == fmt->channels);
 
-    bool planar = af_fmt_is_planar(fmt->src_fmt);
-    int planes = planar ? fmt->channels : 1;
-    int plane_samples = samples * (planar ? 1: fmt->channels);
-    int src_plane_size = plane_samples * af_fmt_to_bytes(fmt->src_fmt);
-    int dst_plane_size = plane_samples * fmt->dst_bits / 8;
-
-    int needed = src_plane_size * planes;
-    if (needed > talloc_get_size(p->convert_buffer) || !p->convert_buffer) {
-        talloc_free(p->convert_buffer);
-        p->convert_buffer = talloc_size(NULL, needed);
-    }
-
-    for (int n = 0; n < planes; n++)
-        ndata[n] = p->convert_buffer + n * src_plane_size;
-
-    int res = ao_read_data(ao, ndata, samples, out_time_us);
-
-    ao_convert_inplace(fmt, ndata, samples);
-    for (int n = 0; n < planes; n++)
-        memcpy(data[n], ndata[n], dst_plane_size);
-
-    return res;
+    return read_data(ao, fmt, data, samples, out_time_us);
 }
 
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg)
@@ -309,7 +353,9 @@ void ao_reset(struct ao *ao)
     }
     wakeup = p->playing;
     p->playing = false;
+    p->started = false;
     p->recover_pause = false;
+    ao->gain_target = NAN; // no gain ramp after seeking
     p->hw_paused = false;
     p->end_time_us = 0;
 
@@ -320,6 +366,9 @@ void ao_reset(struct ao *ao)
 
     if (wakeup)
         ao_wakeup_playthread(ao);
+
+    for (int n = 0; n < ao->num_sinks; n++)
+        ao_reset(ao->sinks[n]);
 }
 
 // Initiate playback. This moves from the stop/underrun state to actually
@@ -334,6 +383,7 @@ void ao_start(struct ao *ao)
     pthread_mutex_lock(&p->lock);
 
     p->playing = true;
+    p->started = true;
 
     if (!ao->driver->write && !p->paused && !p->streaming) {
         p->streaming = true;
@@ -347,6 +397,9 @@ void ao_start(struct ao *ao)
         ao->driver->start(ao);
 
     ao_wakeup_playthread(ao);
+
+    for (int n = 0; n < ao->num_sinks; n++)
+        ao_start(ao->sinks[n]);
 }
 
 void ao_set_paused(struct ao *ao, bool paused)
@@ -399,6 +452,9 @@ void ao_set_paused(struct ao *ao, bool paused)
 
     if (wakeup)
         ao_wakeup_playthread(ao);
+
+    for (int n = 0; n < ao->num_sinks; n++)
+        ao_set_paused(ao->sinks[n], paused);
 }
 
 // Whether audio is playing. This means that there is still data in the buffers,
@@ -422,6 +478,7 @@ void ao_drain(struct ao *ao)
     struct buffer_state *p = ao->buffer_state;
 
     pthread_mutex_lock(&p->lock);
+    resume_sink(ao);
     while (!p->paused && p->playing) {
         pthread_mutex_unlock(&p->lock);
         double delay = ao_get_delay(ao);
@@ -446,6 +503,10 @@ void ao_drain(struct ao *ao)
     }
     pthread_mutex_unlock(&p->lock);
 
+    // Sinks are typically behind, so this doesn't add much waiting.
+    for (int n = 0; n < ao->num_sinks; n++)
+        ao_drain(ao->sinks[n]);
+
     ao_reset(ao);
 }
 
@@ -459,6 +520,9 @@ void ao_uninit(struct ao *ao)
 {
     struct buffer_state *p = ao->buffer_state;
 
+    for (int n = 0; n < ao->num_sinks; n++)
+        ao_uninit(ao->sinks[n]);
+
     if (p && p->thread_valid) {
         pthread_mutex_lock(&p->pt_lock);
         p->terminate = true;
@@ -476,7 +540,6 @@ void ao_uninit(struct ao *ao)
         talloc_free(p->filter_root);
         talloc_free(p->queue);
         talloc_free(p->pending);
-        talloc_free(p->convert_buffer);
         talloc_free(p->temp_buf);
 
         pthread_cond_destroy(&p->wakeup);
@@ -568,11 +631,26 @@ static bool realloc_buf(struct ao *ao, int samples)
     return true;
 }
 
+// called locked
+// The player restarts the main AO after underruns (and EOF), but sinks have to
+// follow it on their own: resume as soon as there is new data.
+static void resume_sink(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    if (ao->is_sink && p->started && !p->playing &&
+        ((p->pending && mp_aframe_get_size(p->pending)) ||
+         mp_async_queue_get_samples(p->queue)))
+        p->playing = true;
+}
+
 // called locked
 static bool ao_play_data(struct ao *ao)
 {
     struct buffer_state *p = ao->buffer_state;
 
+    resume_sink(ao);
+
     if ((!p->playing || p->paused) && !ao->stream_silence)
         return false;
 
@@ -590,10 +668,25 @@ static bool ao_play_data(struct ao *ao)
 
     int samples = 0;
     bool got_eof = false;
+    bool direct = false;
     if (ao->driver->write_frames) {
         TA_FREEP(&p->pending);
-        samples = read_buffer(ao, NULL, 1, &got_eof);
+        samples = read_buffer(ao, NULL, NULL, 1, &got_eof);
         planes = (void **)&p->pending;
+    } else if (ao->driver->write_direct && p->playing && !p->paused &&
+               !p->recover_pause)
+    {
+        // Pass the planes of the queued frame to the driver without copying.
+        // This writes at most one frame; if space is left, we're retried.
+        if (fetch_pending(ao, &got_eof)) {
+            planes = (void **)mp_aframe_get_data_rw(p->pending);
+            if (planes) {
+                samples = MPMIN(mp_aframe_get_size(p->pending), space);
+                got_eof = false;
+                ao_post_process_data(ao, planes, samples);
+                direct = true;
+            }
+        }
     } else {
         if (!realloc_buf(ao, space)) {
             MP_ERR(ao, "Failed to allocate buffer.\n");
@@ -609,7 +702,7 @@ static bool ao_play_data(struct ao *ao)
         }
 
         if (!samples) {
-            samples = read_buffer(ao, planes, space, &got_eof);
+            samples = read_buffer(ao, NULL, planes, space, &got_eof);
             if (p->paused || (ao->stream_silence && !p->playing))
                 samples = space; // read_buffer() sets remainder to silent
         }
@@ -621,6 +714,9 @@ static bool ao_play_data(struct ao *ao)
             MP_ERR(ao, "Error writing audio to device.\n");
         MP_STATS(ao, "end ao fill");
 
+        if (direct)
+            mp_aframe_skip_samples(p->pending, samples);
+
         if (!p->streaming) {
             MP_VERBOSE(ao, "starting AO\n");
             ao->driver->start(ao);
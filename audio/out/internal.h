@@ -65,9 +65,21 @@ struct ao {
     // Float gain multiplicator
     mp_atomic_float gain;
 
+    // Software gain ramp state. Accessed by the audio thread only, or with
+    // the buffer lock held.
+    float gain_cur;             // gain applied to the last frame
+    float gain_target;          // gain the ramp ends at (NAN: no ramp)
+    float gain_step;            // gain change per frame
+    int gain_ramp;              // remaining frames of the ramp
+
     int buffer;
     double def_buffer;
     struct buffer_state *buffer_state;
+
+    // Additional outputs fed with the same data (ao_add_sink()). Owned.
+    struct ao **sinks;
+    int num_sinks;
+    bool is_sink;               // added to another AO with ao_add_sink()
 };
 
 void init_buffer_pre(struct ao *ao);
@@ -140,6 +152,10 @@ struct ao_driver {
     // If true, write units of entire frames. The write() call is modified to
     // use data==mp_aframe. Useful for encoding AO only.
     bool write_frames;
+    // If true, write() may be passed the planes of the queued audio frames
+    // directly, instead of a copy. A single write() call then never covers
+    // more than one frame, but the data can be modified in place.
+    bool write_direct;
     // Init the device using ao->format/ao->channels/ao->samplerate. If the
     // device doesn't accept these parameters, you can attempt to negotiate
     // fallback parameters, and set the ao format fields accordingly.
@@ -215,6 +231,12 @@ void ao_device_list_add(struct ao_device_list *list, struct ao *ao,
                         struct ao_device_desc *e);
 
 void ao_post_process_data(struct ao *ao, void **data, int num_samples);
+void ao_post_process_copy(struct ao *ao, void **dst, void **src,
+                          int num_samples);
+void ao_gain_apply(int fmt, int pack, void *dst, void *src, int frames,
+                   int channels, float gain, float step);
+void ao_gain_apply_ref(int fmt, int pack, void *dst, void *src, int frames,
+                       int channels, float gain, float step);
 
 struct ao_convert_fmt {
     int src_fmt;        // source AF_FORMAT_*
@@ -227,6 +249,8 @@ struct ao_convert_fmt {
 bool ao_can_convert_inplace(struct ao_convert_fmt *fmt);
 bool ao_need_conversion(struct ao_convert_fmt *fmt);
 void ao_convert_inplace(struct ao_convert_fmt *fmt, void **data, int num_samples);
+void ao_post_process_convert(struct ao *ao, struct ao_convert_fmt *fmt,
+                             void **dst, void **src, int num_samples);
 
 void ao_wakeup_playthread(struct ao *ao);
 
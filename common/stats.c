@@ -163,6 +163,8 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
 
                 e->cpu_start_ns = 0;
                 e->val_rt = e->val_th = 0;
+                if (e->type == VAL_TIME)
+                    e->val_d = 0;
                 if (e->type != VAL_THREAD_CPU_TIME)
                     e->type = 0;
             }
@@ -192,7 +194,9 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
             add_stat(out, e, "cpu", t_cpu, mp_tprintf(80, "%.2f ms", t_cpu));
             double t_rt = e->val_rt / 1e3;
             add_stat(out, e, "time", t_rt, mp_tprintf(80, "%.2f ms", t_rt));
+            add_stat(out, e, "calls", e->val_d, NULL);
             e->val_rt = e->val_th = 0;
+            e->val_d = 0;
             break;
         }
         case VAL_THREAD_CPU_TIME: {
@@ -304,6 +308,7 @@ void stats_time_end(struct stats_ctx *ctx, const char *name)
         e->type = VAL_TIME;
         e->val_rt += mp_time_us() - e->time_start_us;
         e->val_th += get_thread_cpu_time_ns(pthread_self()) - e->cpu_start_ns;
+        e->val_d += 1;
         e->time_start_us = 0;
     }
     pthread_mutex_unlock(&ctx->base->lock);
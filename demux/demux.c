@@ -271,6 +271,7 @@ struct demux_internal {
     double highest_av_pts;      // highest non-subtitle PTS seen - for duration
 
     bool blocked;
+    bool keyframes_only;        // return only keyframe packets on video streams
 
     // Transient state.
     double duration;
@@ -2700,6 +2701,12 @@ static int dequeue_packet(struct demux_stream *ds, double min_pts,
         eof = ds->back_range_count < 0;
     }
 
+    // Skip non-keyframes; the decoder would discard them anyway.
+    if (in->keyframes_only && ds->type == STREAM_VIDEO && !in->back_demuxing) {
+        while (ds->reader_head && !ds->reader_head->keyframe)
+            advance_reader_head(ds);
+    }
+
     ds->need_wakeup = !ds->reader_head;
     if (!ds->reader_head || eof) {
         if (!ds->eager) {
@@ -4124,6 +4131,18 @@ void demux_block_reading(struct demuxer *demuxer, bool block)
     pthread_mutex_unlock(&in->lock);
 }
 
+// If enabled, only keyframe packets are returned for video streams. This is
+// meant for fast scrubbing, and requires resyncing (seeking) when disabled.
+void demux_set_keyframes_only(struct demuxer *demuxer, bool enable)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    in->keyframes_only = enable;
+    pthread_mutex_unlock(&in->lock);
+}
+
 static void update_bytes_read(struct demux_internal *in)
 {
     struct demuxer *demuxer = in->d_thread;
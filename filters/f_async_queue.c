@@ -1,5 +1,6 @@
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "audio/aframe.h"
 #include "common/common.h"
@@ -15,37 +16,126 @@ struct mp_async_queue {
     struct async_queue *q;
 };
 
+struct slot {
+    struct mp_frame frame;
+    mp_atomic_double pts; // for max_duration checks from any thread
+};
+
+// The frames are passed through a single-producer/single-consumer ring buffer.
+// The producer (access filter "in") and consumer ("out") use it without taking
+// the lock. Everything else (reset, config changes, connecting filters,
+// growing the ring) takes the lock, and additionally waits until neither end
+// is accessing the queue (see exclusive_begin()).
 struct async_queue {
     mp_atomic_uint64 refcount;
 
     pthread_mutex_t lock;
 
-    // -- protected by lock
+    // -- written with lock held and exclusive access, read by producer and
+    //    consumer without lock
     struct mp_async_queue_config cfg;
-    bool active; // queue was resumed; consumer may request frames
-    bool reading; // data flow: reading => consumer has requested frames
-    int64_t samples_size; // queue size in the cfg.sample_unit
-    size_t byte_size; // queue size in bytes (using approx. frame sizes)
-    int num_frames;
-    struct mp_frame *frames;
-    int eof_count; // number of MP_FRAME_EOF in frames[], for draining
+    struct slot *slots;
+    uint64_t num_slots; // power of 2
     struct mp_filter *conn[2]; // filters: in (0), out (1)
+
+    // -- atomic
+    atomic_bool active; // queue was resumed; consumer may request frames
+    atomic_bool reading; // data flow: reading => consumer has requested frames
+    mp_atomic_uint64 head; // next slot written by the producer
+    mp_atomic_uint64 tail; // next slot read by the consumer
+    mp_atomic_int64 samples_size; // queue size in the cfg.sample_unit
+    mp_atomic_int64 byte_size; // queue size in bytes (using approx. frame sizes)
+    mp_atomic_int64 eof_count; // number of MP_FRAME_EOF in slots, for draining
+    atomic_bool exclusive; // a locked operation wants exclusive access
+    atomic_bool busy[2]; // producer (0) or consumer (1) is accessing the queue
 };
 
+// Must be called with the lock held. Waits until producer and consumer have
+// left the queue; they will take the lock instead of entering it until
+// exclusive_end() is called.
+static void exclusive_begin(struct async_queue *q)
+{
+    atomic_store(&q->exclusive, true);
+    while (atomic_load(&q->busy[0]) || atomic_load(&q->busy[1]))
+        sched_yield();
+}
+
+static void exclusive_end(struct async_queue *q)
+{
+    atomic_store(&q->exclusive, false);
+}
+
+// Called by producer (side==0) or consumer (side==1) before accessing the
+// queue. Returns true if the lock had to be taken, which must be passed to
+// queue_leave(). Must not be called with the lock held.
+static bool queue_enter(struct async_queue *q, int side)
+{
+    atomic_store(&q->busy[side], true);
+    if (!atomic_load(&q->exclusive))
+        return false;
+    atomic_store(&q->busy[side], false);
+    pthread_mutex_lock(&q->lock);
+    return true;
+}
+
+static void queue_leave(struct async_queue *q, int side, bool locked)
+{
+    if (locked) {
+        pthread_mutex_unlock(&q->lock);
+    } else {
+        atomic_store(&q->busy[side], false);
+    }
+}
+
+static uint64_t get_num_frames(struct async_queue *q)
+{
+    return atomic_load(&q->head) - atomic_load(&q->tail);
+}
+
+static struct slot *get_slot(struct async_queue *q, uint64_t index)
+{
+    return &q->slots[index & (q->num_slots - 1)];
+}
+
 static void reset_queue(struct async_queue *q)
 {
     pthread_mutex_lock(&q->lock);
-    q->active = q->reading = false;
-    for (int n = 0; n < q->num_frames; n++)
-        mp_frame_unref(&q->frames[n]);
-    q->num_frames = 0;
-    q->eof_count = 0;
-    q->samples_size = 0;
-    q->byte_size = 0;
+    exclusive_begin(q);
+    atomic_store(&q->active, false);
+    atomic_store(&q->reading, false);
+    uint64_t head = atomic_load(&q->head);
+    for (uint64_t n = atomic_load(&q->tail); n < head; n++)
+        mp_frame_unref(&get_slot(q, n)->frame);
+    atomic_store(&q->tail, head);
+    atomic_store(&q->eof_count, 0);
+    atomic_store(&q->samples_size, 0);
+    atomic_store(&q->byte_size, 0);
     for (int n = 0; n < 2; n++) {
         if (q->conn[n])
             mp_filter_wakeup(q->conn[n]);
     }
+    exclusive_end(q);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Called by the producer (outside of queue_enter()) if the ring is full.
+static void grow_queue(struct async_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    exclusive_begin(q);
+    uint64_t new_size = MPMAX(q->num_slots * 2, 16);
+    struct slot *slots = talloc_zero_array(q, struct slot, new_size);
+    uint64_t head = atomic_load(&q->head);
+    for (uint64_t n = atomic_load(&q->tail); n < head; n++) {
+        struct slot *src = get_slot(q, n);
+        struct slot *dst = &slots[n & (new_size - 1)];
+        dst->frame = src->frame;
+        atomic_store(&dst->pts, atomic_load(&src->pts));
+    }
+    talloc_free(q->slots);
+    q->slots = slots;
+    q->num_slots = new_size;
+    exclusive_end(q);
     pthread_mutex_unlock(&q->lock);
 }
 
@@ -93,13 +183,17 @@ static int64_t frame_get_samples(struct async_queue *q, struct mp_frame frame)
     return res;
 }
 
+// Must be called by the producer, or with the lock held.
 static bool is_full(struct async_queue *q)
 {
-    if (q->samples_size >= q->cfg.max_samples || q->byte_size >= q->cfg.max_bytes)
+    if (atomic_load(&q->samples_size) >= q->cfg.max_samples ||
+        atomic_load(&q->byte_size) >= q->cfg.max_bytes)
         return true;
-    if (q->num_frames >= 2 && q->cfg.max_duration > 0) {
-        double pts1 = mp_frame_get_pts(q->frames[q->num_frames - 1]);
-        double pts2 = mp_frame_get_pts(q->frames[0]);
+    uint64_t tail = atomic_load(&q->tail);
+    uint64_t head = atomic_load(&q->head);
+    if (head - tail >= 2 && q->cfg.max_duration > 0) {
+        double pts1 = atomic_load(&get_slot(q, tail)->pts);
+        double pts2 = atomic_load(&get_slot(q, head - 1)->pts);
         if (pts1 != MP_NOPTS_VALUE && pts2 != MP_NOPTS_VALUE &&
             pts2 - pts1 >= q->cfg.max_duration)
             return true;
@@ -114,20 +208,22 @@ static void account_frame(struct async_queue *q, struct mp_frame frame,
 {
     assert(dir == 1 || dir == -1);
 
-    q->samples_size += dir * frame_get_samples(q, frame);
-    q->byte_size += dir * mp_frame_approx_size(frame);
+    atomic_fetch_add(&q->samples_size, dir * frame_get_samples(q, frame));
+    atomic_fetch_add(&q->byte_size, dir * (int64_t)mp_frame_approx_size(frame));
 
     if (frame.type == MP_FRAME_EOF)
-        q->eof_count += dir;
+        atomic_fetch_add(&q->eof_count, dir);
 }
 
+// Requires exclusive access.
 static void recompute_sizes(struct async_queue *q)
 {
-    q->eof_count = 0;
-    q->samples_size = 0;
-    q->byte_size = 0;
-    for (int n = 0; n < q->num_frames; n++)
-        account_frame(q, q->frames[n], 1);
+    atomic_store(&q->eof_count, 0);
+    atomic_store(&q->samples_size, 0);
+    atomic_store(&q->byte_size, 0);
+    uint64_t head = atomic_load(&q->head);
+    for (uint64_t n = atomic_load(&q->tail); n < head; n++)
+        account_frame(q, get_slot(q, n)->frame, 1);
 }
 
 void mp_async_queue_set_config(struct mp_async_queue *queue,
@@ -143,10 +239,12 @@ void mp_async_queue_set_config(struct mp_async_queue *queue,
     cfg.max_samples = MPMAX(cfg.max_samples, 1);
 
     pthread_mutex_lock(&q->lock);
+    exclusive_begin(q);
     bool recompute = q->cfg.sample_unit != cfg.sample_unit;
     q->cfg = cfg;
     if (recompute)
         recompute_sizes(q);
+    exclusive_end(q);
     pthread_mutex_unlock(&q->lock);
 }
 
@@ -157,11 +255,7 @@ void mp_async_queue_reset(struct mp_async_queue *queue)
 
 bool mp_async_queue_is_active(struct mp_async_queue *queue)
 {
-    struct async_queue *q = queue->q;
-    pthread_mutex_lock(&q->lock);
-    bool res = q->active;
-    pthread_mutex_unlock(&q->lock);
-    return res;
+    return atomic_load(&queue->q->active);
 }
 
 bool mp_async_queue_is_full(struct mp_async_queue *queue)
@@ -178,8 +272,8 @@ void mp_async_queue_resume(struct mp_async_queue *queue)
     struct async_queue *q = queue->q;
 
     pthread_mutex_lock(&q->lock);
-    if (!q->active) {
-        q->active = true;
+    if (!atomic_load(&q->active)) {
+        atomic_store(&q->active, true);
         // Possibly make the consumer request new frames.
         if (q->conn[1])
             mp_filter_wakeup(q->conn[1]);
@@ -192,9 +286,9 @@ void mp_async_queue_resume_reading(struct mp_async_queue *queue)
     struct async_queue *q = queue->q;
 
     pthread_mutex_lock(&q->lock);
-    if (!q->active || !q->reading) {
-        q->active = true;
-        q->reading = true;
+    if (!atomic_load(&q->active) || !atomic_load(&q->reading)) {
+        atomic_store(&q->active, true);
+        atomic_store(&q->reading, true);
         // Possibly start producer/consumer.
         for (int n = 0; n < 2; n++) {
             if (q->conn[n])
@@ -206,20 +300,12 @@ void mp_async_queue_resume_reading(struct mp_async_queue *queue)
 
 int64_t mp_async_queue_get_samples(struct mp_async_queue *queue)
 {
-    struct async_queue *q = queue->q;
-    pthread_mutex_lock(&q->lock);
-    int64_t res = q->samples_size;
-    pthread_mutex_unlock(&q->lock);
-    return res;
+    return atomic_load(&queue->q->samples_size);
 }
 
 int mp_async_queue_get_frames(struct mp_async_queue *queue)
 {
-    struct async_queue *q = queue->q;
-    pthread_mutex_lock(&q->lock);
-    int res = q->num_frames;
-    pthread_mutex_unlock(&q->lock);
-    return res;
+    return get_num_frames(queue->q);
 }
 
 struct priv {
@@ -233,10 +319,12 @@ static void destroy(struct mp_filter *f)
     struct async_queue *q = p->q;
 
     pthread_mutex_lock(&q->lock);
+    exclusive_begin(q);
     for (int n = 0; n < 2; n++) {
         if (q->conn[n] == f)
             q->conn[n] = NULL;
     }
+    exclusive_end(q);
     pthread_mutex_unlock(&q->lock);
 
     unref_queue(q);
@@ -248,8 +336,11 @@ static void process_in(struct mp_filter *f)
     struct async_queue *q = p->q;
     assert(q->conn[0] == f);
 
-    pthread_mutex_lock(&q->lock);
-    if (!q->reading) {
+    if (get_num_frames(q) >= q->num_slots)
+        grow_queue(q);
+
+    bool locked = queue_enter(q, 0);
+    if (!atomic_load(&q->reading)) {
         // mp_async_queue_reset()/reset_queue() is usually called asynchronously,
         // so we might have requested a frame earlier, and now can't use it.
         // Discard it; the expectation is that this is a benign logical race
@@ -259,10 +350,17 @@ static void process_in(struct mp_filter *f)
             mp_frame_unref(&frame);
             MP_DBG(f, "discarding frame due to async reset\n");
         }
-    } else if (!is_full(q) && mp_pin_out_request_data(f->ppins[0])) {
+    } else if (!is_full(q) && get_num_frames(q) < q->num_slots &&
+               mp_pin_out_request_data(f->ppins[0]))
+    {
         struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+        uint64_t head = atomic_load(&q->head);
+        struct slot *slot = get_slot(q, head);
+        slot->frame = frame;
+        atomic_store(&slot->pts, mp_frame_get_pts(frame));
+        // Account before publishing, so the consumer can't see a negative size.
         account_frame(q, frame, 1);
-        MP_TARRAY_INSERT_AT(q, q->frames, q->num_frames, 0, frame);
+        atomic_store(&q->head, head + 1);
         // Notify reader that we have new frames.
         if (q->conn[1])
             mp_filter_wakeup(q->conn[1]);
@@ -272,9 +370,9 @@ static void process_in(struct mp_filter *f)
         if (p->notify && full)
             mp_filter_wakeup(p->notify);
     }
-    if (p->notify && !q->num_frames)
+    if (p->notify && !get_num_frames(q))
         mp_filter_wakeup(p->notify);
-    pthread_mutex_unlock(&q->lock);
+    queue_leave(q, 0, locked);
 }
 
 static void process_out(struct mp_filter *f)
@@ -286,22 +384,28 @@ static void process_out(struct mp_filter *f)
     if (!mp_pin_in_needs_data(f->ppins[0]))
         return;
 
-    pthread_mutex_lock(&q->lock);
-    if (q->active && !q->reading) {
-        q->reading = true;
-        mp_filter_wakeup(q->conn[0]);
+    if (atomic_load(&q->active) && !atomic_load(&q->reading)) {
+        pthread_mutex_lock(&q->lock);
+        if (atomic_load(&q->active) && !atomic_load(&q->reading)) {
+            atomic_store(&q->reading, true);
+            mp_filter_wakeup(q->conn[0]);
+        }
+        pthread_mutex_unlock(&q->lock);
     }
-    if (q->active && q->num_frames) {
-        struct mp_frame frame = q->frames[q->num_frames - 1];
-        q->num_frames -= 1;
+
+    bool locked = queue_enter(q, 1);
+    if (atomic_load(&q->active) && get_num_frames(q)) {
+        uint64_t tail = atomic_load(&q->tail);
+        struct mp_frame frame = get_slot(q, tail)->frame;
+        atomic_store(&q->tail, tail + 1);
         account_frame(q, frame, -1);
-        assert(q->samples_size >= 0);
+        assert(atomic_load(&q->samples_size) >= 0);
         mp_pin_in_write(f->ppins[0], frame);
         // Notify writer that we need new frames.
         if (q->conn[0])
             mp_filter_wakeup(q->conn[0]);
     }
-    pthread_mutex_unlock(&q->lock);
+    queue_leave(q, 1, locked);
 }
 
 static void reset(struct mp_filter *f)
@@ -312,7 +416,7 @@ static void reset(struct mp_filter *f)
     pthread_mutex_lock(&q->lock);
     // If the queue is in reading state, it is logical that it should request
     // input immediately.
-    if (mp_pin_get_dir(f->pins[0]) == MP_PIN_IN && q->reading)
+    if (mp_pin_get_dir(f->pins[0]) == MP_PIN_IN && atomic_load(&q->reading))
         mp_filter_wakeup(f);
     pthread_mutex_unlock(&q->lock);
 }
@@ -366,9 +470,11 @@ struct mp_filter *mp_async_queue_create_filter(struct mp_filter *parent,
     p->q = q;
 
     pthread_mutex_lock(&q->lock);
+    exclusive_begin(q);
     int slot = is_in ? 0 : 1;
     assert(!q->conn[slot]); // fails if already connected on this end
     q->conn[slot] = f;
+    exclusive_end(q);
     pthread_mutex_unlock(&q->lock);
 
     return f;
@@ -8,6 +8,8 @@
 // threads without synchronization, this provides 2 filters, which are
 // implicitly connected. (This seemed much saner than having special thread
 // safe mp_pins or such in the filter framework.)
+// Passing frames between the 2 filters, and querying the queue size, does not
+// take a lock.
 struct mp_async_queue;
 
 // Create a blank queue. Can be freed with talloc_free(). To use it, you need
@@ -0,0 +1,511 @@
+#include <math.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "audio/aframe.h"
+#include "audio/format.h"
+#include "common/common.h"
+
+#include "f_audio_meter.h"
+#include "filter_internal.h"
+
+#define CHUNK 1024              // samples converted and analyzed at once
+
+// True peak: ITU-R BS.1770-4 Annex 2, 4x oversampling with a 48 tap filter.
+#define TP_PHASES 4
+#define TP_TAPS 12
+#define TP_HISTORY (TP_TAPS - 1)
+
+static const float tp_coeffs[TP_PHASES][TP_TAPS] = {
+    { 0.0017089843750, 0.0109863281250, -0.0196533203125,  0.0332031250000,
+     -0.0594482421875, 0.1373291015625,  0.9721679687500, -0.1022949218750,
+      0.0476074218750,-0.0266113281250,  0.0148925781250, -0.0083007812500},
+    {-0.0291748046875, 0.0292968750000, -0.0517578125000,  0.0891113281250,
+     -0.1665039062500, 0.4650878906250,  0.7797851562500, -0.2003173828125,
+      0.1015625000000,-0.0582275390625,  0.0330810546875, -0.0189208984375},
+    {-0.0189208984375, 0.0330810546875, -0.0582275390625,  0.1015625000000,
+     -0.2003173828125, 0.7797851562500,  0.4650878906250, -0.1665039062500,
+      0.0891113281250,-0.0517578125000,  0.0292968750000, -0.0291748046875},
+    {-0.0083007812500, 0.0148925781250, -0.0266113281250,  0.0476074218750,
+     -0.1022949218750, 0.9721679687500,  0.1373291015625, -0.0594482421875,
+      0.0332031250000,-0.0196533203125,  0.0109863281250,  0.0017089843750},
+};
+
+// Loudness (EBU R128) is summed in 100ms blocks.
+#define BLOCK_SECS 0.1
+#define MOMENTARY_BLOCKS 4
+#define SHORT_TERM_BLOCKS 30
+
+struct biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+struct channel {
+    float *buf;                 // TP_HISTORY old samples, then CHUNK samples
+    double z[2][2];             // K-weighting filter state
+    float weight;               // loudness channel weight
+    // Accumulated over the current update interval.
+    float peak, true_peak;
+    double sum_sq;
+};
+
+struct priv {
+    struct mp_audio_meter public;
+
+    double rate_hz;             // 0 if disabled
+
+    struct mp_aframe *fmt;      // current format (NULL: reinit on next frame)
+    bool supported;
+    int format;                 // AF_FORMAT_* of fmt, non-planar
+    bool planar;
+    int num_ch;
+    int samplerate;
+    bool oversample;            // true peak uses oversampling
+    struct channel ch[MP_NUM_CHANNELS];
+    struct biquad kw[2];        // K-weighting: pre-filter, RLB filter
+
+    int interval_len, interval_pos;
+    int block_len, block_pos;
+    double block_sum;           // weighted K-weighted sum of squares
+    double blocks[SHORT_TERM_BLOCKS]; // ring buffer of finished block_sum
+    int num_blocks, cur_block;
+
+    bool have_values;
+    struct mp_audio_meter_values values;
+};
+
+#if HAVE_VECTOR
+
+typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
+typedef int32_t v8si __attribute__ ((vector_size (32), aligned (1)));
+
+#define V8SF_ABS(x) ((v8sf)((v8si)(x) & 0x7FFFFFFF))
+#define V8SF_MAX(a, b) \
+    ((v8sf)((((a) > (b)) & (v8si)(a)) | (~((a) > (b)) & (v8si)(b))))
+
+static float v8sf_hmax(const v8sf *x)
+{
+    float r = (*x)[0];
+    for (int i = 1; i < 8; i++)
+        r = MPMAX(r, (*x)[i]);
+    return r;
+}
+
+static void peak_sum_sq(const float *x, int n, float *peak, double *sum_sq)
+{
+    v8sf vpeak = {0};
+    v8sf vsum = {0};
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        v8sf v = *(v8sf *)(x + i);
+        vpeak = V8SF_MAX(vpeak, V8SF_ABS(v));
+        vsum += v * v;
+    }
+    float pk = v8sf_hmax(&vpeak);
+    double sum = 0;
+    for (int l = 0; l < 8; l++)
+        sum += vsum[l];
+    for (; i < n; i++) {
+        pk = MPMAX(pk, fabsf(x[i]));
+        sum += x[i] * x[i];
+    }
+    *peak = MPMAX(*peak, pk);
+    *sum_sq += sum;
+}
+
+// x[-TP_HISTORY..n-1] must be valid.
+static float true_peak(const float *x, int n)
+{
+    v8sf vpeak = {0};
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int p = 0; p < TP_PHASES; p++) {
+            v8sf acc = {0};
+            for (int k = 0; k < TP_TAPS; k++)
+                acc += tp_coeffs[p][k] * *(v8sf *)(x + i - k);
+            vpeak = V8SF_MAX(vpeak, V8SF_ABS(acc));
+        }
+    }
+    float pk = v8sf_hmax(&vpeak);
+    for (; i < n; i++) {
+        for (int p = 0; p < TP_PHASES; p++) {
+            float acc = 0;
+            for (int k = 0; k < TP_TAPS; k++)
+                acc += tp_coeffs[p][k] * x[i - k];
+            pk = MPMAX(pk, fabsf(acc));
+        }
+    }
+    return pk;
+}
+
+#else // !HAVE_VECTOR
+
+static void peak_sum_sq(const float *x, int n, float *peak, double *sum_sq)
+{
+    float pk = 0;
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        pk = MPMAX(pk, fabsf(x[i]));
+        sum += x[i] * x[i];
+    }
+    *peak = MPMAX(*peak, pk);
+    *sum_sq += sum;
+}
+
+static float true_peak(const float *x, int n)
+{
+    float pk = 0;
+    for (int i = 0; i < n; i++) {
+        for (int p = 0; p < TP_PHASES; p++) {
+            float acc = 0;
+            for (int k = 0; k < TP_TAPS; k++)
+                acc += tp_coeffs[p][k] * x[i - k];
+            pk = MPMAX(pk, fabsf(acc));
+        }
+    }
+    return pk;
+}
+
+#endif // HAVE_VECTOR
+
+// Run the K-weighting filter over x, and return the sum of squares of the
+// filtered signal. (Recursive, so not vectorized; it's cheap anyway.)
+static double k_weighted_sum_sq(struct priv *p, struct channel *ch,
+                                const float *x, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        double v = x[i];
+        for (int s = 0; s < 2; s++) {
+            struct biquad *b = &p->kw[s];
+            double *z = ch->z[s];
+            double y = b->b0 * v + z[0];
+            z[0] = b->b1 * v - b->a1 * y + z[1];
+            z[1] = b->b2 * v - b->a2 * y;
+            v = y;
+        }
+        sum += v * v;
+    }
+    return sum;
+}
+
+// BS.1770 K-weighting filter coefficients for any sample rate.
+static void init_k_weighting(struct priv *p)
+{
+    double rate = p->samplerate;
+
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10.0, gain / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    p->kw[0] = (struct biquad){
+        .b0 = (vh + vb * k / q + k * k) / a0,
+        .b1 = 2.0 * (k * k - vh) / a0,
+        .b2 = (vh - vb * k / q + k * k) / a0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    p->kw[1] = (struct biquad){
+        .b0 = 1.0,
+        .b1 = -2.0,
+        .b2 = 1.0,
+        .a1 = 2.0 * (k * k - 1.0) / a0,
+        .a2 = (1.0 - k / q + k * k) / a0,
+    };
+}
+
+static float channel_weight(int speaker)
+{
+    switch (speaker) {
+    case MP_SPEAKER_ID_LFE:
+    case MP_SPEAKER_ID_LFE2:
+        return 0;
+    case MP_SPEAKER_ID_BL:
+    case MP_SPEAKER_ID_BR:
+    case MP_SPEAKER_ID_SL:
+    case MP_SPEAKER_ID_SR:
+        return 1.41;
+    default:
+        return 1.0;
+    }
+}
+
+static float to_db(double v)
+{
+    return v > 0 ? MPMAX(20.0 * log10(v), MP_AUDIO_METER_FLOOR)
+                 : MP_AUDIO_METER_FLOOR;
+}
+
+static float to_lufs(double mean_sq)
+{
+    return mean_sq > 0 ? MPMAX(-0.691 + 10.0 * log10(mean_sq),
+                               MP_AUDIO_METER_FLOOR)
+                       : MP_AUDIO_METER_FLOOR;
+}
+
+static void reset_state(struct priv *p)
+{
+    for (int c = 0; c < p->num_ch; c++) {
+        struct channel *ch = &p->ch[c];
+        memset(ch->buf, 0, TP_HISTORY * sizeof(float));
+        memset(ch->z, 0, sizeof(ch->z));
+        ch->peak = ch->true_peak = 0;
+        ch->sum_sq = 0;
+    }
+    p->interval_pos = 0;
+    p->block_pos = 0;
+    p->block_sum = 0;
+    p->num_blocks = 0;
+    p->cur_block = 0;
+    p->have_values = false;
+}
+
+static void reinit(struct priv *p, struct mp_aframe *frame)
+{
+    if (!p->fmt)
+        p->fmt = talloc_steal(p, mp_aframe_create());
+    mp_aframe_config_copy(p->fmt, frame);
+
+    int format = mp_aframe_get_format(frame);
+    p->format = af_fmt_from_planar(format);
+    p->planar = af_fmt_is_planar(format);
+    p->samplerate = mp_aframe_get_rate(frame);
+    struct mp_chmap chmap = {0};
+    mp_aframe_get_chmap(frame, &chmap);
+    p->num_ch = chmap.num;
+
+    p->supported = p->samplerate > 0 && p->num_ch > 0 && p->rate_hz > 0;
+    switch (p->format) {
+    case AF_FORMAT_U8:
+    case AF_FORMAT_S16:
+    case AF_FORMAT_S32:
+    case AF_FORMAT_FLOAT:
+    case AF_FORMAT_DOUBLE:
+        break;
+    default:
+        p->supported = false;
+    }
+    if (!p->supported)
+        return;
+
+    // At high sample rates, the sample peak is close enough.
+    p->oversample = p->samplerate < 96000;
+    init_k_weighting(p);
+    p->interval_len = MPMAX(lrint(p->samplerate / p->rate_hz), 1);
+    p->block_len = MPMAX(lrint(p->samplerate * BLOCK_SECS), 1);
+
+    for (int c = 0; c < p->num_ch; c++) {
+        struct channel *ch = &p->ch[c];
+        if (!ch->buf)
+            ch->buf = talloc_array(p, float, TP_HISTORY + CHUNK);
+        ch->weight = channel_weight(chmap.speaker[c]);
+    }
+
+    p->values = (struct mp_audio_meter_values){.chmap = chmap};
+    reset_state(p);
+}
+
+// Convert n samples starting at offset to float, into each ch->buf.
+static void convert(struct priv *p, uint8_t **planes, int offset, int n)
+{
+    int bps = af_fmt_to_bytes(p->format);
+    for (int c = 0; c < p->num_ch; c++) {
+        float *dst = p->ch[c].buf + TP_HISTORY;
+        uint8_t *src;
+        int stride;
+        if (p->planar) {
+            src = planes[c] + offset * bps;
+            stride = 1;
+        } else {
+            src = planes[0] + (offset * p->num_ch + c) * bps;
+            stride = p->num_ch;
+        }
+        switch (p->format) {
+        case AF_FORMAT_U8:
+            for (int i = 0; i < n; i++)
+                dst[i] = (src[i * stride] - 128) / 128.0f;
+            break;
+        case AF_FORMAT_S16:
+            for (int i = 0; i < n; i++)
+                dst[i] = ((int16_t *)src)[i * stride] / 32768.0f;
+            break;
+        case AF_FORMAT_S32:
+            for (int i = 0; i < n; i++)
+                dst[i] = ((int32_t *)src)[i * stride] / 2147483648.0f;
+            break;
+        case AF_FORMAT_FLOAT:
+            for (int i = 0; i < n; i++)
+                dst[i] = ((float *)src)[i * stride];
+            break;
+        case AF_FORMAT_DOUBLE:
+            for (int i = 0; i < n; i++)
+                dst[i] = ((double *)src)[i * stride];
+            break;
+        }
+    }
+}
+
+static double sum_blocks(struct priv *p, int num)
+{
+    num = MPMIN(num, p->num_blocks);
+    if (!num)
+        return 0;
+    double sum = 0;
+    for (int n = 0; n < num; n++) {
+        int i = (p->cur_block - 1 - n + SHORT_TERM_BLOCKS) % SHORT_TERM_BLOCKS;
+        sum += p->blocks[i];
+    }
+    return sum / ((double)num * p->block_len);
+}
+
+static void end_block(struct priv *p)
+{
+    p->blocks[p->cur_block] = p->block_sum;
+    p->cur_block = (p->cur_block + 1) % SHORT_TERM_BLOCKS;
+    p->num_blocks = MPMIN(p->num_blocks + 1, SHORT_TERM_BLOCKS);
+    p->block_sum = 0;
+    p->block_pos = 0;
+}
+
+static void publish(struct priv *p, double pts)
+{
+    struct mp_audio_meter_values *v = &p->values;
+    for (int c = 0; c < p->num_ch; c++) {
+        struct channel *ch = &p->ch[c];
+        v->peak[c] = to_db(ch->peak);
+        v->rms[c] = to_db(sqrt(ch->sum_sq / p->interval_pos));
+        v->true_peak[c] = to_db(MPMAX(ch->true_peak, ch->peak));
+        ch->peak = ch->true_peak = 0;
+        ch->sum_sq = 0;
+    }
+    v->momentary = to_lufs(sum_blocks(p, MOMENTARY_BLOCKS));
+    v->short_term = to_lufs(sum_blocks(p, SHORT_TERM_BLOCKS));
+    v->pts = pts;
+    p->interval_pos = 0;
+    p->have_values = true;
+    p->public.updated = true;
+}
+
+void mp_audio_meter_feed(struct mp_audio_meter *m, struct mp_aframe *frame)
+{
+    struct priv *p = m->f->priv;
+
+    if (!p->rate_hz)
+        return;
+
+    if (!p->fmt || !mp_aframe_config_equals(p->fmt, frame))
+        reinit(p, frame);
+    if (!p->supported)
+        return;
+
+    uint8_t **planes = mp_aframe_get_data_ro(frame);
+    if (!planes)
+        return;
+
+    int size = mp_aframe_get_size(frame);
+    double pts = mp_aframe_get_pts(frame);
+    int pos = 0;
+    while (pos < size) {
+        int n = MPMIN(size - pos, CHUNK);
+        n = MPMIN(n, p->interval_len - p->interval_pos);
+        n = MPMIN(n, p->block_len - p->block_pos);
+
+        convert(p, planes, pos, n);
+
+        for (int c = 0; c < p->num_ch; c++) {
+            struct channel *ch = &p->ch[c];
+            float *x = ch->buf + TP_HISTORY;
+            peak_sum_sq(x, n, &ch->peak, &ch->sum_sq);
+            if (p->oversample)
+                ch->true_peak = MPMAX(ch->true_peak, true_peak(x, n));
+            if (ch->weight)
+                p->block_sum += ch->weight * k_weighted_sum_sq(p, ch, x, n);
+            memmove(ch->buf, ch->buf + n, TP_HISTORY * sizeof(float));
+        }
+
+        pos += n;
+        p->interval_pos += n;
+        p->block_pos += n;
+
+        if (p->block_pos == p->block_len)
+            end_block(p);
+        if (p->interval_pos == p->interval_len) {
+            publish(p, pts == MP_NOPTS_VALUE ? MP_NOPTS_VALUE
+                                             : pts + pos / (double)p->samplerate);
+        }
+    }
+}
+
+void mp_audio_meter_set_rate(struct mp_audio_meter *m, double rate)
+{
+    struct priv *p = m->f->priv;
+
+    if (p->rate_hz == rate)
+        return;
+    p->rate_hz = rate;
+    TA_FREEP(&p->fmt); // reinit on next frame
+    p->have_values = false;
+}
+
+bool mp_audio_meter_get_values(struct mp_audio_meter *m,
+                               struct mp_audio_meter_values *out)
+{
+    struct priv *p = m->f->priv;
+
+    if (!p->rate_hz || !p->have_values)
+        return false;
+    *out = p->values;
+    return true;
+}
+
+static void meter_process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (!mp_pin_can_transfer_data(f->ppins[1], f->ppins[0]))
+        return;
+
+    struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+    if (frame.type == MP_FRAME_AUDIO)
+        mp_audio_meter_feed(&p->public, frame.data);
+    mp_pin_in_write(f->ppins[1], frame);
+}
+
+static void meter_reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->fmt && p->supported)
+        reset_state(p);
+}
+
+static const struct mp_filter_info meter_filter = {
+    .name = "audio_meter",
+    .priv_size = sizeof(struct priv),
+    .process = meter_process,
+    .reset = meter_reset,
+};
+
+struct mp_audio_meter *mp_audio_meter_create(struct mp_filter *parent)
+{
+    struct mp_filter *f = mp_filter_create(parent, &meter_filter);
+    if (!f)
+        return NULL;
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    struct priv *p = f->priv;
+    p->public.f = f;
+
+    return &p->public;
+}
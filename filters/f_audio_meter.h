@@ -0,0 +1,46 @@
+#pragma once
+
+#include "audio/chmap.h"
+
+#include "filter.h"
+
+struct mp_aframe;
+
+// Values published by the meter. Levels are in dBFS, loudness in LUFS. Both
+// are clamped to MP_AUDIO_METER_FLOOR (also used for silence).
+struct mp_audio_meter_values {
+    struct mp_chmap chmap;
+    double pts;                         // of the last analyzed sample
+    // Per channel, over the last update interval.
+    float peak[MP_NUM_CHANNELS];        // sample peak
+    float rms[MP_NUM_CHANNELS];
+    float true_peak[MP_NUM_CHANNELS];   // peak of the 4x oversampled signal
+    // EBU R128, K-weighted, all channels summed (no gating).
+    float momentary;                    // last 400ms
+    float short_term;                   // last 3s
+};
+
+#define MP_AUDIO_METER_FLOOR -120.0f
+
+// Passes through all data, and measures levels of audio frames on the way.
+// Disabled (and nearly free) until mp_audio_meter_set_rate() is called.
+struct mp_audio_meter {
+    struct mp_filter *f;
+
+    // Set when new values were published. The user can reset the flag.
+    bool updated;
+};
+
+struct mp_audio_meter *mp_audio_meter_create(struct mp_filter *parent);
+
+// Set how often values are published (in Hz, relative to audio time). 0
+// disables the meter.
+void mp_audio_meter_set_rate(struct mp_audio_meter *m, double rate);
+
+// Analyze the frame as if it passed through the filter. Formats other than
+// u8/s16/s32/float/double (planar or interleaved) are ignored.
+void mp_audio_meter_feed(struct mp_audio_meter *m, struct mp_aframe *frame);
+
+// Return false if disabled, or if no values were published yet.
+bool mp_audio_meter_get_values(struct mp_audio_meter *m,
+                               struct mp_audio_meter_values *out);
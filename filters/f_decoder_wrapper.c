@@ -40,11 +40,13 @@
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
+#include "common/stats.h"
 #include "misc/dispatch.h"
 
 #include "audio/aframe.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/sws_utils.h"
 
 #include "demux/stheader.h"
 
@@ -108,6 +110,7 @@ struct dec_wrapper_opts {
     struct dec_queue_opts *adec_queue_opts;
     int64_t video_reverse_size;
     int64_t audio_reverse_size;
+    int video_reverse_downscale;
 };
 
 static int decoder_list_help(struct mp_log *log, const m_option_t *opt,
@@ -136,6 +139,7 @@ const struct m_sub_options dec_wrapper_conf = {
             M_RANGE(0, M_MAX_MEM_BYTES)},
         {"audio-reversal-buffer", OPT_BYTE_SIZE(audio_reverse_size),
             M_RANGE(0, M_MAX_MEM_BYTES)} ,
+        {"video-reversal-downscale", OPT_FLAG(video_reverse_downscale)},
         {0}
     },
     .size = sizeof(struct dec_wrapper_opts),
@@ -148,6 +152,13 @@ const struct m_sub_options dec_wrapper_conf = {
     },
 };
 
+struct reverse_entry {
+    struct mp_frame frame;
+    // If the video frame was stored downscaled, the original parameters.
+    bool downscaled;
+    struct mp_image_params params;
+};
+
 struct priv {
     struct mp_log *log;
     struct sh_stream *header;
@@ -163,6 +174,7 @@ struct priv {
     struct dec_wrapper_opts *opts;
     struct dec_queue_opts *queue_opts;
     struct mp_stream_info stream_info;
+    double prefetch; // >0: decoding ahead before output is read (seconds)
 
     struct mp_codec_params *codec;
     struct mp_decoder *decoder;
@@ -204,9 +216,10 @@ struct priv {
     bool packet_fed, preroll_discard;
 
     size_t reverse_queue_byte_size;
-    struct mp_frame *reverse_queue;
+    struct reverse_entry *reverse_queue;
     int num_reverse_queue;
     bool reverse_queue_complete;
+    struct mp_sws_context *reverse_sws;
 
     struct mp_frame decoded_coverart;
     int coverart_returned; // 0: no, 1: coverart frame itself, 2: EOF returned
@@ -232,7 +245,9 @@ struct priv {
     bool attached_picture;
     bool pts_reset;
     int attempt_framedrops; // try dropping this many frames
+    bool keyframes_only; // decode keyframes only (scrubbing)
     int dropped_frames; // total frames _probably_ dropped
+    double decode_time; // VDCTRL_GET_DECODE_TIME result
 };
 
 static int decoder_list_help(struct mp_log *log, const m_option_t *opt,
@@ -335,7 +350,7 @@ static void decf_reset(struct mp_filter *f)
     p->coverart_returned = 0;
 
     for (int n = 0; n < p->num_reverse_queue; n++)
-        mp_frame_unref(&p->reverse_queue[n]);
+        mp_frame_unref(&p->reverse_queue[n].frame);
     p->num_reverse_queue = 0;
     p->reverse_queue_byte_size = 0;
     p->reverse_queue_complete = false;
@@ -500,6 +515,15 @@ void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num)
     pthread_mutex_unlock(&p->cache_lock);
 }
 
+void mp_decoder_wrapper_set_keyframes_only(struct mp_decoder_wrapper *d,
+                                           bool enable)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    p->keyframes_only = enable;
+    pthread_mutex_unlock(&p->cache_lock);
+}
+
 int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -509,6 +533,15 @@ int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d)
     return res;
 }
 
+double mp_decoder_wrapper_get_decode_time(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    pthread_mutex_lock(&p->cache_lock);
+    double res = p->decode_time;
+    pthread_mutex_unlock(&p->cache_lock);
+    return res;
+}
+
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d)
 {
     struct priv *p = d->f->priv;
@@ -888,12 +921,16 @@ static void feed_packet(struct priv *p)
         pthread_mutex_lock(&p->cache_lock);
         if (p->attempt_framedrops)
             framedrop_type = 1;
+        bool keyframes_only = p->keyframes_only;
         pthread_mutex_unlock(&p->cache_lock);
 
         if (start_pts != MP_NOPTS_VALUE && packet && p->play_dir > 0 &&
             packet->pts < start_pts - .005 && !p->has_broken_packet_pts)
             framedrop_type = 2;
 
+        if (keyframes_only && p->play_dir > 0)
+            framedrop_type = 3;
+
         p->decoder->control(p->decoder->f, VDCTRL_SET_FRAMEDROP, &framedrop_type);
     }
 
@@ -925,9 +962,51 @@ static void feed_packet(struct priv *p)
     p->packets_without_output += 1;
 }
 
+// Scale src to a new image with the given parameters. Returns NULL on failure.
+static struct mp_image *reverse_scale(struct priv *p, struct mp_image *src,
+                                      struct mp_image_params *par)
+{
+    struct mp_image *dst = mp_image_alloc(par->imgfmt, par->w, par->h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, src);
+    dst->params = *par;
+
+    if (!p->reverse_sws)
+        p->reverse_sws = mp_sws_alloc(p);
+    if (mp_sws_scale(p->reverse_sws, dst, src) < 0) {
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+// Store a software video frame at half width and height (a quarter of the
+// memory). It is scaled back to the original size when it's output.
+static void downscale_backward_frame(struct priv *p, struct reverse_entry *e)
+{
+    struct mp_image *img = e->frame.data;
+    if (img->hwctx || !mp_sws_supported_format(img->imgfmt))
+        return;
+
+    struct mp_image_params par = img->params;
+    par.w = MPMAX(par.w / 2, 1);
+    par.h = MPMAX(par.h / 2, 1);
+
+    struct mp_image *small = reverse_scale(p, img, &par);
+    if (!small)
+        return;
+
+    e->downscaled = true;
+    e->params = img->params;
+    talloc_free(img);
+    e->frame.data = small;
+}
+
 static void enqueue_backward_frame(struct priv *p, struct mp_frame frame)
 {
     bool eof = frame.type == MP_FRAME_EOF;
+    struct reverse_entry e = {.frame = frame};
 
     if (!eof) {
         struct dec_wrapper_opts *opts = p->opts;
@@ -944,16 +1023,38 @@ static void enqueue_backward_frame(struct priv *p, struct mp_frame frame)
             return;
         }
 
-        p->reverse_queue_byte_size += mp_frame_approx_size(frame);
+        // Trade quality for memory once the queue is half full, instead of
+        // running into the overflow case above with long GOPs.
+        if (opts->video_reverse_downscale && frame.type == MP_FRAME_VIDEO &&
+            p->reverse_queue_byte_size >= queue_size / 2)
+            downscale_backward_frame(p, &e);
+
+        p->reverse_queue_byte_size += mp_frame_approx_size(e.frame);
     }
 
     // Note: EOF (really BOF) is propagated, but not reversed.
     MP_TARRAY_INSERT_AT(p, p->reverse_queue, p->num_reverse_queue,
-                        eof ? 0 : p->num_reverse_queue, frame);
+                        eof ? 0 : p->num_reverse_queue, e);
 
     p->reverse_queue_complete = eof;
 }
 
+static struct mp_frame dequeue_backward_frame(struct priv *p)
+{
+    struct reverse_entry e = p->reverse_queue[p->num_reverse_queue - 1];
+    p->num_reverse_queue -= 1;
+
+    if (e.downscaled) {
+        struct mp_image *img = reverse_scale(p, e.frame.data, &e.params);
+        if (!img)
+            MP_ERR(p, "Could not restore downscaled frame.\n");
+        talloc_free(e.frame.data);
+        e.frame = img ? MAKE_FRAME(MP_FRAME_VIDEO, img) : MP_NO_FRAME;
+    }
+
+    return e.frame;
+}
+
 static void read_frame(struct priv *p)
 {
     struct mp_pin *pin = p->decf->ppins[0];
@@ -976,8 +1077,11 @@ static void read_frame(struct priv *p)
     }
 
     if (p->reverse_queue_complete && p->num_reverse_queue) {
-        frame = p->reverse_queue[p->num_reverse_queue - 1];
-        p->num_reverse_queue -= 1;
+        frame = dequeue_backward_frame(p);
+        if (!frame.type) {
+            mp_filter_internal_mark_progress(p->decf);
+            return;
+        }
         goto output_frame;
     }
     p->reverse_queue_complete = false;
@@ -986,7 +1090,13 @@ static void read_frame(struct priv *p)
     if (!frame.type)
         return;
 
+    double decode_time = 0;
+    if (p->decoder->control && frame.type == MP_FRAME_VIDEO)
+        p->decoder->control(p->decoder->f, VDCTRL_GET_DECODE_TIME, &decode_time);
+
     pthread_mutex_lock(&p->cache_lock);
+    if (decode_time > 0)
+        p->decode_time = decode_time;
     if (p->attached_picture && frame.type == MP_FRAME_VIDEO)
         p->decoded_coverart = frame;
     if (p->attempt_framedrops) {
@@ -1066,6 +1176,12 @@ static void update_queue_config(struct priv *p)
         .max_samples = p->queue_opts->max_samples,
         .max_duration = p->queue_opts->max_duration,
     };
+    if (p->prefetch > 0) {
+        // Limited by duration only.
+        cfg.max_bytes = INT64_MAX;
+        cfg.max_samples = INT64_MAX;
+        cfg.max_duration = p->prefetch;
+    }
     mp_async_queue_set_config(p->queue, cfg);
 }
 
@@ -1092,12 +1208,17 @@ static void *dec_thread(void *ptr)
     }
     mpthread_set_name(t_name);
 
+    struct stats_ctx *stats = stats_ctx_create(NULL, p->public.f->global, t_name);
+    stats_register_thread_cputime(stats, "thread");
+
     while (!p->request_terminate_dec_thread) {
         mp_filter_graph_run(p->dec_root_filter);
         update_cached_values(p);
         mp_dispatch_queue_process(p->dec_dispatch, INFINITY);
     }
 
+    stats_unregister_thread(stats, "thread");
+    talloc_free(stats);
     return NULL;
 }
 
@@ -1167,8 +1288,8 @@ static void onlock_dec_thread(void *ptr)
     mp_filter_graph_interrupt(p->dec_root_filter);
 }
 
-struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
-                                                     struct sh_stream *src)
+static struct mp_decoder_wrapper *create(struct mp_filter *parent,
+                                         struct sh_stream *src, double prefetch)
 {
     struct mp_filter *public_f = mp_filter_create(parent, &decode_wrapper_filter);
     if (!public_f)
@@ -1183,6 +1304,7 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
     p->header = src;
     p->codec = p->header->codec;
     p->play_dir = 1;
+    p->prefetch = prefetch;
     mp_filter_add_pin(public_f, MP_PIN_OUT, "out");
 
     if (p->header->type == STREAM_VIDEO) {
@@ -1206,7 +1328,7 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         goto error;
     }
 
-    if (p->queue_opts && p->queue_opts->use_queue) {
+    if (p->queue_opts && (p->queue_opts->use_queue || p->prefetch > 0)) {
         p->queue = mp_async_queue_create();
         p->dec_dispatch = mp_dispatch_create(p);
         p->dec_root_filter = mp_filter_create_root(public_f->global);
@@ -1257,12 +1379,38 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
 
     public_f_reset(public_f);
 
+    // Let the decoder thread fill the queue without waiting for a reader.
+    if (p->prefetch > 0)
+        mp_async_queue_resume_reading(p->queue);
+
     return &p->public;
 error:
     talloc_free(public_f);
     return NULL;
 }
 
+struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
+                                                     struct sh_stream *src)
+{
+    return create(parent, src, 0);
+}
+
+struct mp_decoder_wrapper *mp_decoder_wrapper_create_prefetch(
+    struct mp_filter *parent, struct sh_stream *src, double prefetch)
+{
+    assert(prefetch > 0);
+    return create(parent, src, prefetch);
+}
+
+void mp_decoder_wrapper_end_prefetch(struct mp_decoder_wrapper *d)
+{
+    struct priv *p = d->f->priv;
+    thread_lock(p);
+    p->prefetch = 0;
+    update_queue_config(p);
+    thread_unlock(p);
+}
+
 void lavc_process(struct mp_filter *f, struct lavc_state *state,
                   int (*send)(struct mp_filter *f, struct demux_packet *pkt),
                   int (*receive)(struct mp_filter *f, struct mp_frame *res))
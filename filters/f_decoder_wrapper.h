@@ -42,6 +42,17 @@ struct mp_decoder_wrapper {
 struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
                                                      struct sh_stream *src);
 
+// Like mp_decoder_wrapper_create(), but always use a decoder thread, and start
+// decoding as soon as the decoder is initialized (mp_decoder_wrapper_reinit()),
+// before anything reads the output. Up to prefetch seconds of decoded data are
+// buffered until mp_decoder_wrapper_end_prefetch() is called.
+struct mp_decoder_wrapper *mp_decoder_wrapper_create_prefetch(
+    struct mp_filter *parent, struct sh_stream *src, double prefetch);
+
+// Switch a decoder created with mp_decoder_wrapper_create_prefetch() to the
+// normal queue settings. Data decoded so far is kept.
+void mp_decoder_wrapper_end_prefetch(struct mp_decoder_wrapper *d);
+
 // For informational purposes.
 void mp_decoder_wrapper_get_desc(struct mp_decoder_wrapper *d,
                                  char *buf, size_t buf_size);
@@ -50,6 +61,13 @@ void mp_decoder_wrapper_get_desc(struct mp_decoder_wrapper *d,
 void mp_decoder_wrapper_set_frame_drops(struct mp_decoder_wrapper *d, int num);
 int mp_decoder_wrapper_get_frames_dropped(struct mp_decoder_wrapper *d);
 
+// Decode keyframes only, and output them without decoder delay (scrubbing).
+void mp_decoder_wrapper_set_keyframes_only(struct mp_decoder_wrapper *d,
+                                           bool enable);
+
+// Average time in seconds the decoder needs per frame, or 0 if unknown.
+double mp_decoder_wrapper_get_decode_time(struct mp_decoder_wrapper *d);
+
 double mp_decoder_wrapper_get_container_fps(struct mp_decoder_wrapper *d);
 
 // Whether to prefer spdif wrapper over real decoders on next reinit.
@@ -75,8 +93,10 @@ enum dec_ctrl {
     VDCTRL_GET_HWDEC,
     VDCTRL_REINIT,
     VDCTRL_GET_BFRAMES,
-    // framedrop mode: 0=none, 1=standard, 2=hrseek
+    // framedrop mode: 0=none, 1=standard, 2=hrseek, 3=keyframes only
     VDCTRL_SET_FRAMEDROP,
+    // double*: average decoding time per frame in seconds
+    VDCTRL_GET_DECODE_TIME,
 };
 
 int mp_decoder_wrapper_control(struct mp_decoder_wrapper *d,
@@ -78,6 +78,9 @@ struct lavfi {
     // input anymore after sending EOF, so recreate the graph to "unstuck" it).
     bool draining_recover;
 
+    // Pass video size changes to the existing graph, instead of recreating it.
+    bool reconfig_in_place;
+
     // Filter can't be put into a working state.
     bool failed;
 
@@ -342,7 +345,7 @@ static bool is_aformat_ok(struct mp_aframe *a, struct mp_aframe *b)
 static bool is_vformat_ok(struct mp_image *a, struct mp_image *b)
 {
     return a->imgfmt == b->imgfmt &&
-           a->w == b->w && a->h && b->h &&
+           a->w == b->w && a->h == b->h &&
            a->params.p_w == b->params.p_w && a->params.p_h == b->params.p_h &&
            a->nominal_fps == b->nominal_fps;
 }
@@ -355,6 +358,55 @@ static bool is_format_ok(struct mp_frame a, struct mp_frame b)
     return false;
 }
 
+// Remember the format of pad->pending for detecting format changes.
+static bool set_in_fmt(struct lavfi_pad *pad)
+{
+    mp_frame_unref(&pad->in_fmt);
+    pad->in_fmt = mp_frame_ref(pad->pending);
+    if (!pad->in_fmt.type)
+        return false;
+
+    if (pad->in_fmt.type == MP_FRAME_VIDEO)
+        mp_image_unref_data(pad->in_fmt.data);
+    if (pad->in_fmt.type == MP_FRAME_AUDIO)
+        mp_aframe_unref_data(pad->in_fmt.data);
+    return true;
+}
+
+// Try to apply a video format change on pad->pending to the buffersrc without
+// recreating the graph. This works only if the pixel format and hw context stay
+// the same; the filters are then expected to adapt to the new size (like
+// "scale" does). Returns false if the graph must be recreated.
+static bool reconfig_in_place(struct lavfi *c, struct lavfi_pad *pad)
+{
+    if (!c->reconfig_in_place || !c->initialized || pad->buffer_is_eof ||
+        pad->pending.type != MP_FRAME_VIDEO || pad->in_fmt.type != MP_FRAME_VIDEO)
+        return false;
+
+    struct mp_image *img = pad->pending.data;
+    struct mp_image *fmt = pad->in_fmt.data;
+    if (img->imgfmt != fmt->imgfmt || !img->hwctx != !fmt->hwctx ||
+        (img->hwctx && img->hwctx->data != fmt->hwctx->data))
+        return false;
+
+    AVBufferSrcParameters *params = av_buffersrc_parameters_alloc();
+    if (!params)
+        return false;
+    params->width = img->w;
+    params->height = img->h;
+    params->sample_aspect_ratio.num = img->params.p_w;
+    params->sample_aspect_ratio.den = img->params.p_h;
+    params->frame_rate = av_d2q(img->nominal_fps, 1000000);
+    int ret = av_buffersrc_parameters_set(pad->buffer, params);
+    av_free(params);
+    if (ret < 0 || !set_in_fmt(pad))
+        return false;
+
+    MP_VERBOSE(c, "format change on %s applied to running graph (%dx%d)\n",
+               pad->name, img->w, img->h);
+    return true;
+}
+
 static void read_pad_input(struct lavfi *c, struct lavfi_pad *pad)
 {
     assert(pad->dir == MP_PIN_IN);
@@ -372,7 +424,8 @@ static void read_pad_input(struct lavfi *c, struct lavfi_pad *pad)
     }
 
     if (mp_frame_is_data(pad->pending) && pad->in_fmt.type &&
-        !is_format_ok(pad->pending, pad->in_fmt))
+        !is_format_ok(pad->pending, pad->in_fmt) &&
+        !reconfig_in_place(c, pad))
     {
         if (!c->draining_recover)
             MP_VERBOSE(c, "format change on %s\n", pad->name);
@@ -432,14 +485,8 @@ static bool init_pads(struct lavfi *c)
         if (mp_frame_is_data(pad->pending)) {
             assert(pad->pending.type == pad->type);
 
-            pad->in_fmt = mp_frame_ref(pad->pending);
-            if (!pad->in_fmt.type)
+            if (!set_in_fmt(pad))
                 goto error;
-
-            if (pad->in_fmt.type == MP_FRAME_VIDEO)
-                mp_image_unref_data(pad->in_fmt.data);
-            if (pad->in_fmt.type == MP_FRAME_AUDIO)
-                mp_aframe_unref_data(pad->in_fmt.data);
         }
 
         if (pad->pending.type == MP_FRAME_EOF && !pad->in_fmt.type) {
@@ -630,18 +677,21 @@ static bool feed_input_pads(struct lavfi *c)
             }
         }
 
-        AVFrame *frame = mp_frame_to_av(pad->pending, &pad->timebase);
         bool eof = pad->pending.type == MP_FRAME_EOF;
+        bool emulate_pts =
+            c->emulate_audio_pts && pad->pending.type == MP_FRAME_AUDIO;
+        if (emulate_pts)
+            c->in_pts = mp_aframe_end_pts(pad->pending.data);
 
-        if (c->emulate_audio_pts && pad->pending.type == MP_FRAME_AUDIO) {
-            struct mp_aframe *aframe = pad->pending.data;
-            c->in_pts = mp_aframe_end_pts(aframe);
+        // This hands the data references over, so nothing is copied.
+        AVFrame *frame = mp_frame_to_av_and_unref(pad->pending, &pad->timebase);
+        pad->pending = MP_NO_FRAME;
+
+        if (frame && emulate_pts) {
             frame->pts = c->in_samples; // timebase is 1/sample_rate
             c->in_samples += frame->nb_samples;
         }
 
-        mp_frame_unref(&pad->pending);
-
         if (!frame && !eof) {
             MP_FATAL(c, "out of memory or unsupported format\n");
             continue;
@@ -947,6 +997,7 @@ struct lavfi_user_opts {
     char **filter_opts;
 
     int fix_pts;
+    int reconfig;
 
     char *hwdec_interop;
 };
@@ -966,6 +1017,7 @@ static struct mp_filter *lavfi_create(struct mp_filter *parent, void *options)
     if (l) {
         struct lavfi *c = l->f->priv;
         c->emulate_audio_pts = opts->fix_pts;
+        c->reconfig_in_place = opts->reconfig == 1;
     }
     talloc_free(opts);
     return l ? l->f : NULL;
@@ -1165,6 +1217,7 @@ const struct mp_user_filter_entry vf_lavfi = {
         .options = (const m_option_t[]){
             {"graph", OPT_STRING(graph)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"reconfig", OPT_CHOICE(reconfig, {"rebuild", 0}, {"in-place", 1})},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
@@ -1187,6 +1240,7 @@ const struct mp_user_filter_entry vf_lavfi_bridge = {
             {"name", OPT_STRING(filter_name)},
             {"opts", OPT_KEYVALUELIST(filter_opts)},
             {"o", OPT_KEYVALUELIST(avopts)},
+            {"reconfig", OPT_CHOICE(reconfig, {"rebuild", 0}, {"in-place", 1})},
             {"hwdec_interop",
              OPT_STRING_VALIDATE(hwdec_interop,
                                  ra_hwdec_validate_drivers_only_opt)},
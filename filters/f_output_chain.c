@@ -1,12 +1,20 @@
+#include <math.h>
+#include <pthread.h>
+
 #include "audio/aframe.h"
 #include "audio/out/ao.h"
 #include "common/global.h"
+#include "misc/dispatch.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/options.h"
+#include "osdep/threads.h"
 #include "video/out/vo.h"
 
 #include "filter_internal.h"
 
+#include "f_async_queue.h"
+#include "f_audio_meter.h"
 #include "f_autoconvert.h"
 #include "f_auto_filters.h"
 #include "f_lavfi.h"
@@ -45,6 +53,27 @@ struct chain {
     struct vo *vo;
     struct ao *ao;
 
+    // Parent filter of all wrapper filters: f, or thread_root.
+    struct mp_filter *graph;
+
+    // --- Filter thread (--vf-thread). If thread_root is set, the wrapper
+    //     filters run on the filter thread, and must be accessed with
+    //     thread_lock() from the user thread.
+    struct mp_filter *thread_root;
+    struct mp_dispatch_queue *dispatch;
+    struct mp_async_queue *in_queue, *out_queue;
+    struct mp_pin *queue_in, *queue_out; // user thread ends of the queues
+    pthread_t thread;
+    bool thread_valid;
+    bool request_terminate;
+    pthread_mutex_t state_lock;
+
+    // Fields of the public struct updated by the filters. Points to public,
+    // or with a filter thread, to thread_state, which is accessed with
+    // state_lock held, and copied to public by process().
+    struct mp_output_chain *state;
+    struct mp_output_chain thread_state;
+
     struct mp_output_chain public;
 };
 
@@ -73,6 +102,35 @@ struct mp_user_filter {
     bool error_eof_sent;
 };
 
+// Lock the filter thread. No-op if there is none.
+static void thread_lock(struct chain *p)
+{
+    if (p->dispatch)
+        mp_dispatch_lock(p->dispatch);
+}
+
+static void thread_unlock(struct chain *p)
+{
+    if (p->dispatch)
+        mp_dispatch_unlock(p->dispatch);
+}
+
+// Return p->state for writing. Must be paired with unlock_state().
+static struct mp_output_chain *lock_state(struct chain *p)
+{
+    if (p->thread_root)
+        pthread_mutex_lock(&p->state_lock);
+    return p->state;
+}
+
+static void unlock_state(struct chain *p)
+{
+    if (p->thread_root) {
+        pthread_mutex_unlock(&p->state_lock);
+        mp_filter_wakeup(p->f); // let process() copy it
+    }
+}
+
 static void update_output_caps(struct chain *p)
 {
     if (p->type != MP_OUTPUT_CHAIN_VIDEO)
@@ -104,19 +162,20 @@ static void check_in_format_change(struct mp_user_filter *u,
                        mp_image_params_to_str(&img->params));
             u->last_in_vformat = img->params;
 
+            struct mp_output_chain *state = lock_state(p);
             if (u == p->input) {
-                p->public.input_params = img->params;
+                state->input_params = img->params;
             } else if (u == p->output) {
-                p->public.output_params = img->params;
+                state->output_params = img->params;
             }
+            state->reconfig_happened = true;
+            unlock_state(p);
 
             // Unfortunately there's no good place to update these.
             // But a common case is enabling HW decoding, which
             // might init some support of them in the VO, and update
             // the VO's format list.
             update_output_caps(p);
-
-            p->public.reconfig_happened = true;
         }
     }
 
@@ -153,7 +212,8 @@ static void process_user(struct mp_filter *f)
             // This is a fuckup we can't ignore.
             MP_FATAL(p, "Cannot convert decoder/filter output to any format "
                      "supported by the output.\n");
-            p->public.failed_output_conversion = true;
+            lock_state(p)->failed_output_conversion = true;
+            unlock_state(p);
             mp_filter_wakeup(p->f);
         } else {
             MP_ERR(p, "Disabling filter %s because it has failed.\n", name);
@@ -234,7 +294,7 @@ static const struct mp_filter_info user_wrapper_filter = {
 
 static struct mp_user_filter *create_wrapper_filter(struct chain *p)
 {
-    struct mp_filter *f = mp_filter_create(p->f, &user_wrapper_filter);
+    struct mp_filter *f = mp_filter_create(p->graph, &user_wrapper_filter);
     if (!f)
         abort();
     struct mp_user_filter *wrapper = f->priv;
@@ -280,7 +340,25 @@ static void process(struct mp_filter *f)
 {
     struct chain *p = f->priv;
 
-    if (mp_pin_can_transfer_data(p->filters_in, f->ppins[0])) {
+    struct mp_pin *filters_in = p->filters_in;
+    struct mp_pin *filters_out = p->filters_out;
+
+    if (p->thread_root) {
+        filters_in = p->queue_in;
+        filters_out = p->queue_out;
+
+        pthread_mutex_lock(&p->state_lock);
+        p->public.input_params = p->thread_state.input_params;
+        p->public.output_params = p->thread_state.output_params;
+        p->public.reconfig_happened |= p->thread_state.reconfig_happened;
+        p->public.failed_output_conversion |=
+            p->thread_state.failed_output_conversion;
+        p->thread_state.reconfig_happened = false;
+        p->thread_state.failed_output_conversion = false;
+        pthread_mutex_unlock(&p->state_lock);
+    }
+
+    if (mp_pin_can_transfer_data(filters_in, f->ppins[0])) {
         struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
 
         if (frame.type == MP_FRAME_EOF)
@@ -291,11 +369,11 @@ static void process(struct mp_filter *f)
                                        mp_frame_get_pts(frame));
         }
 
-        mp_pin_in_write(p->filters_in, frame);
+        mp_pin_in_write(filters_in, frame);
     }
 
-    if (mp_pin_can_transfer_data(f->ppins[1], p->filters_out)) {
-        struct mp_frame frame = mp_pin_out_read(p->filters_out);
+    if (mp_pin_can_transfer_data(f->ppins[1], filters_out)) {
+        struct mp_frame frame = mp_pin_out_read(filters_out);
 
         p->public.got_output_eof = frame.type == MP_FRAME_EOF;
         if (p->public.got_output_eof)
@@ -312,6 +390,16 @@ static void reset(struct mp_filter *f)
     p->public.ao_needs_update = false;
 
     p->public.got_output_eof = false;
+
+    if (p->thread_root) {
+        mp_async_queue_reset(p->in_queue);
+        mp_async_queue_reset(p->out_queue);
+        thread_lock(p);
+        mp_filter_reset(p->thread_root);
+        thread_unlock(p);
+        mp_async_queue_resume(p->in_queue);
+        mp_async_queue_resume(p->out_queue);
+    }
 }
 
 void mp_output_chain_reset_harder(struct mp_output_chain *c)
@@ -320,6 +408,9 @@ void mp_output_chain_reset_harder(struct mp_output_chain *c)
 
     mp_filter_reset(p->f);
 
+    thread_lock(p);
+    lock_state(p)->failed_output_conversion = false;
+    unlock_state(p);
     p->public.failed_output_conversion = false;
     for (int n = 0; n < p->num_all_filters; n++) {
         struct mp_user_filter *u = p->all_filters[n];
@@ -333,11 +424,31 @@ void mp_output_chain_reset_harder(struct mp_output_chain *c)
         p->ao = NULL;
         mp_autoconvert_clear(p->convert);
     }
+    thread_unlock(p);
 }
 
 static void destroy(struct mp_filter *f)
 {
+    struct chain *p = f->priv;
+
     reset(f);
+
+    if (p->thread_valid) {
+        thread_lock(p);
+        p->request_terminate = true;
+        mp_dispatch_interrupt(p->dispatch);
+        thread_unlock(p);
+        pthread_join(p->thread, NULL);
+        p->thread_valid = false;
+    }
+
+    if (p->thread_root) {
+        mp_filter_free_children(f);
+        talloc_free(p->thread_root);
+        talloc_free(p->in_queue);
+        talloc_free(p->out_queue);
+        pthread_mutex_destroy(&p->state_lock);
+    }
 }
 
 static const struct mp_filter_info output_chain_filter = {
@@ -361,12 +472,14 @@ void mp_output_chain_set_vo(struct mp_output_chain *c, struct vo *vo)
 {
     struct chain *p = c->f->priv;
 
+    thread_lock(p);
     p->stream_info.hwdec_devs = vo ? vo->hwdec_devs : NULL;
     p->stream_info.osd = vo ? vo->osd : NULL;
     p->stream_info.rotate90 = vo ? vo->driver->caps & VO_CAP_ROTATE90 : false;
     p->stream_info.dr_vo = vo;
     p->vo = vo;
     update_output_caps(p);
+    thread_unlock(p);
 }
 
 void mp_output_chain_set_ao(struct mp_output_chain *c, struct ao *ao)
@@ -428,11 +541,9 @@ static struct mp_user_filter *find_by_label(struct chain *p, const char *label)
     return NULL;
 }
 
-bool mp_output_chain_command(struct mp_output_chain *c, const char *target,
-                             struct mp_filter_command *cmd)
+static bool chain_command(struct chain *p, const char *target,
+                          struct mp_filter_command *cmd)
 {
-    struct chain *p = c->f->priv;
-
     if (!target || !target[0])
         return false;
 
@@ -450,6 +561,17 @@ bool mp_output_chain_command(struct mp_output_chain *c, const char *target,
     return mp_filter_command(f->f, cmd);
 }
 
+bool mp_output_chain_command(struct mp_output_chain *c, const char *target,
+                             struct mp_filter_command *cmd)
+{
+    struct chain *p = c->f->priv;
+
+    thread_lock(p);
+    bool r = chain_command(p, target, cmd);
+    thread_unlock(p);
+    return r;
+}
+
 // Set the speed on the last filter in the chain that supports it. If a filter
 // supports it, reset *speed, then keep setting the speed on the other filters.
 // The purpose of this is to make sure only 1 filter changes speed.
@@ -494,6 +616,8 @@ double mp_output_get_measured_total_delay(struct mp_output_chain *c)
 
     double delay = 0;
 
+    thread_lock(p);
+
     for (int n = 0; n < p->num_all_filters; n++) {
         struct mp_user_filter *u = p->all_filters[n];
 
@@ -503,15 +627,13 @@ double mp_output_get_measured_total_delay(struct mp_output_chain *c)
             delay += u->last_in_pts - u->last_out_pts;
         }
     }
+    thread_unlock(p);
 
     return delay;
 }
 
-bool mp_output_chain_update_filters(struct mp_output_chain *c,
-                                    struct m_obj_settings *list)
+static bool update_filters(struct chain *p, struct m_obj_settings *list)
 {
-    struct chain *p = c->f->priv;
-
     struct mp_user_filter **add = NULL;      // new filters
     int num_add = 0;
     struct mp_user_filter **res = NULL;      // new final list
@@ -598,6 +720,8 @@ bool mp_output_chain_update_filters(struct mp_output_chain *c,
     update_output_caps(p);
 
     mp_filter_wakeup(p->f);
+    if (p->thread_root)
+        mp_filter_wakeup(p->input->wrapper);
 
     talloc_free(add);
     talloc_free(used);
@@ -611,6 +735,92 @@ error:
     return false;
 }
 
+bool mp_output_chain_update_filters(struct mp_output_chain *c,
+                                    struct m_obj_settings *list)
+{
+    struct chain *p = c->f->priv;
+
+    thread_lock(p);
+    bool r = update_filters(p, list);
+    thread_unlock(p);
+    return r;
+}
+
+static void *filter_thread(void *ptr)
+{
+    struct chain *p = ptr;
+
+    mpthread_set_name("vf");
+
+    while (!p->request_terminate) {
+        mp_filter_graph_run(p->thread_root);
+        mp_dispatch_queue_process(p->dispatch, INFINITY);
+    }
+
+    return NULL;
+}
+
+static void wakeup_filter_thread(void *ptr)
+{
+    struct chain *p = ptr;
+
+    mp_dispatch_interrupt(p->dispatch);
+}
+
+static void onlock_filter_thread(void *ptr)
+{
+    struct chain *p = ptr;
+
+    mp_filter_graph_interrupt(p->thread_root);
+}
+
+// Make the wrapper filters use a separate filter graph, which is run by a
+// thread started with start_filter_thread().
+static void create_filter_thread(struct chain *p, int queue_frames)
+{
+    pthread_mutex_init(&p->state_lock, NULL);
+    p->state = &p->thread_state;
+
+    p->dispatch = mp_dispatch_create(p);
+    p->thread_root = mp_filter_create_root(p->f->global);
+    mp_filter_graph_set_wakeup_cb(p->thread_root, wakeup_filter_thread, p);
+    mp_dispatch_set_onlock_fn(p->dispatch, onlock_filter_thread, p);
+    p->graph = p->thread_root;
+
+    p->in_queue = mp_async_queue_create();
+    p->out_queue = mp_async_queue_create();
+    // Let the thread filter ahead by this many frames.
+    mp_async_queue_set_config(p->out_queue, (struct mp_async_queue_config){
+        .max_bytes = INT64_MAX,
+        .max_samples = queue_frames,
+    });
+}
+
+// Connect the filter list to the user thread's graph, and start the thread.
+static void start_filter_thread(struct chain *p)
+{
+    struct mp_filter *f_in =
+        mp_async_queue_create_filter(p->f, MP_PIN_IN, p->in_queue);
+    struct mp_filter *t_in =
+        mp_async_queue_create_filter(p->thread_root, MP_PIN_OUT, p->in_queue);
+    struct mp_filter *t_out =
+        mp_async_queue_create_filter(p->thread_root, MP_PIN_IN, p->out_queue);
+    struct mp_filter *f_out =
+        mp_async_queue_create_filter(p->f, MP_PIN_OUT, p->out_queue);
+
+    // (filters_in/out never change, as the first and last filters are fixed.)
+    mp_pin_connect(p->filters_in, t_in->pins[0]);
+    mp_pin_connect(t_out->pins[0], p->filters_out);
+    p->queue_in = f_in->pins[0];
+    p->queue_out = f_out->pins[0];
+
+    if (pthread_create(&p->thread, NULL, filter_thread, p)) {
+        MP_FATAL(p, "Could not create filter thread.\n");
+        abort();
+    }
+    p->thread_valid = true;
+}
+
 static void create_video_things(struct chain *p)
 {
     p->frame_type = MP_FRAME_VIDEO;
@@ -619,6 +829,8 @@ static void create_video_things(struct chain *p)
     p->stream_info.get_display_fps = get_display_fps;
 
     p->f->stream_info = &p->stream_info;
+    if (p->thread_root)
+        p->thread_root->stream_info = &p->stream_info;
 
     struct mp_user_filter *f = create_wrapper_filter(p);
     f->name = "userdeint";
@@ -669,6 +881,13 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     p->f = f;
     p->log = f->log;
     p->type = type;
+    p->graph = f;
+    p->state = &p->public;
+
+    struct filter_opts *opts = mp_get_config_group(NULL, f->global, &filter_conf);
+    if (type == MP_OUTPUT_CHAIN_VIDEO && opts->vf_thread)
+        create_filter_thread(p, opts->vf_thread_queue);
+    talloc_free(opts);
 
     struct mp_output_chain *c = &p->public;
     c->f = f;
@@ -699,6 +918,15 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     if (type == MP_OUTPUT_CHAIN_AUDIO) {
         p->convert->on_audio_format_change = on_audio_format_change;
         p->convert->on_audio_format_change_opaque = p;
+
+        // Measures what is actually sent to the AO.
+        struct mp_user_filter *u = create_wrapper_filter(p);
+        c->meter = mp_audio_meter_create(u->wrapper);
+        if (!c->meter)
+            abort();
+        u->name = "meter";
+        u->f = c->meter->f;
+        MP_TARRAY_APPEND(p, p->post_filters, p->num_post_filters, u);
     }
 
     // Dummy filter for reporting and logging the output format.
@@ -711,6 +939,9 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
 
     relink_filter_list(p);
 
+    if (p->thread_root)
+        start_filter_thread(p);
+
     reset(f);
 
     return c;
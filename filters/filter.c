@@ -6,6 +6,8 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
+#include "misc/node.h"
 #include "osdep/atomic.h"
 #include "osdep/timer.h"
 #include "video/hwdec.h"
@@ -74,16 +76,22 @@ struct filter_runner {
     double max_run_time;
     atomic_bool interrupt_flag;
 
+    // If set, time process() calls per filter (mp_filter_graph_set_stats()).
+    struct stats_ctx *stats;
+
     // If we're currently running the filter graph (for avoiding recursion).
     bool filtering;
 
     // If set, recursive filtering was initiated through this pin.
     struct mp_pin *recursive;
 
-    // Set of filters which need process() to be called. A filter is in this
-    // array iff mp_filter_internal.pending==true.
-    struct mp_filter **pending;
-    int num_pending;
+    // Set of filters which need process() to be called. A filter is in one
+    // of these arrays iff mp_filter_internal.pending==true. pending_hi contains
+    // the high priority filters, which are always run first. Both are used as
+    // stacks (the most recently added filter is run first), so adding and
+    // removing the next filter is O(1).
+    struct mp_filter **pending, **pending_hi;
+    int num_pending, num_pending_hi;
 
     // Any outside pins have changed state.
     bool external_pending;
@@ -118,6 +126,11 @@ struct mp_filter_internal {
     bool pending;
     bool async_pending;
     bool failed;
+
+    // Number of process() calls and total time spent in them (in us). Only
+    // updated while mp_filter_graph_set_stats() is enabled.
+    int64_t process_calls;
+    int64_t process_time;
 };
 
 // Called when new work needs to be done on a pin belonging to the filter:
@@ -133,16 +146,33 @@ static void add_pending(struct mp_filter *f)
     if (f->in->pending)
         return;
 
-    // This should probably really be some sort of priority queue, but for now
-    // something naive and dumb does the job too.
     f->in->pending = true;
     if (f->in->high_priority) {
-        MP_TARRAY_INSERT_AT(r, r->pending, r->num_pending, 0, f);
+        MP_TARRAY_APPEND(r, r->pending_hi, r->num_pending_hi, f);
     } else {
         MP_TARRAY_APPEND(r, r->pending, r->num_pending, f);
     }
 }
 
+// Remove f from the pending set, if it's in it.
+static void remove_pending(struct mp_filter *f)
+{
+    struct filter_runner *r = f->in->runner;
+
+    if (!f->in->pending)
+        return;
+
+    struct mp_filter **list = f->in->high_priority ? r->pending_hi : r->pending;
+    int *num = f->in->high_priority ? &r->num_pending_hi : &r->num_pending;
+    for (int n = *num - 1; n >= 0; n--) {
+        if (list[n] == f) {
+            MP_TARRAY_REMOVE_AT(list, *num, n);
+            break;
+        }
+    }
+    f->in->pending = false;
+}
+
 static void add_pending_pin(struct mp_pin *p)
 {
     struct mp_filter *f = p->manual_connection;
@@ -238,28 +268,36 @@ bool mp_filter_graph_run(struct mp_filter *filter)
             exit_req = true;
         }
 
-        if (!r->num_pending) {
+        if (!r->num_pending && !r->num_pending_hi) {
             flush_async_notifications(r);
-            if (!r->num_pending)
+            if (!r->num_pending && !r->num_pending_hi)
                 break;
         }
 
         struct mp_filter *next = NULL;
 
-        if (r->pending[0]->in->high_priority) {
-            next = r->pending[0];
-            MP_TARRAY_REMOVE_AT(r->pending, r->num_pending, 0);
+        if (r->num_pending_hi) {
+            next = r->pending_hi[--r->num_pending_hi];
         } else if (!exit_req) {
-            next = r->pending[r->num_pending - 1];
-            r->num_pending -= 1;
+            next = r->pending[--r->num_pending];
         }
 
         if (!next)
             break;
 
         next->in->pending = false;
-        if (next->in->info->process)
-            next->in->info->process(next);
+        if (next->in->info->process) {
+            if (r->stats) {
+                int64_t start = mp_time_us();
+                stats_time_start(r->stats, next->in->info->name);
+                next->in->info->process(next);
+                stats_time_end(r->stats, next->in->info->name);
+                next->in->process_calls += 1;
+                next->in->process_time += mp_time_us() - start;
+            } else {
+                next->in->info->process(next);
+            }
+        }
 
         if (end_time && mp_time_us() >= end_time)
             mp_filter_graph_interrupt(r->root_filter);
@@ -538,7 +576,15 @@ const struct mp_filter_info *mp_filter_get_info(struct mp_filter *f)
 
 void mp_filter_set_high_priority(struct mp_filter *f, bool pri)
 {
+    if (f->in->high_priority == pri)
+        return;
+
+    // Move it to the correct pending list.
+    bool pending = f->in->pending;
+    remove_pending(f);
     f->in->high_priority = pri;
+    if (pending)
+        add_pending(f);
 }
 
 void mp_filter_set_name(struct mp_filter *f, const char *name)
@@ -734,6 +780,15 @@ void mp_filter_graph_set_max_run_time(struct mp_filter *f, double seconds)
     r->max_run_time = seconds;
 }
 
+void mp_filter_graph_set_stats(struct mp_filter *f, const char *prefix)
+{
+    struct filter_runner *r = f->in->runner;
+    assert(f == r->root_filter); // user is supposed to call this on root only
+    TA_FREEP(&r->stats);
+    if (prefix)
+        r->stats = stats_ctx_create(r, r->global, prefix);
+}
+
 void mp_filter_graph_interrupt(struct mp_filter *f)
 {
     struct filter_runner *r = f->in->runner;
@@ -765,12 +820,7 @@ static void filter_destructor(void *p)
     // There will be no more new notifications at this point (due to destroy()).
     flush_async_notifications(r);
 
-    for (int n = 0; n < r->num_pending; n++) {
-        if (r->pending[n] == f) {
-            MP_TARRAY_REMOVE_AT(r->pending, r->num_pending, n);
-            break;
-        }
-    }
+    remove_pending(f);
 
     if (f->in->parent) {
         struct mp_filter_internal *p_in = f->in->parent->in;
@@ -895,6 +945,34 @@ static void dump_pin_state(struct mp_filter *f, struct mp_pin *pin)
         mp_frame_type_str(pin->data.type));
 }
 
+// dst must be an initialized MPV_FORMAT_NODE_MAP.
+static void dump_graph(struct mp_filter *f, struct mpv_node *dst)
+{
+    node_map_add_string(dst, "type", f->in->info->name);
+    if (f->in->name)
+        node_map_add_string(dst, "name", f->in->name);
+    node_map_add_flag(dst, "pending", f->in->pending);
+    node_map_add_flag(dst, "high-priority", f->in->high_priority);
+    node_map_add_flag(dst, "failed", f->in->failed);
+    node_map_add_int64(dst, "calls", f->in->process_calls);
+    node_map_add_double(dst, "time", f->in->process_time / 1e6);
+
+    if (f->in->num_children) {
+        struct mpv_node *children =
+            node_map_add(dst, "children", MPV_FORMAT_NODE_ARRAY);
+        for (int n = 0; n < f->in->num_children; n++) {
+            dump_graph(f->in->children[n],
+                       node_array_add(children, MPV_FORMAT_NODE_MAP));
+        }
+    }
+}
+
+void mp_filter_dump_graph(struct mp_filter *f, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    dump_graph(f, dst);
+}
+
 void mp_filter_dump_states(struct mp_filter *f)
 {
     MP_WARN(f, "%s[%p] (%s[%p])\n", filt_name(f), f,
@@ -423,6 +423,13 @@ bool mp_filter_graph_run(struct mp_filter *root);
 // Can be called on the root filter only.
 void mp_filter_graph_set_max_run_time(struct mp_filter *root, double seconds);
 
+// Account the time spent in each filter's process() callback with stats.c,
+// using "<prefix>/<filter name>" as names. Time is aggregated over all filters
+// with the same name. prefix==NULL disables it (the default).
+// This also enables the per-filter counters in mp_filter_dump_graph().
+// Can be called on the root filter only.
+void mp_filter_graph_set_stats(struct mp_filter *root, const char *prefix);
+
 // Interrupt mp_filter_graph_run() asynchronously. This does not stop filtering
 // in a destructive way, but merely suspends it. In practice, this will make
 // mp_filter_graph_run() return after the current filter's process() function has
@@ -466,3 +473,9 @@ void mp_filter_graph_set_wakeup_cb(struct mp_filter *root,
 
 // Debugging internal stuff.
 void mp_filter_dump_states(struct mp_filter *f);
+
+// Write f and its children recursively as nested node maps to dst, including
+// the number of process() calls and time spent in them. The caller needs to
+// free dst with mpv_free_node_contents() (or the talloc parent of dst->u).
+struct mpv_node;
+void mp_filter_dump_graph(struct mp_filter *f, struct mpv_node *dst);
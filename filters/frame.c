@@ -16,6 +16,7 @@ struct frame_handler {
     void (*set_pts)(void *data, double pts);
     int (*approx_size)(void *data);
     AVFrame *(*new_av_ref)(void *data);
+    AVFrame *(*to_av_and_unref)(void *data);
     void *(*from_av_ref)(AVFrame *data);
     void (*free)(void *data);
 };
@@ -45,6 +46,11 @@ static AVFrame *video_new_av_ref(void *data)
     return mp_image_to_av_frame(data);
 }
 
+static AVFrame *video_to_av_and_unref(void *data)
+{
+    return mp_image_to_av_frame_and_unref(data);
+}
+
 static void *video_from_av_ref(AVFrame *data)
 {
     return mp_image_from_av_frame(data);
@@ -75,6 +81,11 @@ static AVFrame *audio_new_av_ref(void *data)
     return mp_aframe_to_avframe(data);
 }
 
+static AVFrame *audio_to_av_and_unref(void *data)
+{
+    return mp_aframe_to_avframe_and_unref(data);
+}
+
 static void *audio_from_av_ref(AVFrame *data)
 {
     return mp_aframe_from_avframe(data);
@@ -101,6 +112,7 @@ static const struct frame_handler frame_handlers[] = {
         .set_pts = video_set_pts,
         .approx_size = video_approx_size,
         .new_av_ref = video_new_av_ref,
+        .to_av_and_unref = video_to_av_and_unref,
         .from_av_ref = video_from_av_ref,
         .free = talloc_free,
     },
@@ -112,6 +124,7 @@ static const struct frame_handler frame_handlers[] = {
         .set_pts = audio_set_pts,
         .approx_size = audio_approx_size,
         .new_av_ref = audio_new_av_ref,
+        .to_av_and_unref = audio_to_av_and_unref,
         .from_av_ref = audio_from_av_ref,
         .free = talloc_free,
     },
@@ -193,6 +206,24 @@ AVFrame *mp_frame_to_av(struct mp_frame frame, struct AVRational *tb)
     return res;
 }
 
+// Like mp_frame_to_av(), but unref frame (also on failure). Instead of creating
+// new references, the data references are handed over to the AVFrame.
+AVFrame *mp_frame_to_av_and_unref(struct mp_frame frame, struct AVRational *tb)
+{
+    if (!frame_handlers[frame.type].to_av_and_unref) {
+        mp_frame_unref(&frame);
+        return NULL;
+    }
+
+    double pts = mp_frame_get_pts(frame);
+    AVFrame *res = frame_handlers[frame.type].to_av_and_unref(frame.data);
+    if (!res)
+        return NULL;
+
+    res->pts = mp_pts_to_av(pts, tb);
+    return res;
+}
+
 struct mp_frame mp_frame_from_av(enum mp_frame_type type, struct AVFrame *frame,
                                  struct AVRational *tb)
 {
@@ -374,9 +374,14 @@ const struct m_sub_options dvd_conf = {
 const struct m_sub_options filter_conf = {
     .opts = (const struct m_option[]){
         {"deinterlace", OPT_FLAG(deinterlace)},
+        {"vf-thread", OPT_FLAG(vf_thread)},
+        {"vf-thread-queue", OPT_INT(vf_thread_queue), M_RANGE(1, 100)},
         {0}
     },
     .size = sizeof(OPT_BASE_STRUCT),
+    .defaults = &(const struct filter_opts){
+        .vf_thread_queue = 2,
+    },
     .change_flags = UPDATE_IMGPAR,
 };
 
@@ -551,6 +556,7 @@ static const m_option_t mp_opts[] = {
     {"demuxer-termination-timeout", OPT_DOUBLE(demux_termination_timeout)},
     {"demuxer-cache-wait", OPT_FLAG(demuxer_cache_wait)},
     {"prefetch-playlist", OPT_FLAG(prefetch_open)},
+    {"prefetch-playlist-audio", OPT_DOUBLE(prefetch_audio), M_RANGE(0, 10)},
     {"cache-pause", OPT_FLAG(cache_pause)},
     {"cache-pause-initial", OPT_FLAG(cache_pause_initial)},
     {"cache-pause-wait", OPT_FLOAT(cache_pause_wait), M_RANGE(0, DBL_MAX)},
@@ -633,8 +639,10 @@ static const m_option_t mp_opts[] = {
     {"", OPT_SUBSTRUCT(ao_opts, ao_conf)},
     {"audio-exclusive", OPT_FLAG(audio_exclusive), .flags = UPDATE_AUDIO},
     {"audio-fallback-to-null", OPT_FLAG(ao_null_fallback)},
+    {"audio-sinks", OPT_STRINGLIST(audio_sinks), .flags = UPDATE_AUDIO},
     {"audio-stream-silence", OPT_FLAG(audio_stream_silence)},
     {"audio-wait-open", OPT_FLOAT(audio_wait_open), M_RANGE(0, 60)},
+    {"audio-meter-rate", OPT_DOUBLE(audio_meter_rate), M_RANGE(0, 1000)},
     {"force-window", OPT_CHOICE(force_vo,
         {"no", 0}, {"yes", 1}, {"immediate", 2})},
 
@@ -693,7 +701,9 @@ static const m_option_t mp_opts[] = {
         {"no", 0},
         {"vo", 1},
         {"decoder", 2},
-        {"decoder+vo", 3})},
+        {"decoder+vo", 3},
+        {"predictive", 4},
+        {"predictive+vo", 5})},
     {"video-latency-hacks", OPT_FLAG(video_latency_hacks)},
 
     {"untimed", OPT_FLAG(untimed)},
@@ -748,6 +758,7 @@ static const m_option_t mp_opts[] = {
         {"no", -1}, {"absolute", 0}, {"yes", 1}, {"always", 1}, {"default", 2})},
     {"hr-seek-demuxer-offset", OPT_FLOAT(hr_seek_demuxer_offset)},
     {"hr-seek-framedrop", OPT_FLAG(hr_seek_framedrop)},
+    {"scrub-mode", OPT_FLAG(scrub_mode)},
     {"autosync", OPT_CHOICE(autosync, {"no", -1}), M_RANGE(0, 10000)},
 
     {"term-osd", OPT_CHOICE(term_osd,
@@ -784,6 +795,8 @@ static const m_option_t mp_opts[] = {
     {"screenshot-directory", OPT_STRING(screenshot_directory),
         .flags = M_OPT_FILE},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-queue-size", OPT_INT(screenshot_queue_size), M_RANGE(0, 256)},
+    {"screenshot-threads", OPT_INT(screenshot_threads), M_RANGE(0, 64)},
 
     {"record-file", OPT_STRING(record_file), .flags = M_OPT_FILE,
         .deprecation_message = "use --stream-record or the dump-cache command"},
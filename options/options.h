@@ -165,8 +165,10 @@ typedef struct MPOpts {
 
     int audio_exclusive;
     int ao_null_fallback;
+    char **audio_sinks;
     int audio_stream_silence;
     float audio_wait_open;
+    double audio_meter_rate;
     int force_vo;
     float softvol_volume;
     int rgain_mode;
@@ -225,6 +227,7 @@ typedef struct MPOpts {
     int hr_seek;
     float hr_seek_demuxer_offset;
     int hr_seek_framedrop;
+    int scrub_mode;
     float audio_delay;
     float default_max_pts_correction;
     int autosync;
@@ -277,6 +280,7 @@ typedef struct MPOpts {
     double demux_termination_timeout;
     int demuxer_cache_wait;
     int prefetch_open;
+    double prefetch_audio;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -288,6 +292,8 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_directory;
     bool screenshot_sw;
+    int screenshot_queue_size;
+    int screenshot_threads;
 
     int index_mode;
 
@@ -377,6 +383,8 @@ struct dvd_opts {
 
 struct filter_opts {
     int deinterlace;
+    int vf_thread;
+    int vf_thread_queue;
 };
 
 extern const struct m_sub_options vo_sub_opts;
@@ -35,6 +35,7 @@
 #include "audio/out/ao.h"
 #include "demux/demux.h"
 #include "filters/f_async_queue.h"
+#include "filters/f_audio_meter.h"
 #include "filters/f_decoder_wrapper.h"
 #include "filters/filter_internal.h"
 
@@ -224,6 +225,10 @@ static void ao_chain_reset_state(struct ao_chain *ao_c)
     ao_c->start_pts = MP_NOPTS_VALUE;
     ao_c->untimed_throttle = false;
     ao_c->underrun = false;
+    for (int n = 0; n < ao_c->num_sinks; n++) {
+        ao_c->sinks[n].dropping = false;
+        ao_c->sinks[n].eof_pending = false;
+    }
 }
 
 void reset_audio_state(struct MPContext *mpctx)
@@ -245,6 +250,10 @@ void uninit_audio_out(struct MPContext *mpctx)
     if (ao_c) {
         ao_c->ao_queue = NULL;
         TA_FREEP(&ao_c->queue_filter);
+        for (int n = 0; n < ao_c->num_sinks; n++)
+            talloc_free(ao_c->sinks[n].queue_filter);
+        TA_FREEP(&ao_c->sinks);
+        ao_c->num_sinks = 0;
         ao_c->ao = NULL;
     }
     if (mpctx->ao) {
@@ -345,6 +354,17 @@ static void ao_chain_set_ao(struct ao_chain *ao_c, struct ao *ao)
         mp_async_queue_set_notifier(ao_c->queue_filter, ao_c->ao_filter);
         // Make sure filtering never stops with frames stuck in access filter.
         mp_filter_set_high_priority(ao_c->queue_filter, true);
+
+        struct ao *sink;
+        for (int n = 0; (sink = ao_get_sink(ao, n)); n++) {
+            struct ao_sink_input in = {
+                .queue_filter = mp_async_queue_create_filter(ao_c->ao_filter,
+                                            MP_PIN_IN, ao_get_queue(sink)),
+            };
+            mp_filter_set_high_priority(in.queue_filter, true);
+            MP_TARRAY_APPEND(ao_c, ao_c->sinks, ao_c->num_sinks, in);
+        }
+
         audio_update_volume(ao_c->mpctx);
     }
 
@@ -354,6 +374,28 @@ static void ao_chain_set_ao(struct ao_chain *ao_c, struct ao *ao)
     mp_filter_wakeup(ao_c->ao_filter);
 }
 
+// Open the additional outputs (--audio-sinks). The main AO stays the clock
+// master; the sinks just get a copy of everything written to it.
+static void init_audio_sinks(struct MPContext *mpctx, int rate, int format,
+                             struct mp_chmap channels)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    for (int n = 0; opts->audio_sinks && opts->audio_sinks[n]; n++) {
+        struct ao *sink = ao_init_sink(mpctx->global, mp_wakeup_core_cb, mpctx,
+                                       mpctx->encode_lavc_ctx,
+                                       opts->audio_sinks[n], rate, format,
+                                       channels);
+        if (!sink) {
+            MP_ERR(mpctx, "Could not open audio sink '%s'.\n",
+                   opts->audio_sinks[n]);
+            continue;
+        }
+        MP_INFO(mpctx, "AO sink: [%s]\n", ao_get_name(sink));
+        ao_add_sink(mpctx->ao, sink);
+    }
+}
+
 static int reinit_audio_filters_and_output(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -492,6 +534,8 @@ static int reinit_audio_filters_and_output(struct MPContext *mpctx)
     MP_VERBOSE(mpctx, "AO: Description: %s\n", ao_get_description(mpctx->ao));
     update_window_title(mpctx, true);
 
+    init_audio_sinks(mpctx, ao_rate, ao_format, ao_channels);
+
     ao_c->ao_resume_time =
         opts->audio_wait_open > 0 ? mp_time_sec() + opts->audio_wait_open : 0;
 
@@ -525,6 +569,27 @@ int init_audio_decoder(struct MPContext *mpctx, struct track *track)
     if (!track->stream)
         goto init_error;
 
+    // Use the decoder started by --prefetch-playlist-audio, which has the
+    // first frames decoded already. It was set up for the normal audio chain
+    // (spdif flag), so it can't be used for lavfi-complex.
+    if (mpctx->prefetch_adec && mpctx->prefetch_astream == track->stream) {
+        if (track->ao_c) {
+            MP_VERBOSE(mpctx, "Using prefetched audio decoder.\n");
+            track->dec = mpctx->prefetch_adec;
+            mpctx->prefetch_adec = NULL;
+            mpctx->prefetch_astream = NULL;
+            mp_decoder_wrapper_end_prefetch(track->dec);
+            return 1;
+        }
+        // It has read packets of this stream; make the demuxer return them
+        // again to the new decoder.
+        uninit_prefetch_audio(mpctx);
+        demuxer_select_track(track->demuxer, track->stream, MP_NOPTS_VALUE,
+                             false);
+        demuxer_select_track(track->demuxer, track->stream,
+                             get_start_time(mpctx, mpctx->play_dir), true);
+    }
+
     track->dec = mp_decoder_wrapper_create(mpctx->filter_root, track->stream);
     if (!track->dec)
         goto init_error;
@@ -579,6 +644,8 @@ void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track)
     ao_c->spdif_passthrough = true;
     ao_c->last_out_pts = MP_NOPTS_VALUE;
     ao_c->delay = mpctx->opts->audio_delay;
+    if (ao_c->filter)
+        mp_audio_meter_set_rate(ao_c->filter->meter, mpctx->opts->audio_meter_rate);
 
     ao_c->ao_filter = mp_filter_create(mpctx->filter_root, &ao_filter);
     if (!ao_c->filter || !ao_c->ao_filter)
@@ -646,6 +713,53 @@ static void update_throttle(struct MPContext *mpctx)
     }
 }
 
+// Write EOF to the sinks which had no space for it. The sink queue filters
+// wake up ao_filter when they request data, so this is retried in time.
+static void write_sinks_pending_eof(struct ao_chain *ao_c)
+{
+    for (int n = 0; n < ao_c->num_sinks; n++) {
+        struct ao_sink_input *in = &ao_c->sinks[n];
+        struct mp_pin *pin = in->queue_filter->pins[0];
+
+        if (in->eof_pending && mp_pin_in_needs_data(pin)) {
+            in->eof_pending = false;
+            mp_pin_in_write(pin, MP_EOF_FRAME);
+        }
+    }
+}
+
+// Copy the frame to the sinks. A sink that can't keep up never holds back the
+// main AO; it loses audio frames instead. EOF is never lost, but delayed until
+// the sink's queue has space, so that draining the sink works.
+static void write_sinks(struct ao_chain *ao_c, struct mp_frame frame)
+{
+    write_sinks_pending_eof(ao_c);
+
+    for (int n = 0; n < ao_c->num_sinks; n++) {
+        struct ao_sink_input *in = &ao_c->sinks[n];
+        struct mp_pin *pin = in->queue_filter->pins[0];
+
+        if (frame.type == MP_FRAME_AUDIO)
+            in->eof_pending = false; // the EOF was followed by new data
+
+        if (!mp_pin_in_needs_data(pin)) {
+            if (frame.type == MP_FRAME_EOF) {
+                in->eof_pending = true;
+                continue;
+            }
+            if (!in->dropping && frame.type == MP_FRAME_AUDIO)
+                MP_WARN(ao_c, "Audio sink %d is not keeping up.\n", n + 1);
+            in->dropping = true;
+            continue;
+        }
+        in->dropping = false;
+
+        struct mp_frame ref = mp_frame_ref(frame);
+        MP_HANDLE_OOM(ref.type);
+        mp_pin_in_write(pin, ref);
+    }
+}
+
 static void ao_process(struct mp_filter *f)
 {
     struct ao_chain *ao_c = f->priv;
@@ -669,6 +783,8 @@ static void ao_process(struct mp_filter *f)
         return;
     }
 
+    write_sinks_pending_eof(ao_c);
+
     // Due to mp_async_queue_set_notifier() this function is called when the
     // queue becomes full. This affects state changes in the normal playloop,
     // so wake it up. But avoid redundant wakeups during normal playback.
@@ -697,6 +813,7 @@ static void ao_process(struct mp_filter *f)
                 mp_pin_out_unread(f->ppins[0], frame);
                 if (!ao_c->out_eof) {
                     ao_c->out_eof = true;
+                    write_sinks(ao_c, MP_EOF_FRAME);
                     mp_pin_in_write(ao_c->queue_filter->pins[0], MP_EOF_FRAME);
                 }
                 return;
@@ -748,6 +865,7 @@ static void ao_process(struct mp_filter *f)
             MP_VERBOSE(mpctx, "previous audio still playing; continuing\n");
         }
 
+        write_sinks(ao_c, frame);
         mp_pin_in_write(ao_c->queue_filter->pins[0], frame);
     } else if (frame.type == MP_FRAME_EOF) {
         MP_VERBOSE(mpctx, "audio filter EOF\n");
@@ -755,6 +873,7 @@ static void ao_process(struct mp_filter *f)
         ao_c->out_eof = true;
         mp_wakeup_core(mpctx);
 
+        write_sinks(ao_c, frame);
         mp_pin_in_write(ao_c->queue_filter->pins[0], frame);
         mp_filter_internal_mark_progress(f);
     } else {
@@ -891,6 +1010,11 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
             return;
     }
 
+    if (ao_c->filter->meter->updated) {
+        ao_c->filter->meter->updated = false;
+        mp_notify_property(mpctx, "audio-meter");
+    }
+
     if (mpctx->vo_chain && ao_c->track && ao_c->track->dec &&
         mp_decoder_wrapper_get_pts_reset(ao_c->track->dec))
     {
@@ -39,6 +39,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "common/stats.h"
+#include "filters/f_audio_meter.h"
 #include "filters/f_decoder_wrapper.h"
 #include "command.h"
 #include "osdep/timer.h"
@@ -1829,6 +1830,43 @@ static int mp_property_audio_out_params(void *ctx, struct m_property *prop,
     return r;
 }
 
+static int mp_property_audio_meter(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct mp_audio_meter_values v;
+    if (!mpctx->ao_chain ||
+        !mp_audio_meter_get_values(mpctx->ao_chain->filter->meter, &v))
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    node_map_add_string(r, "channels", mp_chmap_to_str(&v.chmap));
+    node_map_add_int64(r, "channel-count", v.chmap.num);
+    struct mpv_node *peak = node_map_add(r, "peak", MPV_FORMAT_NODE_ARRAY);
+    struct mpv_node *rms = node_map_add(r, "rms", MPV_FORMAT_NODE_ARRAY);
+    struct mpv_node *tp = node_map_add(r, "true-peak", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < v.chmap.num; n++) {
+        node_array_add(peak, MPV_FORMAT_DOUBLE)->u.double_ = v.peak[n];
+        node_array_add(rms, MPV_FORMAT_DOUBLE)->u.double_ = v.rms[n];
+        node_array_add(tp, MPV_FORMAT_DOUBLE)->u.double_ = v.true_peak[n];
+    }
+    node_map_add_double(r, "momentary", v.momentary);
+    node_map_add_double(r, "short-term", v.short_term);
+    if (v.pts != MP_NOPTS_VALUE)
+        node_map_add_double(r, "pts", v.pts);
+
+    return M_PROPERTY_OK;
+}
+
 static struct track* track_next(struct MPContext *mpctx, enum stream_type type,
                                 int direction, struct track *track)
 {
@@ -2622,6 +2660,25 @@ static int mp_property_perf_info(void *ctx, struct m_property *p, int action,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_filter_graph(void *ctx, struct m_property *p,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->filter_root)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        mp_filter_dump_graph(mpctx->filter_root, (struct mpv_node *)arg);
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3651,6 +3708,7 @@ static const struct m_property mp_properties_base[] = {
     {"audio-codec", mp_property_audio_codec},
     {"audio-params", mp_property_audio_params},
     {"audio-out-params", mp_property_audio_out_params},
+    {"audio-meter", mp_property_audio_meter},
     {"aid", property_switch_track, .priv = (void *)(const int[]){0, STREAM_AUDIO}},
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
@@ -3671,6 +3729,7 @@ static const struct m_property mp_properties_base[] = {
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
     {"perf-info", mp_property_perf_info},
+    {"filter-graph", mp_property_filter_graph},
     {"current-vo", mp_property_vo},
     {"container-fps", mp_property_fps},
     {"estimated-vf-fps", mp_property_vf_fps},
@@ -6702,6 +6761,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
         }
     }
 
+    if (opt_ptr == &opts->scrub_mode) {
+        update_scrub_mode(mpctx);
+        mp_wakeup_core(mpctx);
+    }
+
     if (opt_ptr == &opts->edition_id) {
         struct demuxer *demuxer = mpctx->demuxer;
         if (mpctx->playback_initialized && demuxer && demuxer->num_editions > 0) {
@@ -6716,6 +6780,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (opt_ptr == &opts->pause)
         set_pause_state(mpctx, opts->pause);
 
+    if (opt_ptr == &opts->audio_meter_rate && mpctx->ao_chain) {
+        mp_audio_meter_set_rate(mpctx->ao_chain->filter->meter,
+                                opts->audio_meter_rate);
+    }
+
     if (opt_ptr == &opts->audio_delay) {
         if (mpctx->ao_chain) {
             mpctx->delay += mpctx->opts->audio_delay - mpctx->ao_chain->delay;
@@ -168,6 +168,18 @@ struct vo_chain {
 
     bool underrun;
     bool underrun_signaled;
+
+    // Predictive decoder framedrop (--framedrop=predictive).
+    bool predict_drop;          // currently dropping non-reference frames
+    double predict_hold_until;  // keep dropping at least until this time
+    int64_t predict_delayed;    // last vo_get_delayed_count()
+};
+
+// Writes the audio of an ao_chain to an additional AO (--audio-sinks).
+struct ao_sink_input {
+    struct mp_filter *queue_filter;
+    bool dropping;      // queue was full when the last frame was written
+    bool eof_pending;   // EOF still needs to be written once there's space
 };
 
 // Like vo_chain, for audio.
@@ -185,6 +197,10 @@ struct ao_chain {
     struct mp_filter *ao_filter;
     double ao_resume_time;
 
+    // For the sinks of ao (ao_get_sink()).
+    struct ao_sink_input *sinks;
+    int num_sinks;
+
     bool out_eof;
     double last_out_pts;
 
@@ -360,6 +376,8 @@ typedef struct MPContext {
     double video_pts;
     // Last seek target.
     double last_seek_pts;
+    // Last seek target while --scrub-mode was enabled, or MP_NOPTS_VALUE.
+    double scrub_pts;
     // Frame duration field from demuxer. Only used for duration of the last
     // video frame.
     double last_frame_duration;
@@ -454,6 +472,12 @@ typedef struct MPContext {
     //     to true.
     struct demuxer *open_res_demuxer;
     int open_res_error;
+
+    // --- Audio decoded ahead for the prefetched demuxer (open_res_demuxer).
+    //     prefetch_filter_root becomes filter_root if the demuxer is used.
+    struct mp_filter *prefetch_filter_root;
+    struct mp_decoder_wrapper *prefetch_adec;
+    struct sh_stream *prefetch_astream; // stream decoded by prefetch_adec
 } MPContext;
 
 // Contains information about an asynchronous work item, how it can be aborted,
@@ -537,6 +561,7 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel);
 struct track *select_default_track(struct MPContext *mpctx, int order,
                                    enum stream_type type);
 void prefetch_next(struct MPContext *mpctx);
+void uninit_prefetch_audio(struct MPContext *mpctx);
 void close_recorder(struct MPContext *mpctx);
 void close_recorder_and_error(struct MPContext *mpctx);
 void open_recorder(struct MPContext *mpctx, bool on_init);
@@ -601,6 +626,7 @@ double chapter_start_time(struct MPContext *mpctx, int chapter);
 int get_chapter_count(struct MPContext *mpctx);
 int get_cache_buffering_percentage(struct MPContext *mpctx);
 void execute_queued_seek(struct MPContext *mpctx);
+void update_scrub_mode(struct MPContext *mpctx);
 void run_playloop(struct MPContext *mpctx);
 void mp_idle(struct MPContext *mpctx);
 void idle_loop(struct MPContext *mpctx);
@@ -1083,8 +1083,10 @@ static void cancel_open(struct MPContext *mpctx)
         pthread_join(mpctx->open_thread, NULL);
     mpctx->open_active = false;
 
-    if (mpctx->open_res_demuxer)
+    if (mpctx->open_res_demuxer) {
+        uninit_prefetch_audio(mpctx); // reads from the demuxer
         demux_cancel_and_free(mpctx->open_res_demuxer);
+    }
     mpctx->open_res_demuxer = NULL;
 
     TA_FREEP(&mpctx->open_cancel);
@@ -1160,6 +1162,14 @@ static void open_demux_reentrant(struct MPContext *mpctx)
         mpctx->demuxer = mpctx->open_res_demuxer;
         mpctx->open_res_demuxer = NULL;
         mp_cancel_set_parent(mpctx->demuxer->cancel, mpctx->playback_abort);
+
+        // Take over the graph with the audio decoder that was started early.
+        // Nothing was added to the current filter_root yet at this point.
+        if (mpctx->prefetch_filter_root) {
+            talloc_free(mpctx->filter_root);
+            mpctx->filter_root = mpctx->prefetch_filter_root;
+            mpctx->prefetch_filter_root = NULL;
+        }
     } else {
         mpctx->error_playing = mpctx->open_res_error;
     }
@@ -1167,6 +1177,52 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     cancel_open(mpctx); // cleanup
 }
 
+// Start decoding the audio of the prefetched demuxer, once it's opened.
+static void prefetch_audio(struct MPContext *mpctx)
+{
+    double duration = mpctx->opts->prefetch_audio;
+    struct demuxer *demux = mpctx->open_res_demuxer;
+    if (duration <= 0 || !mpctx->open_for_prefetch ||
+        !atomic_load(&mpctx->open_done) || !demux ||
+        mpctx->prefetch_filter_root || mpctx->encode_lavc_ctx)
+        return;
+
+    // Created even if it stays empty, so this is done only once.
+    struct mp_filter *root = mp_filter_create_root(mpctx->global);
+    mp_filter_graph_set_wakeup_cb(root, mp_wakeup_core_cb, mpctx);
+    mp_filter_graph_set_max_run_time(root, 0.1);
+    mp_filter_graph_set_stats(root, "filter");
+    mpctx->prefetch_filter_root = root;
+
+    // Guess the track that will be selected; if that's wrong, the decoder is
+    // discarded when the file is loaded.
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demux); n++) {
+        struct sh_stream *s = demux_get_stream(demux, n);
+        if (s->type != STREAM_AUDIO)
+            continue;
+        if (!sh || (s->default_track && !sh->default_track))
+            sh = s;
+    }
+    if (!sh)
+        return;
+
+    struct mp_decoder_wrapper *dec =
+        mp_decoder_wrapper_create_prefetch(root, sh, duration);
+    if (!dec)
+        return;
+    // Same as init_audio_decoder() does for the normal audio chain.
+    mp_decoder_wrapper_set_spdif_flag(dec, true);
+    if (!mp_decoder_wrapper_reinit(dec)) {
+        talloc_free(dec->f);
+        return;
+    }
+
+    MP_VERBOSE(mpctx, "Prefetching audio: stream %d\n", sh->index);
+    mpctx->prefetch_adec = dec;
+    mpctx->prefetch_astream = sh;
+}
+
 void prefetch_next(struct MPContext *mpctx)
 {
     if (!mpctx->opts->prefetch_open)
@@ -1177,6 +1233,19 @@ void prefetch_next(struct MPContext *mpctx)
         MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
         start_open(mpctx, new_entry->filename, new_entry->stream_flags, true);
     }
+
+    if (mpctx->open_active)
+        prefetch_audio(mpctx);
+}
+
+// Free the decoder started by prefetch_audio(), if it wasn't used.
+void uninit_prefetch_audio(struct MPContext *mpctx)
+{
+    if (mpctx->prefetch_adec)
+        talloc_free(mpctx->prefetch_adec->f);
+    mpctx->prefetch_adec = NULL;
+    mpctx->prefetch_astream = NULL;
+    TA_FREEP(&mpctx->prefetch_filter_root);
 }
 
 // Destroy the complex filter, and remove the references to the filter pads.
@@ -1455,10 +1524,12 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->display_sync_active = false;
     // let get_current_time() show 0 as start time (before playback_pts is set)
     mpctx->last_seek_pts = 0.0;
+    mpctx->scrub_pts = MP_NOPTS_VALUE;
     mpctx->seek = (struct seek_params){ 0 };
     mpctx->filter_root = mp_filter_create_root(mpctx->global);
     mp_filter_graph_set_wakeup_cb(mpctx->filter_root, mp_wakeup_core_cb, mpctx);
     mp_filter_graph_set_max_run_time(mpctx->filter_root, 0.1);
+    mp_filter_graph_set_stats(mpctx->filter_root, "filter");
 
     reset_playback_state(mpctx);
 
@@ -1596,6 +1667,11 @@ static void play_current_file(struct MPContext *mpctx)
         }
     }
 
+    // The prefetched audio decoder must go before its stream is deselected.
+    struct track *atrack = mpctx->current_track[0][STREAM_AUDIO];
+    if (!atrack || atrack->stream != mpctx->prefetch_astream)
+        uninit_prefetch_audio(mpctx);
+
     for (int n = 0; n < mpctx->num_tracks; n++)
         reselect_demux_stream(mpctx, mpctx->tracks[n], false);
 
@@ -1606,6 +1682,7 @@ static void play_current_file(struct MPContext *mpctx)
     reinit_video_chain(mpctx);
     reinit_audio_chain(mpctx);
     reinit_sub_all(mpctx);
+    uninit_prefetch_audio(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         if (mpctx->vo_chain)
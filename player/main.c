@@ -180,6 +180,8 @@ void mp_destroy(struct MPContext *mpctx)
 
     command_uninit(mpctx);
 
+    screenshot_uninit(mpctx);
+
     mp_clients_destroy(mpctx);
 
     osd_free(mpctx->osd);
@@ -301,6 +301,13 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
          (opts->hr_seek >= 0 && seek.type == MPSEEK_ABSOLUTE) ||
          (opts->hr_seek == 2 && (!mpctx->vo_chain || mpctx->vo_chain->is_sparse)));
 
+    // Scrubbing shows keyframes only; the exact position is restored when
+    // scrub mode is disabled.
+    if (opts->scrub_mode && seek_pts != MP_NOPTS_VALUE) {
+        hr_seek = false;
+        mpctx->scrub_pts = seek_pts;
+    }
+
     if (seek.type == MPSEEK_FACTOR || seek.amount < 0 ||
         (seek.type == MPSEEK_ABSOLUTE && seek.amount < mpctx->last_chapter_pts))
         mpctx->last_chapter_seek = -2;
@@ -471,8 +478,10 @@ void execute_queued_seek(struct MPContext *mpctx)
         // If the user seeks continuously (keeps arrow key down) try to finish
         // showing a frame from one location before doing another seek (instead
         // of never updating the screen).
-        if ((mpctx->seek.flags & MPSEEK_FLAG_DELAY) &&
-            mp_time_sec() - mpctx->start_timestamp < 0.3)
+        // In scrub mode, all seeks are coalesced this way.
+        bool delay = (mpctx->seek.flags & MPSEEK_FLAG_DELAY) ||
+                     mpctx->opts->scrub_mode;
+        if (delay && mp_time_sec() - mpctx->start_timestamp < 0.3)
         {
             // Wait until a video frame is available and has been shown.
             if (mpctx->video_status < STATUS_PLAYING)
@@ -489,6 +498,32 @@ void execute_queued_seek(struct MPContext *mpctx)
     }
 }
 
+// Apply --scrub-mode to the video decoders and demuxers. When it is disabled,
+// seek back to the last scrub target to get exact, non-keyframe output again.
+void update_scrub_mode(struct MPContext *mpctx)
+{
+    bool enable = mpctx->opts->scrub_mode;
+
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *track = mpctx->tracks[n];
+        if (track->type != STREAM_VIDEO)
+            continue;
+        if (track->demuxer)
+            demux_set_keyframes_only(track->demuxer, enable);
+        if (track->dec)
+            mp_decoder_wrapper_set_keyframes_only(track->dec, enable);
+    }
+
+    if (!enable && mpctx->playback_initialized) {
+        double pts = mpctx->scrub_pts;
+        if (pts == MP_NOPTS_VALUE)
+            pts = get_current_time(mpctx);
+        if (pts != MP_NOPTS_VALUE)
+            queue_seek(mpctx, MPSEEK_ABSOLUTE, pts, MPSEEK_EXACT, 0);
+        mpctx->scrub_pts = MP_NOPTS_VALUE;
+    }
+}
+
 // NOPTS (i.e. <0) if unknown
 double get_time_length(struct MPContext *mpctx)
 {
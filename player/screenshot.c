@@ -15,10 +15,14 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <libavutil/cpu.h>
+
 #include "config.h"
 
 #include "osdep/io.h"
@@ -31,6 +35,7 @@
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "common/msg.h"
 #include "options/path.h"
@@ -54,8 +59,27 @@ typedef struct screenshot_ctx {
 
     int frameno;
     uint64_t last_frame_count;
+
+    // Asynchronous each-frame pipeline (--screenshot-queue-size).
+    struct mp_thread_pool *pool;
+    int pool_threads;
+    pthread_mutex_t lock;
+    int num_queued;     // jobs queued or running
+    uint64_t dropped;   // each-frame screenshots skipped because queue was full
+    bool dropping;      // the last each-frame screenshot was skipped
+    struct image_writer_cache **caches; // idle per-job encoder state
+    int num_caches;
 } screenshot_ctx;
 
+struct screenshot_job {
+    struct screenshot_ctx *ctx;
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_image *image;
+    char *filename;
+    struct image_writer_opts opts;
+};
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -63,6 +87,30 @@ void screenshot_init(struct MPContext *mpctx)
         .mpctx = mpctx,
         .frameno = 1,
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+}
+
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    if (!ctx)
+        return;
+
+    // Blocks until all queued screenshots were written.
+    talloc_free(ctx->pool);
+    ctx->pool = NULL;
+
+    if (ctx->dropped) {
+        MP_WARN(mpctx, "%"PRIu64" each-frame screenshots were dropped because "
+                "the screenshot queue was full.\n", ctx->dropped);
+    }
+
+    for (int n = 0; n < ctx->num_caches; n++)
+        talloc_free(ctx->caches[n]);
+    talloc_free(ctx->caches);
+
+    pthread_mutex_destroy(&ctx->lock);
+    TA_FREEP(&mpctx->screenshot_ctx);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -97,6 +145,101 @@ static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
     return ok;
 }
 
+static void screenshot_job_run(void *p)
+{
+    struct screenshot_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct image_writer_cache *cache = NULL;
+    if (ctx->num_caches)
+        MP_TARRAY_POP(ctx->caches, ctx->num_caches, &cache);
+    pthread_mutex_unlock(&ctx->lock);
+    if (!cache)
+        cache = image_writer_cache_alloc(NULL);
+
+    if (write_image_cached(cache, job->image, &job->opts, job->filename,
+                           job->global, job->log))
+    {
+        mp_msg(job->log, MSGL_V, "Screenshot: '%s'\n", job->filename);
+    } else {
+        mp_msg(job->log, MSGL_ERR, "Error writing screenshot '%s'!\n",
+               job->filename);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    // Not parented to ctx, because the core thread may allocate on it.
+    MP_TARRAY_APPEND(NULL, ctx->caches, ctx->num_caches, cache);
+    ctx->num_queued -= 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    talloc_free(job);
+}
+
+// Reserve a slot in the bounded screenshot queue. Returns false if the queue
+// is full. On success, the slot is released by the job queued with
+// queue_screenshot(), or with release_queue_slot() if nothing was queued.
+static bool reserve_queue_slot(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    bool ok;
+    pthread_mutex_lock(&ctx->lock);
+    ok = ctx->num_queued < mpctx->opts->screenshot_queue_size;
+    if (ok)
+        ctx->num_queued += 1;
+    pthread_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+// Hand off conversion, encoding and writing of the image to the worker pool.
+// Requires a slot from reserve_queue_slot(). On success, takes ownership of
+// image and returns true. On failure, the caller keeps both image and slot.
+static bool queue_screenshot(struct MPContext *mpctx, struct mp_image *image,
+                             const char *filename)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    int threads = mpctx->opts->screenshot_threads;
+    if (threads < 1)
+        threads = MPMAX(av_cpu_count() / 2, 1);
+    threads = MPMIN(threads, mpctx->opts->screenshot_queue_size);
+
+    if (ctx->pool && ctx->pool_threads != threads) {
+        talloc_free(ctx->pool); // waits for running jobs
+        ctx->pool = NULL;
+    }
+    if (!ctx->pool) {
+        ctx->pool = mp_thread_pool_create(ctx, 0, 1, threads);
+        ctx->pool_threads = threads;
+    }
+
+    struct screenshot_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct screenshot_job){
+        .ctx = ctx,
+        .global = mpctx->global,
+        .log = mpctx->log,
+        .image = talloc_steal(job, image),
+        .filename = talloc_strdup(job, filename),
+        .opts = *mpctx->opts->screenshot_image_opts,
+    };
+
+    if (!mp_thread_pool_queue(ctx->pool, screenshot_job_run, job)) {
+        talloc_steal(NULL, image);
+        talloc_free(job);
+        return false;
+    }
+    MP_VERBOSE(mpctx, "Queuing screenshot: '%s'\n", filename);
+    return true;
+}
+
+static void release_queue_slot(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_queued -= 1;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 #ifdef _WIN32
 #define ILLEGAL_FILENAME_CHARS "?\"/\\<>*|:"
 #else
@@ -478,6 +621,25 @@ void cmd_screenshot(void *p)
 
     cmd->success = false;
 
+    // In each-frame mode with a screenshot queue, never stall playback on
+    // encoding: skip the frame if the workers are still busy.
+    bool async = each_frame_mode && mpctx->opts->screenshot_queue_size > 0;
+    if (async && !reserve_queue_slot(mpctx)) {
+        ctx->dropped += 1;
+        if (!ctx->dropping) {
+            MP_WARN(mpctx, "Screenshot queue full, dropping frames. Writing "
+                    "the images is not keeping up with playback.\n");
+        }
+        ctx->dropping = true;
+        cmd->success = true;
+        return;
+    }
+    if (async && ctx->dropping) {
+        MP_INFO(mpctx, "Screenshot queue caught up, %"PRIu64" frames dropped "
+                "so far.\n", ctx->dropped);
+        ctx->dropping = false;
+    }
+
     struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
     bool high_depth = image_writer_high_depth(opts);
 
@@ -485,13 +647,21 @@ void cmd_screenshot(void *p)
 
     if (image) {
         char *filename = gen_fname(cmd, image_writer_file_ext(opts));
-        if (filename)
+        if (filename && async && queue_screenshot(mpctx, image, filename)) {
+            image = NULL;
+            async = false;
+            cmd->success = true;
+        } else if (filename) {
             cmd->success = write_screenshot(cmd, image, filename, NULL);
+        }
         talloc_free(filename);
     } else {
         mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
     }
 
+    if (async)
+        release_queue_slot(mpctx);
+
     talloc_free(image);
 }
 
@@ -25,6 +25,7 @@
 #include "mpv_talloc.h"
 
 #include "common/msg.h"
+#include "common/stats.h"
 #include "options/options.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
@@ -189,6 +190,11 @@ int init_video_decoder(struct MPContext *mpctx, struct track *track)
     if (!mp_decoder_wrapper_reinit(track->dec))
         goto err_out;
 
+    if (mpctx->opts->scrub_mode) {
+        demux_set_keyframes_only(track->demuxer, true);
+        mp_decoder_wrapper_set_keyframes_only(track->dec, true);
+    }
+
     return 1;
 
 err_out:
@@ -317,22 +323,83 @@ void mp_force_video_refresh(struct MPContext *mpctx)
     }
 }
 
+// Predictive framedrop starts dropping if decoding a frame is expected to take
+// more than PREDICT_DROP_HIGH of the frame duration, and stops if it goes below
+// PREDICT_DROP_LOW, but not earlier than PREDICT_DROP_HOLD seconds after the
+// last sign of trouble.
+#define PREDICT_DROP_HIGH 0.9
+#define PREDICT_DROP_LOW 0.7
+#define PREDICT_DROP_HOLD 1.0
+
+static void set_predict_drop(struct MPContext *mpctx, struct vo_chain *vo_c,
+                             bool drop)
+{
+    if (drop != vo_c->predict_drop) {
+        MP_VERBOSE(mpctx, "%s dropping non-reference frames.\n",
+                   drop ? "Start" : "Stop");
+        stats_event(mpctx->stats, drop ? "framedrop-start" : "framedrop-stop");
+    }
+    vo_c->predict_drop = drop;
+    // Keep the count high enough that the decoder never runs out of frames
+    // to drop before the next call.
+    mp_decoder_wrapper_set_frame_drops(vo_c->track->dec, drop ? 100 : 0);
+}
+
+// Drop non-reference frames before decoding them if the decoder or the VO
+// are predicted to fall behind, instead of waiting for A/V desync to happen.
+static void check_framedrop_predictive(struct MPContext *mpctx,
+                                       struct vo_chain *vo_c, double frame_time)
+{
+    double decode_time =
+        mp_decoder_wrapper_get_decode_time(vo_c->track->dec);
+
+    // Display timing jitter eats into the time budget of a frame.
+    double jitter = vo_get_estimated_vsync_jitter(vo_c->vo) *
+                    vo_get_estimated_vsync_interval(vo_c->vo);
+    double load = (decode_time + MPMAX(jitter, 0)) / frame_time;
+
+    int64_t delayed = vo_get_delayed_count(vo_c->vo);
+    bool trouble = delayed > vo_c->predict_delayed ||
+                   mpctx->last_av_difference > frame_time;
+    vo_c->predict_delayed = delayed;
+
+    double now = mp_time_sec();
+    bool drop = vo_c->predict_drop;
+    if (trouble || load > PREDICT_DROP_HIGH) {
+        drop = true;
+        vo_c->predict_hold_until = now + PREDICT_DROP_HOLD;
+    } else if (load < PREDICT_DROP_LOW && now >= vo_c->predict_hold_until) {
+        drop = false;
+    }
+
+    stats_value(mpctx->stats, "framedrop-load", load);
+    stats_value(mpctx->stats, "framedrop-active", drop);
+    set_predict_drop(mpctx, vo_c, drop);
+}
+
 static void check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
 {
     struct MPOpts *opts = mpctx->opts;
     // check for frame-drop:
     if (mpctx->video_status == STATUS_PLAYING && !mpctx->paused &&
         mpctx->audio_status == STATUS_PLAYING && !ao_untimed(mpctx->ao) &&
-        vo_c->track && vo_c->track->dec && (opts->frame_dropping & 2))
+        vo_c->track && vo_c->track->dec && (opts->frame_dropping & (2 | 4)))
     {
         float fps = vo_c->filter->container_fps;
         // it's a crappy heuristic; avoid getting upset by incorrect fps
         if (fps <= 20 || fps >= 500)
             return;
         double frame_time =  1.0 / fps;
+        if (opts->frame_dropping & 4) {
+            check_framedrop_predictive(mpctx, vo_c,
+                                       frame_time / mpctx->video_speed);
+            return;
+        }
         // try to drop as many frames as we appear to be behind
         mp_decoder_wrapper_set_frame_drops(vo_c->track->dec,
             MPCLAMP((mpctx->last_av_difference - 0.010) / frame_time, 0, 100));
+    } else if (vo_c->predict_drop && vo_c->track && vo_c->track->dec) {
+        set_predict_drop(mpctx, vo_c, false);
     }
 }
 
@@ -271,12 +271,19 @@ void ta_set_destructor(void *ptr, void (*destructor)(void *))
 
 static pthread_mutex_t ta_dbg_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool enable_leak_check; // pretty much constant
+static bool enable_alloc_count;
+static int64_t num_allocs;
 static struct ta_header leak_node;
 static char allocation_is_string;
 
 static void ta_dbg_add(struct ta_header *h)
 {
     h->canary = CANARY;
+    if (enable_alloc_count) {
+        pthread_mutex_lock(&ta_dbg_mutex);
+        num_allocs++;
+        pthread_mutex_unlock(&ta_dbg_mutex);
+    }
     if (enable_leak_check) {
         pthread_mutex_lock(&ta_dbg_mutex);
         h->leak_next = &leak_node;
@@ -371,6 +378,27 @@ void ta_enable_leak_report(void)
     pthread_mutex_unlock(&ta_dbg_mutex);
 }
 
+/* Start counting allocations and reallocations (for benchmarks). This makes
+ * allocations slower, so it's never enabled by default.
+ */
+void ta_enable_alloc_count(void)
+{
+    pthread_mutex_lock(&ta_dbg_mutex);
+    enable_alloc_count = true;
+    pthread_mutex_unlock(&ta_dbg_mutex);
+}
+
+/* Return the number of allocations since ta_enable_alloc_count(), or -1 if
+ * counting is not supported (memory debugging disabled at compile time).
+ */
+int64_t ta_get_alloc_count(void)
+{
+    pthread_mutex_lock(&ta_dbg_mutex);
+    int64_t r = num_allocs;
+    pthread_mutex_unlock(&ta_dbg_mutex);
+    return r;
+}
+
 /* Set a (static) string that will be printed if the memory allocation in ptr
  * shows up on the leak report. The string must stay valid until ptr is freed.
  * Calling it on ptr==NULL does nothing.
@@ -400,6 +428,8 @@ static void ta_dbg_check_header(struct ta_header *h){}
 static void ta_dbg_remove(struct ta_header *h){}
 
 void ta_enable_leak_report(void){}
+void ta_enable_alloc_count(void){}
+int64_t ta_get_alloc_count(void){return -1;}
 void *ta_dbg_set_loc(void *ptr, const char *loc){return ptr;}
 void *ta_dbg_mark_as_string(void *ptr){return ptr;}
 
@@ -18,6 +18,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdarg.h>
 
 #ifdef __GNUC__
@@ -151,6 +152,8 @@ void *ta_oom_p(void *p);
 #define ta_oom_g(ptr) (TA_TYPEOF(ptr))ta_oom_p(ptr)
 
 void ta_enable_leak_report(void);
+void ta_enable_alloc_count(void);
+int64_t ta_get_alloc_count(void);
 void *ta_dbg_set_loc(void *ptr, const char *name);
 void *ta_dbg_mark_as_string(void *ptr);
 
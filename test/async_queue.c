@@ -0,0 +1,138 @@
+#include <pthread.h>
+
+#include "audio/aframe.h"
+#include "common/common.h"
+#include "filters/f_async_queue.h"
+#include "filters/filter.h"
+#include "filters/filter_internal.h"
+#include "test_filters.h"
+
+#define NUM_FRAMES 20000
+
+struct source_state {
+    int pos;
+};
+
+static struct mp_frame next_frame(void *ctx)
+{
+    struct source_state *s = ctx;
+    if (s->pos >= NUM_FRAMES)
+        return MP_NO_FRAME;
+    struct mp_aframe *frame = mp_aframe_create();
+    mp_aframe_set_pts(frame, s->pos++);
+    return MAKE_FRAME(MP_FRAME_AUDIO, frame);
+}
+
+struct sink_state {
+    int num_frames;
+    double last_pts;
+    bool in_order;
+};
+
+static void on_frame(void *ctx, struct mp_frame frame)
+{
+    struct sink_state *s = ctx;
+    double pts = mp_frame_get_pts(frame);
+    if (pts <= s->last_pts)
+        s->in_order = false;
+    s->last_pts = pts;
+    s->num_frames++;
+}
+
+static void *producer_thread(void *ptr)
+{
+    struct test_graph *g = ptr;
+    while (test_graph_run(g, NULL)) {}
+    return NULL;
+}
+
+// Pass frames between 2 threads through a small queue, so that the producer
+// and consumer hit the full and empty cases all the time. With mutate set,
+// the consumer thread changes the queue size and resets the queue (dropping
+// queued frames) during the transfer.
+static void test_transfer(struct test_ctx *ctx, int queue_size, bool mutate)
+{
+    struct mp_async_queue *queue = mp_async_queue_create();
+    mp_async_queue_set_config(queue, (struct mp_async_queue_config){
+        .max_bytes = INT64_MAX,
+        .max_samples = queue_size,
+    });
+
+    struct test_graph prod;
+    test_graph_init(&prod, ctx->global);
+    struct source_state src_state = {0};
+    struct mp_filter *src = test_source_create(prod.root, next_frame, &src_state);
+    struct mp_filter *q_in =
+        mp_async_queue_create_filter(prod.root, MP_PIN_IN, queue);
+    mp_pin_connect(q_in->pins[0], src->pins[0]);
+
+    struct test_graph cons;
+    test_graph_init(&cons, ctx->global);
+    struct mp_filter *q_out =
+        mp_async_queue_create_filter(cons.root, MP_PIN_OUT, queue);
+    struct sink_state sink_state = {.last_pts = -1, .in_order = true};
+    struct test_sink *sink = test_sink_create(cons.root);
+    sink->on_frame = on_frame;
+    sink->ctx = &sink_state;
+    mp_pin_connect(sink->f->pins[0], q_out->pins[0]);
+
+    mp_async_queue_resume_reading(queue);
+
+    pthread_t thread;
+    assert_true(pthread_create(&thread, NULL, producer_thread, &prod) == 0);
+    int last_change = 0;
+    int num_changes = 0;
+    int num_resets = 0;
+    while (test_graph_run(&cons, &sink->eof)) {
+        int num_frames = sink_state.num_frames;
+        if (!mutate || num_frames - last_change < 500)
+            continue;
+        last_change = num_frames;
+        static const int sizes[] = {1, 50, 3, 1000};
+        mp_async_queue_set_config(queue, (struct mp_async_queue_config){
+            .max_bytes = INT64_MAX,
+            .max_samples = sizes[num_changes % MP_ARRAY_SIZE(sizes)],
+        });
+        // Not near the end, where the reset could drop the EOF frame.
+        if (num_frames < NUM_FRAMES / 2 && num_changes % 4 == 1) {
+            mp_async_queue_reset(queue);
+            mp_filter_reset(cons.root);
+            mp_filter_wakeup(sink->f); // to request frames again
+            test_graph_reset(&prod);
+            mp_async_queue_resume_reading(queue);
+            num_resets++;
+        }
+        num_changes++;
+    }
+
+    test_graph_quit(&prod);
+    pthread_join(thread, NULL);
+
+    assert_true(sink_state.in_order);
+    assert_float_equal(sink_state.last_pts, NUM_FRAMES - 1, 0);
+    if (mutate) {
+        assert_true(num_resets > 0);
+        assert_true(sink_state.num_frames <= NUM_FRAMES);
+    } else {
+        assert_int_equal(sink_state.num_frames, NUM_FRAMES);
+    }
+    assert_int_equal(mp_async_queue_get_frames(queue), 0);
+    assert_int_equal(mp_async_queue_get_samples(queue), 0);
+
+    test_graph_uninit(&cons);
+    test_graph_uninit(&prod);
+    talloc_free(queue);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    test_transfer(ctx, 1, false);
+    test_transfer(ctx, 3, false);
+    test_transfer(ctx, 1000, false);
+    test_transfer(ctx, 3, true);
+}
+
+const struct unittest test_async_queue = {
+    .name = "async-queue",
+    .run = run,
+};
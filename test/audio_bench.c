@@ -0,0 +1,267 @@
+#include <math.h>
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/f_swresample.h"
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "misc/bstr.h"
+#include "misc/thread_tools.h"
+#include "osdep/timer.h"
+#include "test_filters.h"
+
+// Synthetic input, used if no file is given.
+#define RATE 44100
+#define CHANNELS 2
+#define SECONDS 30
+#define FRAME_SIZE 1024
+
+#define STATS_PREFIX "bench"
+
+struct stage {
+    const char *name;       // user filter (--af) name, or "swresample"
+    char **args;            // key/value pairs for user filters
+    double speed;           // if set, sent as MP_FILTER_COMMAND_SET_SPEED
+};
+
+struct scenario {
+    const char *name;
+    struct stage stages[5];
+};
+
+static const struct scenario scenarios[] = {
+    {"passthrough"},
+    {"swresample 48k", {{"swresample"}}},
+    {"scaletempo 1.25x", {{"scaletempo", .speed = 1.25}}},
+    {"scaletempo2 1.25x", {{"scaletempo2", .speed = 1.25}}},
+    {"format s16", {{"format", (char *[]){"format", "s16", NULL}}}},
+    {"lavfi", {{"lavfi", (char *[]){"graph", "volume=0.5,highpass=f=80", NULL}}}},
+    {"all", {
+        {"swresample"},
+        {"scaletempo2", .speed = 1.25},
+        {"lavfi", (char *[]){"graph", "volume=0.5,highpass=f=80", NULL}},
+        {"format", (char *[]){"format", "s16", NULL}},
+    }},
+};
+
+struct signal_source {
+    struct mp_aframe *data;     // whole signal
+    int pos;
+};
+
+// Outputs slices of the pre-generated signal, like a decoder would.
+static struct mp_frame next_frame(void *ctx)
+{
+    struct signal_source *p = ctx;
+
+    int size = mp_aframe_get_size(p->data);
+    if (p->pos >= size)
+        return MP_NO_FRAME;
+
+    struct mp_aframe *frame = mp_aframe_new_ref(p->data);
+    MP_HANDLE_OOM(frame);
+    mp_aframe_skip_samples(frame, p->pos);
+    mp_aframe_set_size(frame, MPMIN(FRAME_SIZE, size - p->pos));
+    p->pos += mp_aframe_get_size(frame);
+    return MAKE_FRAME(MP_FRAME_AUDIO, frame);
+}
+
+struct output_stats {
+    int64_t samples;
+    double duration;
+};
+
+static void on_frame(void *ctx, struct mp_frame frame)
+{
+    struct output_stats *p = ctx;
+    if (frame.type != MP_FRAME_AUDIO)
+        return;
+    struct mp_aframe *af = frame.data;
+    p->samples += mp_aframe_get_size(af);
+    p->duration += mp_aframe_duration(af);
+}
+
+static struct mp_aframe *gen_signal(void)
+{
+    struct mp_aframe *frame = mp_aframe_create();
+    struct mp_chmap chmap;
+    mp_chmap_from_channels(&chmap, CHANNELS);
+    mp_aframe_set_format(frame, AF_FORMAT_FLOATP);
+    mp_aframe_set_chmap(frame, &chmap);
+    mp_aframe_set_rate(frame, RATE);
+    mp_aframe_set_pts(frame, 0);
+    if (!mp_aframe_alloc_data(frame, RATE * SECONDS))
+        abort();
+
+    uint8_t **planes = mp_aframe_get_data_rw(frame);
+    uint32_t seed = 1;
+    for (int c = 0; c < CHANNELS; c++) {
+        float *d = (float *)planes[c];
+        for (int n = 0; n < RATE * SECONDS; n++) {
+            double t = n / (double)RATE;
+            seed = seed * 1664525 + 1013904223;
+            d[n] = 0.4 * sin(2 * M_PI * (110 + 55 * c) * t)
+                 + 0.3 * sin(2 * M_PI * 440 * t * (1 + 0.1 * sin(t)))
+                 + 0.1 * ((seed >> 8) / (double)(1 << 24) - 0.5);
+        }
+    }
+    return frame;
+}
+
+static struct mp_filter *create_stage(struct mp_filter *root,
+                                      const struct stage *st)
+{
+    struct mp_filter *f;
+    if (strcmp(st->name, "swresample") == 0) {
+        struct mp_swresample *s = mp_swresample_create(root, NULL);
+        if (!s)
+            abort();
+        s->out_rate = 48000;
+        f = s->f;
+    } else {
+        f = mp_create_user_filter(root, MP_OUTPUT_CHAIN_AUDIO, st->name,
+                                  st->args);
+        if (!f)
+            abort();
+    }
+    if (st->speed) {
+        struct mp_filter_command cmd = {
+            .type = MP_FILTER_COMMAND_SET_SPEED,
+            .speed = st->speed,
+        };
+        mp_filter_command(f, &cmd);
+    }
+    return f;
+}
+
+static void run_scenario(struct test_ctx *ctx, const struct scenario *sc,
+                         struct mp_aframe *signal, const char *file)
+{
+    void *tmp = talloc_new(NULL);
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    mp_filter_graph_set_stats(root, STATS_PREFIX);
+
+    struct demuxer *demuxer = NULL;
+    struct mp_decoder_wrapper *dec = NULL;
+    struct mp_pin *src;
+    if (file) {
+        struct mp_cancel *cancel = mp_cancel_new(tmp);
+        struct demuxer_params params = {0};
+        demuxer = demux_open_url(file, &params, cancel, ctx->global);
+        if (!demuxer) {
+            MP_FATAL(ctx, "Could not open '%s'.\n", file);
+            abort();
+        }
+        struct sh_stream *sh = NULL;
+        for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+            struct sh_stream *s = demux_get_stream(demuxer, n);
+            if (s->type == STREAM_AUDIO && !sh)
+                sh = s;
+        }
+        if (!sh) {
+            MP_FATAL(ctx, "No audio stream in '%s'.\n", file);
+            abort();
+        }
+        demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+        dec = mp_decoder_wrapper_create(root, sh);
+        if (!dec || !mp_decoder_wrapper_reinit(dec))
+            abort();
+        src = dec->f->pins[0];
+    } else {
+        struct signal_source *p = talloc_zero(tmp, struct signal_source);
+        p->data = signal;
+        src = test_source_create(root, next_frame, p)->pins[0];
+    }
+
+    for (int n = 0; n < MP_ARRAY_SIZE(sc->stages) && sc->stages[n].name; n++) {
+        struct mp_filter *f = create_stage(root, &sc->stages[n]);
+        mp_pin_connect(f->pins[0], src);
+        src = f->pins[1];
+    }
+
+    struct output_stats out = {0};
+    struct test_sink *sink = test_sink_create(root);
+    sink->on_frame = on_frame;
+    sink->ctx = &out;
+    mp_pin_connect(sink->f->pins[0], src);
+
+    struct test_stats stats = {.ta_ctx = tmp};
+    test_stats_collect(ctx, &stats); // activate and clear
+    test_stats_clear(&stats);
+
+    int64_t allocs = ta_get_alloc_count();
+    int64_t start = mp_time_us();
+    int64_t last_poll = start;
+    int idle = 0;
+
+    mp_filter_graph_set_max_run_time(root, 0.1);
+    while (!sink->eof) {
+        int64_t prev = out.samples;
+        mp_filter_graph_run(root);
+        idle = out.samples == prev ? idle + 1 : 0;
+        if (idle > 1000) {
+            MP_FATAL(ctx, "Filter graph stalled.\n");
+            mp_filter_dump_states(root);
+            abort();
+        }
+        if (mp_time_us() - last_poll > 500 * 1000) {
+            test_stats_collect(ctx, &stats);
+            last_poll = mp_time_us();
+        }
+    }
+
+    double secs = (mp_time_us() - start) / 1e6;
+    allocs = allocs < 0 ? -1 : ta_get_alloc_count() - allocs;
+    test_stats_collect(ctx, &stats);
+
+    MP_INFO(ctx, "%-20s %8.1fx realtime, %10.0f samples/s, %s allocs/s of audio\n",
+            sc->name, out.duration / secs, out.samples / secs,
+            allocs < 0 ? "n/a" :
+                mp_tprintf(30, "%.0f", allocs / MPMAX(out.duration, 1e-9)));
+    for (int n = 0; n < stats.num_entries; n++) {
+        struct test_stat *st = &stats.entries[n];
+        bstr name = bstr0(st->name);
+        if (st->value > 0 && bstr_eatstart0(&name, STATS_PREFIX "/") &&
+            bstr_eatend0(&name, "/cpu"))
+        {
+            MP_INFO(ctx, "    %-24.*s %8.2f ms cpu\n", BSTR_P(name), st->value);
+        }
+    }
+
+    talloc_free(root);
+    if (demuxer)
+        demux_free(demuxer);
+    talloc_free(tmp);
+}
+
+// Run each scenario untimed (as fast as possible). The input is the first file
+// given on the command line, or a synthetic signal if there is none.
+static void run(struct test_ctx *ctx)
+{
+    ta_enable_alloc_count();
+
+    struct mp_aframe *signal = NULL;
+    if (!ctx->input_file)
+        signal = gen_signal();
+
+    MP_INFO(ctx, "Input: %s\n", ctx->input_file ? ctx->input_file :
+            mp_tprintf(80, "%d Hz, %d channels, %d seconds (synthetic)",
+                       RATE, CHANNELS, SECONDS));
+
+    for (int n = 0; n < MP_ARRAY_SIZE(scenarios); n++)
+        run_scenario(ctx, &scenarios[n], signal, ctx->input_file);
+
+    talloc_free(signal);
+}
+
+const struct unittest test_audio_chain_bench = {
+    .name = "audio-chain-bench",
+    // Benchmark only, not run by all-simple.
+    .is_complex = true,
+    .run = run,
+};
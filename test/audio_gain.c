@@ -0,0 +1,125 @@
+#include "audio/format.h"
+#include "audio/out/internal.h"
+#include "osdep/endian.h"
+#include "tests.h"
+
+#define MAX_SAMPLES 1200
+
+static const int formats[] = {
+    AF_FORMAT_U8, AF_FORMAT_S16, AF_FORMAT_S32, AF_FORMAT_FLOAT,
+    AF_FORMAT_DOUBLE,
+};
+
+// Random samples, with some full scale and out of range values mixed in.
+static void gen_samples(int fmt, void *data, int num_samples, uint32_t *seed)
+{
+    for (int n = 0; n < num_samples; n++) {
+        *seed = *seed * 1664525 + 1013904223;
+        uint32_t r = *seed;
+        bool extreme = (r & 0xF) == 0;
+        switch (fmt) {
+        case AF_FORMAT_U8:
+            ((uint8_t *)data)[n] = extreme ? (r & 0x10 ? 255 : 0) : r >> 24;
+            break;
+        case AF_FORMAT_S16:
+            ((int16_t *)data)[n] =
+                extreme ? (r & 0x10 ? INT16_MAX : INT16_MIN) : (int16_t)(r >> 16);
+            break;
+        case AF_FORMAT_S32:
+            ((int32_t *)data)[n] =
+                extreme ? (r & 0x10 ? INT32_MAX : INT32_MIN) : (int32_t)r;
+            break;
+        case AF_FORMAT_FLOAT:
+            ((float *)data)[n] = ((int32_t)r / (double)INT32_MAX) *
+                                 (extreme ? 1.5 : 1.0);
+            break;
+        case AF_FORMAT_DOUBLE:
+            ((double *)data)[n] = ((int32_t)r / (double)INT32_MAX) *
+                                  (extreme ? 1.5 : 1.0);
+            break;
+        }
+    }
+}
+
+static void check(int fmt, int pack, int frames, int channels, float gain,
+                  float step, uint32_t *seed)
+{
+    int num_samples = frames * channels;
+    int bytes = af_fmt_to_bytes(fmt);
+    int out_bytes = pack ? (pack == 1 ? 3 : 4) : bytes;
+
+    uint8_t src[MAX_SAMPLES * 8];
+    uint8_t ref[MAX_SAMPLES * 8];
+    uint8_t out[MAX_SAMPLES * 8];
+    gen_samples(fmt, src, num_samples, seed);
+    memset(ref, 0xAB, sizeof(ref));
+    memset(out, 0xAB, sizeof(out));
+
+    ao_gain_apply_ref(fmt, pack, ref, src, frames, channels, gain, step);
+    ao_gain_apply(fmt, pack, out, src, frames, channels, gain, step);
+    // Also checks that nothing is written past the end.
+    assert_memcmp(ref, out, sizeof(ref));
+
+    if (!pack) {
+        ao_gain_apply(fmt, pack, src, src, frames, channels, gain, step);
+        assert_memcmp(ref, src, num_samples * out_bytes);
+    }
+}
+
+static void run(struct test_ctx *ctx)
+{
+    static const float gains[] = {0, 0.25, 0.5, 0.999, 1.0, 1.001, 1.7, 40, 500};
+    static const int channel_counts[] = {1, 2, 6};
+    static const int frame_counts[] = {1, 3, 7, 8, 9, 31, 200};
+    uint32_t seed = 1;
+
+    for (int f = 0; f < MP_ARRAY_SIZE(formats); f++) {
+        int fmt = formats[f];
+        for (int pack = 0; pack <= (fmt == AF_FORMAT_S32 ? 2 : 0); pack++) {
+            for (int c = 0; c < MP_ARRAY_SIZE(channel_counts); c++) {
+                int channels = channel_counts[c];
+                for (int n = 0; n < MP_ARRAY_SIZE(frame_counts); n++) {
+                    int frames = frame_counts[n];
+                    for (int g = 0; g < MP_ARRAY_SIZE(gains); g++) {
+                        check(fmt, pack, frames, channels, gains[g], 0, &seed);
+                        // Ramp from gains[g] up or down.
+                        check(fmt, pack, frames, channels, gains[g],
+                              0.5 / frames, &seed);
+                        check(fmt, pack, frames, channels, gains[g],
+                              -gains[g] / frames, &seed);
+                    }
+                }
+            }
+        }
+    }
+
+    // Sanity check the reference itself.
+    int16_t s16[4] = {1000, -1000, INT16_MAX, INT16_MIN};
+    ao_gain_apply_ref(AF_FORMAT_S16, 0, s16, s16, 2, 2, 2.0, 0);
+    assert_int_equal(s16[0], 2000);
+    assert_int_equal(s16[1], -2000);
+    assert_int_equal(s16[2], INT16_MAX);
+    assert_int_equal(s16[3], INT16_MIN);
+
+    float f[3] = {0.5, -0.5, 0.5};
+    ao_gain_apply_ref(AF_FORMAT_FLOAT, 0, f, f, 3, 1, 1.0, 0.5);
+    assert_float_equal(f[0], 0.5, 0);
+    assert_float_equal(f[1], -0.75, 0);
+    assert_float_equal(f[2], 1.0, 0);
+
+    int32_t s32 = 0x12345678;
+    uint8_t packed[4];
+    ao_gain_apply_ref(AF_FORMAT_S32, 2, packed, &s32, 1, 1, 1.0, 0);
+    uint32_t word;
+    memcpy(&word, packed, 4);
+#if BYTE_ORDER == BIG_ENDIAN
+    assert_int_equal(word, 0x12345600);
+#else
+    assert_int_equal(word, 0x00123456);
+#endif
+}
+
+const struct unittest test_audio_gain = {
+    .name = "audio-gain",
+    .run = run,
+};
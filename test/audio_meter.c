@@ -0,0 +1,134 @@
+#include <math.h>
+
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "filters/f_audio_meter.h"
+#include "filters/filter.h"
+#include "tests.h"
+
+#define RATE 48000
+
+struct tone {
+    double freq, amp, phase;
+};
+
+// Feed secs of audio in frames of frame_len samples. Channel c gets tones[c].
+static void feed(struct mp_audio_meter *m, int format, const char *layout,
+                 const struct tone *tones, double secs, int frame_len)
+{
+    struct mp_chmap chmap;
+    if (!mp_chmap_from_str(&chmap, bstr0(layout)))
+        abort();
+
+    int total = lrint(secs * RATE);
+    for (int pos = 0; pos < total; pos += frame_len) {
+        int len = MPMIN(frame_len, total - pos);
+        struct mp_aframe *frame = mp_aframe_create();
+        mp_aframe_set_format(frame, format);
+        mp_aframe_set_chmap(frame, &chmap);
+        mp_aframe_set_rate(frame, RATE);
+        if (!mp_aframe_alloc_data(frame, len))
+            abort();
+        mp_aframe_set_pts(frame, pos / (double)RATE);
+
+        uint8_t **planes = mp_aframe_get_data_rw(frame);
+        bool planar = af_fmt_is_planar(format);
+        for (int c = 0; c < chmap.num; c++) {
+            for (int n = 0; n < len; n++) {
+                double t = (pos + n) / (double)RATE;
+                double v = tones[c].amp *
+                           sin(2 * M_PI * tones[c].freq * t + tones[c].phase);
+                int i = planar ? n : n * chmap.num + c;
+                void *dst = planes[planar ? c : 0];
+                switch (af_fmt_from_planar(format)) {
+                case AF_FORMAT_S16:
+                    ((int16_t *)dst)[i] = MPCLAMP(lrint(v * 32768), -32768, 32767);
+                    break;
+                case AF_FORMAT_FLOAT:
+                    ((float *)dst)[i] = v;
+                    break;
+                default:
+                    abort();
+                }
+            }
+        }
+
+        mp_audio_meter_feed(m, frame);
+        talloc_free(frame);
+    }
+}
+
+static struct mp_audio_meter_values get(struct mp_audio_meter *m)
+{
+    struct mp_audio_meter_values v;
+    assert_int_equal(m->updated, 1);
+    assert_int_equal(mp_audio_meter_get_values(m, &v), 1);
+    m->updated = false;
+    return v;
+}
+
+static void run(struct test_ctx *ctx)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+    struct mp_audio_meter *m = mp_audio_meter_create(root);
+    struct mp_audio_meter_values v;
+
+    // Disabled by default.
+    feed(m, AF_FORMAT_FLOAT, "mono", &(struct tone){997, 1.0}, 0.5, 4800);
+    assert_int_equal(m->updated, 0);
+    assert_int_equal(mp_audio_meter_get_values(m, &v), 0);
+
+    // BS.1770: a 0 dBFS 997 Hz sine in one front channel reads -3.01 LUFS.
+    mp_audio_meter_set_rate(m, 10);
+    feed(m, AF_FORMAT_FLOAT, "mono", &(struct tone){997, 1.0}, 3.0, 4800);
+    v = get(m);
+    assert_int_equal(v.chmap.num, 1);
+    assert_float_equal(v.peak[0], 0, 0.01);
+    assert_float_equal(v.rms[0], -3.01, 0.02);
+    assert_float_equal(v.true_peak[0], 0, 0.05);
+    assert_float_equal(v.momentary, -3.01, 0.05);
+    assert_float_equal(v.short_term, -3.01, 0.05);
+    assert_float_equal(v.pts, 3.0, 1e-9);
+
+    // Frame boundaries don't matter: odd frame sizes, interleaved s16, and
+    // a quieter second channel.
+    mp_filter_reset(m->f);
+    static const struct tone stereo[] = {{1000, 1.0}, {440, 0.5}};
+    feed(m, AF_FORMAT_S16, "stereo", stereo, 1.0, 333);
+    v = get(m);
+    assert_int_equal(v.chmap.num, 2);
+    assert_float_equal(v.peak[0], 0, 0.01);
+    assert_float_equal(v.peak[1], -6.02, 0.01);
+    assert_float_equal(v.rms[0], -3.01, 0.02);
+    assert_float_equal(v.rms[1], -9.03, 0.02);
+
+    // fs/4 sine hitting the samples at 45 degrees: the sample peak is 3dB
+    // below the true peak.
+    mp_filter_reset(m->f);
+    feed(m, AF_FORMAT_FLOATP, "mono",
+         &(struct tone){RATE / 4, 1.0, M_PI / 4}, 0.5, 1000);
+    v = get(m);
+    assert_float_equal(v.peak[0], -3.01, 0.01);
+    assert_float_equal(v.true_peak[0], 0, 0.1);
+
+    // LFE doesn't contribute to loudness; silence reads as the floor.
+    static const struct tone lfe_only[] = {{0}, {0}, {0}, {50, 1.0}, {0}, {0}};
+    feed(m, AF_FORMAT_FLOATP, "5.1", lfe_only, 0.5, 1024);
+    v = get(m);
+    assert_int_equal(v.chmap.num, 6);
+    assert_float_equal(v.peak[0], MP_AUDIO_METER_FLOOR, 0);
+    assert_float_equal(v.peak[3], 0, 0.01);
+    assert_float_equal(v.momentary, MP_AUDIO_METER_FLOOR, 0);
+
+    // Disabling drops the old values.
+    mp_audio_meter_set_rate(m, 0);
+    assert_int_equal(mp_audio_meter_get_values(m, &v), 0);
+
+    talloc_free(root);
+}
+
+const struct unittest test_audio_meter = {
+    .name = "audio-meter",
+    .run = run,
+};
@@ -0,0 +1,137 @@
+#include "audio/aframe.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "filters/filter.h"
+#include "filters/user_filters.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "test_filters.h"
+
+struct frame_list {
+    struct mp_frame *frames;
+    int num_frames;
+    int pos;
+};
+
+static struct mp_frame next_frame(void *ctx)
+{
+    struct frame_list *l = ctx;
+    return l->pos < l->num_frames ? l->frames[l->pos++] : MP_NO_FRAME;
+}
+
+// Run frames (ownership is transferred) through the given user filter, and
+// return the sink, which has all output frames.
+static struct test_sink *run_filter(struct mp_filter *root,
+                                    enum mp_output_chain_type type,
+                                    char **args,
+                                    struct mp_frame *frames, int num_frames)
+{
+    struct frame_list *l = talloc_ptrtype(root, l);
+    *l = (struct frame_list){frames, num_frames};
+    struct mp_filter *src = test_source_create(root, next_frame, l);
+
+    struct mp_filter *f = mp_create_user_filter(root, type, "lavfi", args);
+    assert_true(f);
+    mp_pin_connect(f->pins[0], src->pins[0]);
+
+    struct test_sink *sink = test_sink_create(root);
+    mp_pin_connect(sink->f->pins[0], f->pins[1]);
+
+    for (int n = 0; n < 1000 && !sink->eof; n++)
+        mp_filter_graph_run(root);
+    assert_true(sink->eof);
+
+    return sink;
+}
+
+static struct mp_image *new_image(int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(IMGFMT_420P, w, h);
+    assert_true(img);
+    mp_image_clear(img, 0, 0, w, h);
+    return img;
+}
+
+// Frames must be passed through a graph that doesn't touch the data by
+// reference, without copying the data. The size change on the third frame
+// recreates the graph, unless in_place is set. This is visible in the output
+// timestamps, which setpts replaces with the frame count of the graph.
+static void test_video(struct test_ctx *ctx, bool in_place)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+
+    struct mp_image *in[3] = {new_image(64, 48), new_image(64, 48),
+                              new_image(128, 96)};
+    struct mp_frame frames[3];
+    for (int n = 0; n < 3; n++) {
+        in[n]->pts = 10 + n;
+        frames[n] = MAKE_FRAME(MP_FRAME_VIDEO, mp_image_new_ref(in[n]));
+    }
+
+    char *args[] = {"graph", "setpts=N/TB",
+                    "reconfig", in_place ? "in-place" : "rebuild", NULL};
+    struct test_sink *p =
+        run_filter(root, MP_OUTPUT_CHAIN_VIDEO, args, frames, 3);
+
+    const double out_pts[2][3] = {{0, 1, 0}, {0, 1, 2}};
+    assert_int_equal(p->num_frames, 3);
+    for (int n = 0; n < 3; n++) {
+        struct mp_image *out = p->frames[n].data;
+        assert_int_equal(p->frames[n].type, MP_FRAME_VIDEO);
+        assert_int_equal(out->w, in[n]->w);
+        assert_int_equal(out->h, in[n]->h);
+        assert_float_equal(out->pts, out_pts[in_place][n], 1e-6);
+        for (int i = 0; i < in[n]->num_planes; i++)
+            assert_true(out->planes[i] == in[n]->planes[i]);
+        talloc_free(in[n]);
+    }
+
+    talloc_free(root);
+}
+
+static void test_audio(struct test_ctx *ctx)
+{
+    struct mp_filter *root = mp_filter_create_root(ctx->global);
+
+    struct mp_aframe *in[2];
+    struct mp_frame frames[2];
+    for (int n = 0; n < 2; n++) {
+        in[n] = mp_aframe_create();
+        mp_aframe_set_format(in[n], AF_FORMAT_FLOATP);
+        mp_aframe_set_chmap(in[n], &(struct mp_chmap)MP_CHMAP_INIT_STEREO);
+        mp_aframe_set_rate(in[n], 48000);
+        mp_aframe_set_pts(in[n], n * 1024 / 48000.0);
+        assert_true(mp_aframe_alloc_data(in[n], 1024));
+        frames[n] = MAKE_FRAME(MP_FRAME_AUDIO, mp_aframe_new_ref(in[n]));
+    }
+
+    char *args[] = {"graph", "anull", NULL};
+    struct test_sink *p =
+        run_filter(root, MP_OUTPUT_CHAIN_AUDIO, args, frames, 2);
+
+    assert_int_equal(p->num_frames, 2);
+    for (int n = 0; n < 2; n++) {
+        struct mp_aframe *out = p->frames[n].data;
+        assert_int_equal(p->frames[n].type, MP_FRAME_AUDIO);
+        assert_int_equal(mp_aframe_get_size(out), 1024);
+        uint8_t **a = mp_aframe_get_data_ro(out);
+        uint8_t **b = mp_aframe_get_data_ro(in[n]);
+        for (int i = 0; i < mp_aframe_get_planes(out); i++)
+            assert_true(a[i] == b[i]);
+        talloc_free(in[n]);
+    }
+
+    talloc_free(root);
+}
+
+static void run(struct test_ctx *ctx)
+{
+    test_video(ctx, false);
+    test_video(ctx, true);
+    test_audio(ctx);
+}
+
+const struct unittest test_lavfi = {
+    .name = "lavfi",
+    .run = run,
+};
@@ -0,0 +1,165 @@
+#include "audio/chmap.h"
+#include "audio/filter/af_scaletempo2_internals.h"
+#include "common/msg.h"
+#include "osdep/timer.h"
+#include "tests.h"
+
+#define RATE 48000
+#define IN_FRAMES (RATE * 2)
+#define OUT_FRAMES (RATE / 2)
+#define MAX_CHANNELS 16
+
+// A few partials per channel plus some noise, so that the overlap search has
+// distinct but non-trivial maxima.
+static void gen_signal(float **planes, int channels)
+{
+    uint32_t seed = 1;
+    for (int c = 0; c < channels; c++) {
+        for (int n = 0; n < IN_FRAMES; n++) {
+            double t = n / (double)RATE;
+            seed = seed * 1664525 + 1013904223;
+            planes[c][n] = 0.4 * sin(2 * M_PI * (110 + 30 * c) * t)
+                         + 0.3 * sin(2 * M_PI * (440 + 7 * c) * t * (1 + t))
+                         + 0.1 * ((seed >> 8) / (double)(1 << 24) - 0.5);
+        }
+    }
+}
+
+static int stretch(struct mp_scaletempo2_opts *opts, int channels, float speed,
+                   float **in, float **out)
+{
+    struct mp_scaletempo2 st = { .opts = opts };
+    mp_scaletempo2_init(&st, channels, RATE);
+    if (opts->fft_search >= 0)
+        assert_int_equal(st.use_fft_search, opts->fft_search);
+
+    int pos = 0, rendered = 0;
+    while (rendered < OUT_FRAMES) {
+        uint8_t *planes[MP_NUM_CHANNELS];
+        float *dst[MP_NUM_CHANNELS];
+        for (int c = 0; c < channels; c++) {
+            planes[c] = (uint8_t *)(in[c] + pos);
+            dst[c] = out[c] + rendered;
+        }
+        int read = mp_scaletempo2_fill_input_buffer(&st, planes,
+                                                    IN_FRAMES - pos, false);
+        pos += read;
+        int got = mp_scaletempo2_fill_buffer(&st, dst,
+            MPMIN(OUT_FRAMES - rendered, 1024), speed);
+        rendered += got;
+        if (!read && !got)
+            break;
+    }
+
+    mp_scaletempo2_destroy(&st);
+    return rendered;
+}
+
+struct buffers {
+    float *in[MAX_CHANNELS];
+    float *ref[MAX_CHANNELS];
+    float *out[MAX_CHANNELS];
+};
+
+static struct buffers *alloc_buffers(void)
+{
+    struct buffers *b = talloc_zero(NULL, struct buffers);
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        b->in[c] = talloc_array(b, float, IN_FRAMES);
+        b->ref[c] = talloc_zero_array(b, float, OUT_FRAMES);
+        b->out[c] = talloc_zero_array(b, float, OUT_FRAMES);
+    }
+    gen_signal(b->in, MAX_CHANNELS);
+    return b;
+}
+
+// The threads compute the same values per channel, so they must not change
+// the output. The FFT search computes the same dot products with different
+// rounding, so it could pick a different block if two candidates are nearly
+// tied. This doesn't happen with this signal, so the output is checked bit for
+// bit as a regression check, not as a proof that both searches are equivalent.
+static void run(struct test_ctx *ctx)
+{
+    static const int channel_counts[] = {1, 2, 5, 8};
+    static const float speeds[] = {0.6, 1.5, 2.5};
+    static const struct { int fft_search, threads; } variants[] = {
+        {0, 3}, {1, 1}, {1, 3},
+    };
+
+    struct buffers *b = alloc_buffers();
+
+    for (int i = 0; i < MP_ARRAY_SIZE(channel_counts); i++) {
+        int channels = channel_counts[i];
+        for (int s = 0; s < MP_ARRAY_SIZE(speeds); s++) {
+            struct mp_scaletempo2_opts opts = {
+                .min_playback_rate = 0.25,
+                .max_playback_rate = 4.0,
+                .ola_window_size_ms = 20,
+                .wsola_search_interval_ms = 60,
+                .fft_search = 0,
+                .threads = 1,
+            };
+
+            int n_ref = stretch(&opts, channels, speeds[s], b->in, b->ref);
+            assert_int_equal(n_ref, OUT_FRAMES);
+
+            for (int v = 0; v < MP_ARRAY_SIZE(variants); v++) {
+                opts.fft_search = variants[v].fft_search;
+                opts.threads = variants[v].threads;
+                int n = stretch(&opts, channels, speeds[s], b->in, b->out);
+                assert_int_equal(n, n_ref);
+                for (int c = 0; c < channels; c++)
+                    assert_memcmp(b->ref[c], b->out[c], n * sizeof(float));
+            }
+        }
+    }
+
+    talloc_free(b);
+}
+
+// Throughput with default settings, single-threaded vs. automatic slicing.
+static void run_bench(struct test_ctx *ctx)
+{
+    static const int channel_counts[] = {2, 6, 8, 16};
+    const float speed = 1.5;
+    const int iterations = 20;
+
+    struct buffers *b = alloc_buffers();
+
+    for (int i = 0; i < MP_ARRAY_SIZE(channel_counts); i++) {
+        int channels = channel_counts[i];
+        for (int threads = 1; threads >= 0; threads--) {
+            struct mp_scaletempo2_opts opts = {
+                .min_playback_rate = 0.25,
+                .max_playback_rate = 4.0,
+                .ola_window_size_ms = 20,
+                .wsola_search_interval_ms = 30,
+                .fft_search = -1,
+                .threads = threads,
+            };
+
+            int64_t start = mp_time_us();
+            for (int n = 0; n < iterations; n++)
+                stretch(&opts, channels, speed, b->in, b->out);
+            double secs = (mp_time_us() - start) / 1e6;
+
+            double audio_secs = iterations * OUT_FRAMES / (double)RATE;
+            MP_INFO(ctx, "%2d channels, threads=%s: %7.1fx realtime\n",
+                    channels, threads ? "1   " : "auto", audio_secs / secs);
+        }
+    }
+
+    talloc_free(b);
+}
+
+const struct unittest test_scaletempo2 = {
+    .name = "scaletempo2",
+    .run = run,
+};
+
+const struct unittest test_scaletempo2_bench = {
+    .name = "scaletempo2-bench",
+    // Benchmark only, not run by all-simple.
+    .is_complex = true,
+    .run = run_bench,
+};
@@ -0,0 +1,204 @@
+#include "common/common.h"
+#include "common/stats.h"
+#include "filters/filter_internal.h"
+#include "misc/bstr.h"
+#include "misc/node.h"
+#include "test_filters.h"
+
+static void wakeup_cb(void *ctx)
+{
+    struct test_graph *g = ctx;
+    pthread_mutex_lock(&g->lock);
+    g->woken = true;
+    pthread_cond_broadcast(&g->wakeup);
+    pthread_mutex_unlock(&g->lock);
+}
+
+void test_graph_init(struct test_graph *g, struct mpv_global *global)
+{
+    *g = (struct test_graph){.root = mp_filter_create_root(global)};
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->wakeup, NULL);
+    mp_filter_graph_set_wakeup_cb(g->root, wakeup_cb, g);
+}
+
+void test_graph_uninit(struct test_graph *g)
+{
+    TA_FREEP(&g->root);
+    pthread_cond_destroy(&g->wakeup);
+    pthread_mutex_destroy(&g->lock);
+}
+
+bool test_graph_run(struct test_graph *g, bool *done)
+{
+    mp_filter_graph_run(g->root);
+    if (done && *done)
+        return false;
+    pthread_mutex_lock(&g->lock);
+    while (!g->woken && !g->quit && !g->reset)
+        pthread_cond_wait(&g->wakeup, &g->lock);
+    g->woken = false;
+    if (g->reset) {
+        mp_filter_reset(g->root);
+        g->reset = false;
+        pthread_cond_broadcast(&g->wakeup);
+    }
+    bool res = !g->quit;
+    pthread_mutex_unlock(&g->lock);
+    return res;
+}
+
+void test_graph_quit(struct test_graph *g)
+{
+    pthread_mutex_lock(&g->lock);
+    g->quit = true;
+    pthread_cond_broadcast(&g->wakeup);
+    pthread_mutex_unlock(&g->lock);
+}
+
+void test_graph_reset(struct test_graph *g)
+{
+    pthread_mutex_lock(&g->lock);
+    g->reset = true;
+    pthread_cond_broadcast(&g->wakeup);
+    while (g->reset)
+        pthread_cond_wait(&g->wakeup, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+}
+
+struct source_priv {
+    struct mp_frame (*next_frame)(void *ctx);
+    void *ctx;
+    bool eof;
+};
+
+static void source_process(struct mp_filter *f)
+{
+    struct source_priv *p = f->priv;
+
+    if (p->eof || !mp_pin_in_needs_data(f->ppins[0]))
+        return;
+
+    struct mp_frame frame = p->next_frame(p->ctx);
+    if (!frame.type) {
+        frame = MP_EOF_FRAME;
+        p->eof = true;
+    }
+    mp_pin_in_write(f->ppins[0], frame);
+}
+
+static const struct mp_filter_info source_filter = {
+    .name = "test_source",
+    .priv_size = sizeof(struct source_priv),
+    .process = source_process,
+};
+
+struct mp_filter *test_source_create(struct mp_filter *parent,
+                                     struct mp_frame (*next_frame)(void *ctx),
+                                     void *ctx)
+{
+    struct mp_filter *f = mp_filter_create(parent, &source_filter);
+    if (!f)
+        abort();
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+    struct source_priv *p = f->priv;
+    p->next_frame = next_frame;
+    p->ctx = ctx;
+    return f;
+}
+
+static void sink_process(struct mp_filter *f)
+{
+    struct test_sink *p = f->priv;
+
+    while (!p->eof) {
+        struct mp_frame frame = mp_pin_out_read(f->ppins[0]);
+        if (frame.type == MP_FRAME_EOF) {
+            p->eof = true;
+        } else if (!frame.type) {
+            break;
+        } else if (p->on_frame) {
+            p->on_frame(p->ctx, frame);
+            mp_frame_unref(&frame);
+        } else {
+            MP_TARRAY_APPEND(p, p->frames, p->num_frames, frame);
+        }
+    }
+}
+
+static void sink_destroy(struct mp_filter *f)
+{
+    test_sink_free_frames(f->priv);
+}
+
+static const struct mp_filter_info sink_filter = {
+    .name = "test_sink",
+    .priv_size = sizeof(struct test_sink),
+    .process = sink_process,
+    .destroy = sink_destroy,
+};
+
+struct test_sink *test_sink_create(struct mp_filter *parent)
+{
+    struct mp_filter *f = mp_filter_create(parent, &sink_filter);
+    if (!f)
+        abort();
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    struct test_sink *p = f->priv;
+    p->f = f;
+    return p;
+}
+
+void test_sink_free_frames(struct test_sink *sink)
+{
+    for (int n = 0; n < sink->num_frames; n++)
+        mp_frame_unref(&sink->frames[n]);
+    sink->num_frames = 0;
+}
+
+void test_stats_collect(struct test_ctx *ctx, struct test_stats *stats)
+{
+    struct mpv_node res;
+    stats_global_query(ctx->global, &res);
+
+    for (int n = 0; n < res.u.list->num; n++) {
+        struct mpv_node *e = &res.u.list->values[n];
+        struct mpv_node *name = node_map_get(e, "name");
+        struct mpv_node *val = node_map_get(e, "value");
+        if (!name || !val || name->format != MPV_FORMAT_STRING)
+            continue;
+        bstr s = bstr0(name->u.string);
+        if (!bstr_endswith0(s, "/cpu") && !bstr_endswith0(s, "/time") &&
+            !bstr_endswith0(s, "/calls") && !bstr_endswith0(s, "/thread"))
+            continue;
+
+        struct test_stat *st = NULL;
+        for (int i = 0; i < stats->num_entries; i++) {
+            if (bstr_equals0(s, stats->entries[i].name))
+                st = &stats->entries[i];
+        }
+        if (!st) {
+            MP_TARRAY_APPEND(stats->ta_ctx, stats->entries, stats->num_entries,
+                             (struct test_stat){bstrto0(stats->ta_ctx, s)});
+            st = &stats->entries[stats->num_entries - 1];
+        }
+        st->value += val->u.double_;
+    }
+
+    mpv_free_node_contents(&res);
+}
+
+void test_stats_clear(struct test_stats *stats)
+{
+    for (int n = 0; n < stats->num_entries; n++)
+        stats->entries[n].value = 0;
+}
+
+double test_stats_get(struct test_stats *stats, const char *name)
+{
+    for (int n = 0; n < stats->num_entries; n++) {
+        if (strcmp(stats->entries[n].name, name) == 0)
+            return stats->entries[n].value;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "filters/filter.h"
+#include "tests.h"
+
+// A filter graph root, driven like the player's core loop: run the graph, then
+// sleep until a filter wakes it up. The functions can be used on a separate
+// thread, except test_graph_quit() and test_graph_reset(), which are meant to
+// control such a thread.
+struct test_graph {
+    struct mp_filter *root;
+
+    // Private.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool woken;
+    bool quit;
+    bool reset;
+};
+
+void test_graph_init(struct test_graph *g, struct mpv_global *global);
+void test_graph_uninit(struct test_graph *g);
+
+// Run the graph once, then wait for a wakeup, unless the run set *done (if
+// done is not NULL). Returns false if done was set, or test_graph_quit() was
+// called.
+bool test_graph_run(struct test_graph *g, bool *done);
+
+// Make test_graph_run() return false.
+void test_graph_quit(struct test_graph *g);
+
+// Make test_graph_run() reset all filters, and wait until it's done.
+void test_graph_reset(struct test_graph *g);
+
+// Create a filter with 1 output pin, which outputs the frames returned by
+// next_frame(ctx), and then EOF once next_frame() returns MP_NO_FRAME.
+struct mp_filter *test_source_create(struct mp_filter *parent,
+                                     struct mp_frame (*next_frame)(void *ctx),
+                                     void *ctx);
+
+// A filter with 1 input pin, which reads all frames as fast as possible.
+struct test_sink {
+    struct mp_filter *f;
+
+    // To be filled in by user. If set, this is called for each frame that is
+    // not EOF, and the frame is unreferenced after it returns. Otherwise, the
+    // frames are appended to frames[].
+    void (*on_frame)(void *ctx, struct mp_frame frame);
+    void *ctx;
+
+    struct mp_frame *frames;
+    int num_frames;
+    bool eof;
+};
+
+struct test_sink *test_sink_create(struct mp_filter *parent);
+
+// Unreference and remove all frames in sink->frames[].
+void test_sink_free_frames(struct test_sink *sink);
+
+// Sums of the stats.c values that end with /cpu, /time, /calls or /thread.
+struct test_stats {
+    void *ta_ctx; // to be filled in by user
+
+    struct test_stat {
+        char *name;
+        double value;
+    } *entries;
+    int num_entries;
+};
+
+// Add the values since the last call (stats.c only reports deltas). This must
+// be called regularly, because stats.c resets itself if not polled for a
+// while. The first call also enables stats collection.
+void test_stats_collect(struct test_ctx *ctx, struct test_stats *stats);
+
+// Set all sums to 0.
+void test_stats_clear(struct test_stats *stats);
+
+// Return the sum with the given name, or 0.
+double test_stats_get(struct test_stats *stats, const char *name);
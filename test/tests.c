@@ -1,16 +1,25 @@
+#include "common/playlist.h"
 #include "options/path.h"
 #include "osdep/subprocess.h"
 #include "player/core.h"
 #include "tests.h"
 
 static const struct unittest *unittests[] = {
+    &test_async_queue,
+    &test_audio_chain_bench,
+    &test_audio_gain,
+    &test_audio_meter,
     &test_chmap,
     &test_gl_video,
     &test_img_format,
     &test_json,
+    &test_lavfi,
     &test_linked_list,
     &test_paths,
     &test_repack_sws,
+    &test_scaletempo2,
+    &test_scaletempo2_bench,
+    &test_video_decode_bench,
 #if HAVE_ZIMG
     &test_repack, // zimg only due to cross-checking with zimg.c
     &test_repack_zimg,
@@ -36,6 +45,8 @@ bool run_tests(struct MPContext *mpctx)
         .log = mpctx->log,
         .ref_path = "test/ref",
         .out_path = "test/out",
+        .input_file = mpctx->playlist->num_entries ?
+                      mpctx->playlist->entries[0]->filename : NULL,
     };
 
     if (!mp_path_isdir(ctx.ref_path)) {
@@ -19,6 +19,9 @@ struct test_ctx {
 
     // Path for result files, without trailing "/".
     const char *out_path;
+
+    // First file given on the command line, or NULL.
+    const char *input_file;
 };
 
 struct unittest {
@@ -36,15 +39,23 @@ struct unittest {
     void (*run)(struct test_ctx *ctx);
 };
 
+extern const struct unittest test_async_queue;
+extern const struct unittest test_audio_chain_bench;
+extern const struct unittest test_audio_gain;
+extern const struct unittest test_audio_meter;
 extern const struct unittest test_chmap;
 extern const struct unittest test_gl_video;
 extern const struct unittest test_img_format;
 extern const struct unittest test_json;
+extern const struct unittest test_lavfi;
 extern const struct unittest test_linked_list;
 extern const struct unittest test_repack_sws;
 extern const struct unittest test_repack_zimg;
 extern const struct unittest test_repack;
 extern const struct unittest test_paths;
+extern const struct unittest test_scaletempo2;
+extern const struct unittest test_scaletempo2_bench;
+extern const struct unittest test_video_decode_bench;
 
 #define assert_true(x) assert(x)
 #define assert_false(x) assert(!(x))
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/stats.h"
+#include "demux/demux.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/f_output_chain.h"
+#include "filters/filter.h"
+#include "misc/bstr.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "misc/thread_tools.h"
+#include "options/m_config.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "test_filters.h"
+
+// Filter graph stats prefix; per-filter times are "filter/<name>/cpu" etc.
+#define STATS_PREFIX "filter"
+
+// Names of filters that are accounted to stages other than "filters". There is
+// no demux filter: the decoder wrapper reads packets from the demuxer directly,
+// so that time is part of the decode stage.
+static const char *const decode_filters[] =
+    {"decode", "decode_wrapper", "vd_lavc", "async_queue_in", "async_queue_out",
+     NULL};
+static const char *const vo_filters[] = {"test_sink", NULL};
+
+struct frame_times {
+    void *ta_ctx;
+    int64_t *times; // wall time between frame arrivals, in us
+    int num_frames;
+    int64_t last_time;
+};
+
+// Record the frame arrival times, like vo_null in untimed mode would see them.
+static void on_frame(void *ctx, struct mp_frame frame)
+{
+    struct frame_times *p = ctx;
+    if (frame.type != MP_FRAME_VIDEO)
+        return;
+    int64_t now = mp_time_us();
+    MP_TARRAY_APPEND(p->ta_ctx, p->times, p->num_frames, now - p->last_time);
+    p->last_time = now;
+}
+
+static bool str_in_list(bstr s, const char *const *list)
+{
+    for (int n = 0; list[n]; n++) {
+        if (bstr_equals0(s, list[n]))
+            return true;
+    }
+    return false;
+}
+
+// Add "cpu_ms" and "wall_ms" of the filters in the given stage. If list is
+// NULL, add all filters not in any other stage.
+static void add_filter_stage(struct mpv_node *dst, struct test_stats *sums,
+                             const char *const *list)
+{
+    double cpu = 0, wall = 0;
+    for (int n = 0; n < sums->num_entries; n++) {
+        bstr s = bstr0(sums->entries[n].name);
+        if (!bstr_eatstart0(&s, STATS_PREFIX "/"))
+            continue;
+        bool is_cpu = bstr_eatend0(&s, "/cpu");
+        if (!is_cpu && !bstr_eatend0(&s, "/time"))
+            continue;
+        bool in_stage = list ? str_in_list(s, list) :
+            !str_in_list(s, decode_filters) && !str_in_list(s, vo_filters);
+        if (in_stage)
+            *(is_cpu ? &cpu : &wall) += sums->entries[n].value;
+    }
+    node_map_add_double(dst, "cpu_ms", cpu);
+    node_map_add_double(dst, "wall_ms", wall);
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t va = *(int64_t *)a, vb = *(int64_t *)b;
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+static double percentile_ms(int64_t *sorted, int num, double p)
+{
+    if (!num)
+        return 0;
+    int idx = MPCLAMP((int)(p / 100 * num), 0, num - 1);
+    return sorted[idx] / 1e3;
+}
+
+// Decode the video stream of the given file through the --vf chain as fast as
+// possible, and write a JSON report with throughput, per-stage time, allocation
+// and frame time statistics to test/out/video-decode-bench.json.
+// Use --vd-queue-enable=yes to decode on a separate thread.
+// There is no audio; audio decoding and filtering is covered by the
+// audio-chain-bench test.
+static void run(struct test_ctx *ctx)
+{
+    if (!ctx->input_file) {
+        MP_FATAL(ctx, "This benchmark requires an input file.\n");
+        abort();
+    }
+
+    ta_enable_alloc_count();
+
+    void *tmp = talloc_new(NULL);
+    struct MPOpts *opts = mp_get_config_group(tmp, ctx->global, &mp_opt_root);
+
+    struct test_graph g;
+    test_graph_init(&g, ctx->global);
+    struct mp_filter *root = g.root;
+    mp_filter_graph_set_stats(root, STATS_PREFIX);
+
+    struct stats_ctx *stats = stats_ctx_create(tmp, ctx->global, "bench");
+    stats_register_thread_cputime(stats, "thread");
+
+    struct mp_cancel *cancel = mp_cancel_new(tmp);
+    struct demuxer_params params = {0};
+    struct demuxer *demuxer =
+        demux_open_url(ctx->input_file, &params, cancel, ctx->global);
+    if (!demuxer) {
+        MP_FATAL(ctx, "Could not open '%s'.\n", ctx->input_file);
+        abort();
+    }
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture && !sh)
+            sh = s;
+    }
+    if (!sh) {
+        MP_FATAL(ctx, "No video stream in '%s'.\n", ctx->input_file);
+        abort();
+    }
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+    demux_start_thread(demuxer);
+
+    struct mp_decoder_wrapper *dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec))
+        abort();
+
+    struct mp_output_chain *chain =
+        mp_output_chain_create(root, MP_OUTPUT_CHAIN_VIDEO);
+    if (!mp_output_chain_update_filters(chain, opts->vf_settings)) {
+        MP_FATAL(ctx, "Could not create the --vf filters.\n");
+        abort();
+    }
+    mp_pin_connect(chain->f->pins[0], dec->f->pins[0]);
+
+    struct frame_times times = {.ta_ctx = tmp};
+    struct test_sink *sink = test_sink_create(root);
+    sink->on_frame = on_frame;
+    sink->ctx = &times;
+    mp_pin_connect(sink->f->pins[0], chain->f->pins[1]);
+
+    struct test_stats sums = {.ta_ctx = tmp};
+    test_stats_collect(ctx, &sums); // activate and clear
+    test_stats_clear(&sums);
+
+    int64_t allocs = ta_get_alloc_count();
+    int64_t start = mp_time_us();
+    int64_t last_poll = start;
+    times.last_time = start;
+
+    while (test_graph_run(&g, &sink->eof)) {
+        if (mp_time_us() - last_poll > 500 * 1000) {
+            test_stats_collect(ctx, &sums);
+            last_poll = mp_time_us();
+        }
+    }
+
+    double secs = (mp_time_us() - start) / 1e6;
+    allocs = allocs < 0 ? -1 : ta_get_alloc_count() - allocs;
+    test_stats_collect(ctx, &sums);
+
+    int num_frames = times.num_frames;
+    qsort(times.times, num_frames, sizeof(times.times[0]), cmp_int64);
+
+    struct mpv_node res;
+    node_init(&res, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_string(&res, "file", ctx->input_file);
+    node_map_add_string(&res, "codec", sh->codec->codec);
+    node_map_add_int64(&res, "frames", num_frames);
+    node_map_add_double(&res, "wall_s", secs);
+    node_map_add_double(&res, "fps", num_frames / MPMAX(secs, 1e-9));
+    if (allocs >= 0) {
+        node_map_add_int64(&res, "allocs", allocs);
+        node_map_add_double(&res, "allocs_per_frame",
+                            allocs / (double)MPMAX(num_frames, 1));
+    }
+
+    struct mpv_node *ft = node_map_add(&res, "frame_time_ms", MPV_FORMAT_NODE_MAP);
+    int64_t *t = times.times;
+    node_map_add_double(ft, "p50", percentile_ms(t, num_frames, 50));
+    node_map_add_double(ft, "p90", percentile_ms(t, num_frames, 90));
+    node_map_add_double(ft, "p99", percentile_ms(t, num_frames, 99));
+    node_map_add_double(ft, "max", num_frames ? t[num_frames - 1] / 1e3 : 0);
+
+    struct mpv_node *stages = node_map_add(&res, "stages", MPV_FORMAT_NODE_MAP);
+    struct mpv_node *st = node_map_add(stages, "demux", MPV_FORMAT_NODE_MAP);
+    node_map_add_double(st, "thread_cpu_ms",
+                        test_stats_get(&sums, "demuxer/thread"));
+    st = node_map_add(stages, "decode", MPV_FORMAT_NODE_MAP);
+    node_map_add_double(st, "thread_cpu_ms",
+                        test_stats_get(&sums, "vdec/thread"));
+    node_map_add_double(st, "lavc_cpu_ms",
+                        test_stats_get(&sums, "vd-lavc/decode/cpu"));
+    node_map_add_double(st, "lavc_wall_ms",
+                        test_stats_get(&sums, "vd-lavc/decode/time"));
+    add_filter_stage(st, &sums, decode_filters);
+    st = node_map_add(stages, "filters", MPV_FORMAT_NODE_MAP);
+    add_filter_stage(st, &sums, NULL);
+    st = node_map_add(stages, "vo", MPV_FORMAT_NODE_MAP);
+    add_filter_stage(st, &sums, vo_filters);
+    st = node_map_add(stages, "main", MPV_FORMAT_NODE_MAP);
+    node_map_add_double(st, "thread_cpu_ms",
+                        test_stats_get(&sums, "bench/thread"));
+
+    struct mpv_node *all = node_map_add(&res, "stats", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < sums.num_entries; n++)
+        node_map_add_double(all, sums.entries[n].name, sums.entries[n].value);
+
+    char *json = talloc_strdup(tmp, "");
+    json_write_pretty(&json, &res);
+    FILE *f = test_open_out(ctx, "video-decode-bench.json");
+    fprintf(f, "%s\n", json);
+    fclose(f);
+
+    MP_INFO(ctx, "%d frames in %.2f s: %.1f fps, p50/p99 frame time "
+            "%.2f/%.2f ms\n", num_frames, secs, num_frames / MPMAX(secs, 1e-9),
+            percentile_ms(t, num_frames, 50), percentile_ms(t, num_frames, 99));
+    MP_INFO(ctx, "Report written to %s/video-decode-bench.json\n",
+            ctx->out_path);
+
+    talloc_free(res.u.list);
+    stats_unregister_thread(stats, "thread");
+    test_graph_uninit(&g);
+    demux_free(demuxer);
+    talloc_free(tmp);
+}
+
+const struct unittest test_video_decode_bench = {
+    .name = "video-decode-bench",
+    // Benchmark only, requires a file; not run by all-simple.
+    .is_complex = true,
+    .run = run,
+};
@@ -35,8 +35,10 @@
 #include "mpv_talloc.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "options/options.h"
+#include "osdep/timer.h"
 #include "misc/bstr.h"
 #include "common/av_common.h"
 #include "common/codecs.h"
@@ -187,6 +189,19 @@ typedef struct lavc_ctx {
     bool intra_only;
     int framedrop_flags;
 
+    // --vd-lavc-threads value the decoder was opened with. If the option
+    // changes, the decoder is drained and reopened on the next keyframe.
+    int threads;
+    bool threads_reinit;    // draining the decoder for reopening
+    bool keyframe_drain;    // draining after a keyframe (keyframes-only mode)
+
+    struct stats_ctx *stats;
+
+    // Moving average of the time spent in libavcodec per output frame, and
+    // the time accumulated since the last output frame.
+    double decode_time;
+    double decode_time_acc;
+
     bool hw_probing;
     struct demux_packet **sent_packets;
     int num_sent_packets;
@@ -695,6 +710,8 @@ static void init_avctx(struct mp_filter *vd)
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
     }
+    ctx->threads = lavc_param->threads;
+    ctx->threads_reinit = false;
 
     if (!ctx->use_hwdec && ctx->vo && lavc_param->dr) {
         avctx->opaque = vd;
@@ -1041,6 +1058,8 @@ static void prepare_decoding(struct mp_filter *vd)
         // Can be much more aggressive for true intra codecs.
         if (ctx->intra_only)
             avctx->skip_frame = AVDISCARD_ALL;
+    } else if (drop == 3) {
+        avctx->skip_frame = AVDISCARD_NONKEY;   // scrubbing
     } else {
         avctx->skip_frame = ctx->skip_frame;    // normal playback
     }
@@ -1064,6 +1083,15 @@ static void handle_err(struct mp_filter *vd)
     }
 }
 
+// Whether the decoder should be reopened because --vd-lavc-threads changed.
+static bool need_threads_reinit(struct mp_filter *vd)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
+    m_config_cache_update(ctx->opts_cache);
+    return !ctx->use_hwdec && ctx->opts->threads != ctx->threads;
+}
+
 static int send_packet(struct mp_filter *vd, struct demux_packet *pkt)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -1083,12 +1111,39 @@ static int send_packet(struct mp_filter *vd, struct demux_packet *pkt)
     if (avctx->skip_frame == AVDISCARD_ALL)
         return 0;
 
+    // Changing the thread count requires reopening the decoder. Do it on a
+    // keyframe, so no reference frames are lost: drain the old decoder, and
+    // resend the packet to the new one once that is done.
+    if (pkt && pkt->keyframe && !ctx->hw_probing && need_threads_reinit(vd)) {
+        MP_VERBOSE(vd, "Reopening decoder to change thread count.\n");
+        struct demux_packet *copy = demux_copy_packet(pkt);
+        MP_HANDLE_OOM(copy);
+        MP_TARRAY_APPEND(ctx, ctx->requeue_packets, ctx->num_requeue_packets,
+                         copy);
+        ctx->threads_reinit = true;
+        pkt = NULL;
+    }
+
     mp_set_av_packet(ctx->avpkt, pkt, &ctx->codec_timebase);
 
+    double t = mp_time_sec();
+    stats_time_start(ctx->stats, "decode");
     int ret = avcodec_send_packet(avctx, pkt ? ctx->avpkt : NULL);
+    stats_time_end(ctx->stats, "decode");
+    ctx->decode_time_acc += mp_time_sec() - t;
     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
         return ret;
 
+    // In keyframes-only mode, there is nothing to wait for after a keyframe.
+    // Drain the decoder, so the frame is output immediately, instead of after
+    // the frame threading and reordering delay.
+    if (ret >= 0 && pkt && ctx->framedrop_flags == 3 && !ctx->hw_probing &&
+        !ctx->threads_reinit)
+    {
+        avcodec_send_packet(avctx, NULL);
+        ctx->keyframe_drain = true;
+    }
+
     if (ctx->hw_probing && ctx->num_sent_packets < 32 &&
         ctx->opts->software_fallback <= 32)
     {
@@ -1126,10 +1181,16 @@ static int decode_frame(struct mp_filter *vd)
     prepare_decoding(vd);
 
     // Re-send old packets (typically after a hwdec fallback during init).
-    if (ctx->num_requeue_packets)
+    if (ctx->num_requeue_packets && !ctx->threads_reinit)
         send_queued_packet(vd);
 
+    double t = mp_time_sec();
+    stats_time_start(ctx->stats, "decode");
     int ret = avcodec_receive_frame(avctx, ctx->pic);
+    stats_time_end(ctx->stats, "decode");
+    ctx->decode_time_acc += mp_time_sec() - t;
+    stats_value(ctx->stats, "threads",
+                avctx->active_thread_type ? avctx->thread_count : 1);
     if (ret < 0) {
         if (ret == AVERROR_EOF) {
             // If flushing was initialized earlier and has ended now, make it
@@ -1202,9 +1263,32 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         return 0; // force retry
     }
 
+    if (ctx->threads_reinit && ret == AVERROR_EOF && !ctx->num_delay_queue) {
+        // Old decoder is drained. Reopen it, and send it the keyframe.
+        struct demux_packet **pkts = ctx->requeue_packets;
+        int num_pkts = ctx->num_requeue_packets;
+        ctx->requeue_packets = NULL;
+        ctx->num_requeue_packets = 0;
+
+        uninit_avctx(vd);
+        init_avctx(vd);
+        stats_event(ctx->stats, "reinit");
+
+        ctx->requeue_packets = pkts;
+        ctx->num_requeue_packets = num_pkts;
+
+        return ctx->avctx ? 0 : AVERROR_EOF;
+    }
+
     if (ret == AVERROR(EAGAIN) && ctx->num_requeue_packets)
         return 0; // force retry, so send_queued_packet() gets called
 
+    if (ctx->keyframe_drain && ret == AVERROR_EOF && !ctx->num_delay_queue) {
+        // The decoder was reset by decode_frame(); this is not a real EOF.
+        ctx->keyframe_drain = false;
+        return AVERROR(EAGAIN);
+    }
+
     if (!ctx->num_delay_queue)
         return ret;
 
@@ -1247,6 +1331,10 @@ static int receive_frame(struct mp_filter *vd, struct mp_frame *out_frame)
         ctx->hw_probing = false;
     }
 
+    double t = ctx->decode_time_acc;
+    ctx->decode_time = ctx->decode_time > 0 ? ctx->decode_time * 0.9 + t * 0.1 : t;
+    ctx->decode_time_acc = 0;
+
     *out_frame = MAKE_FRAME(MP_FRAME_VIDEO, res);
     return 0;
 }
@@ -1280,6 +1368,11 @@ static int control(struct mp_filter *vd, enum dec_ctrl cmd, void *arg)
     case VDCTRL_REINIT:
         reinit(vd);
         return CONTROL_TRUE;
+    case VDCTRL_GET_DECODE_TIME:
+        if (ctx->decode_time <= 0)
+            break;
+        *(double *)arg = ctx->decode_time;
+        return CONTROL_TRUE;
     }
     return CONTROL_UNKNOWN;
 }
@@ -1299,6 +1392,9 @@ static void reset(struct mp_filter *vd)
 
     ctx->state = (struct lavc_state){0};
     ctx->framedrop_flags = 0;
+    ctx->threads_reinit = false;
+    ctx->keyframe_drain = false;
+    ctx->decode_time_acc = 0;
 }
 
 static void destroy(struct mp_filter *vd)
@@ -1339,6 +1435,7 @@ static struct mp_decoder *create(struct mp_filter *parent,
     ctx->decoder = talloc_strdup(ctx, decoder);
     ctx->hwdec_swpool = mp_image_pool_new(ctx);
     ctx->dr_pool = mp_image_pool_new(ctx);
+    ctx->stats = stats_ctx_create(ctx, vd->global, "vd-lavc");
 
     ctx->public.f = vd;
     ctx->public.control = control;
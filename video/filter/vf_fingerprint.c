@@ -15,7 +15,14 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <inttypes.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/crc.h>
+#include <libavutil/intfloat.h>
+#include <libavutil/intreadwrite.h>
 
 #include "common/common.h"
 #include "common/tags.h"
@@ -23,6 +30,8 @@
 #include "filters/filter_internal.h"
 #include "filters/user_filters.h"
 #include "options/m_option.h"
+#include "options/path.h"
+#include "osdep/io.h"
 #include "video/img_format.h"
 #include "video/sws_utils.h"
 #include "video/zimg.h"
@@ -31,15 +40,26 @@
 
 #define PRINT_ENTRY_NUM 10
 
+// Values >= 8 are the size of the downscaled gray image for the hex types.
+#define TYPE_DHASH 1
+#define TYPE_PHASH 2
+
+#define PHASH_SIZE 32   // downscaled image size for pHash
+#define PHASH_LOW 8     // number of DCT coefficients used per dimension
+
 struct f_opts {
     int type;
     int clear;
     int print;
+    int plane_hash;
+    char *sidecar;
 };
 
 const struct m_opt_choice_alternatives type_names[] = {
     {"gray-hex-8x8",    8},
     {"gray-hex-16x16",  16},
+    {"dhash-64",        TYPE_DHASH},
+    {"phash-64",        TYPE_PHASH},
     {0}
 };
 
@@ -48,6 +68,8 @@ static const struct m_option f_opts_list[] = {
     {"type", OPT_CHOICE_C(type, type_names)},
     {"clear-on-query", OPT_FLAG(clear)},
     {"print", OPT_FLAG(print)},
+    {"plane-hash", OPT_CHOICE(plane_hash, {"no", 0}, {"crc32", 1})},
+    {"sidecar", OPT_STRING(sidecar), .flags = M_OPT_FILE},
     {0}
 };
 
@@ -58,7 +80,9 @@ static const struct f_opts f_opts_def = {
 
 struct print_entry {
     double pts;
-    char *print;
+    uint64_t hash;      // dhash/phash types
+    uint32_t plane_crc; // if plane-hash is enabled
+    uint8_t gray[16 * 16]; // downscaled image for gray-hex types
 };
 
 struct priv {
@@ -66,21 +90,131 @@ struct priv {
     struct mp_image *scaled;
     struct mp_sws_context *sws;
     struct mp_zimg_context *zimg;
+    // Ring buffer; the oldest entry is at entries[first].
     struct print_entry entries[PRINT_ENTRY_NUM];
-    int num_entries;
+    int first, num_entries;
     bool fallback_warning;
+    const AVCRC *crc_table;
+    FILE *sidecar;
+    float dct[PHASH_LOW][PHASH_SIZE]; // DCT-II basis for the pHash
 };
 
+static struct print_entry *get_entry(struct priv *p, int n)
+{
+    return &p->entries[(p->first + n) % PRINT_ENTRY_NUM];
+}
+
 // (Other code internal to this filter also calls this to reset the frame list.)
 static void f_reset(struct mp_filter *f)
 {
     struct priv *p = f->priv;
 
-    for (int n = 0; n < p->num_entries; n++)
-        talloc_free(p->entries[n].print);
+    p->first = 0;
     p->num_entries = 0;
 }
 
+static void hex_encode(char *dst, const uint8_t *src, int size)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int n = 0; n < size; n++) {
+        dst[n * 2 + 0] = digits[src[n] >> 4];
+        dst[n * 2 + 1] = digits[src[n] & 15];
+    }
+    dst[size * 2] = '\0';
+}
+
+// Each bit is set if a pixel is darker than its right neighbour (9x8 input).
+static uint64_t compute_dhash(struct mp_image *img)
+{
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++) {
+        uint8_t *line = img->planes[0] + y * (ptrdiff_t)img->stride[0];
+        for (int x = 0; x < 8; x++)
+            hash = (hash << 1) | (line[x] < line[x + 1]);
+    }
+    return hash;
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+    float fa = *(const float *)a, fb = *(const float *)b;
+    return fa < fb ? -1 : fa > fb;
+}
+
+// Each bit is set if the low frequency DCT coefficient is above the median
+// (32x32 input). Only the needed 8x8 coefficients are computed, as two small
+// matrix products with contiguous inner loops, which compilers vectorize.
+static uint64_t compute_phash(struct priv *p, struct mp_image *img)
+{
+    float rows[PHASH_SIZE][PHASH_LOW];
+    for (int y = 0; y < PHASH_SIZE; y++) {
+        uint8_t *line = img->planes[0] + y * (ptrdiff_t)img->stride[0];
+        float px[PHASH_SIZE];
+        for (int x = 0; x < PHASH_SIZE; x++)
+            px[x] = line[x];
+        for (int u = 0; u < PHASH_LOW; u++) {
+            float sum = 0;
+            for (int x = 0; x < PHASH_SIZE; x++)
+                sum += p->dct[u][x] * px[x];
+            rows[y][u] = sum;
+        }
+    }
+
+    float coeffs[PHASH_LOW * PHASH_LOW];
+    for (int v = 0; v < PHASH_LOW; v++) {
+        float sum[PHASH_LOW] = {0};
+        for (int y = 0; y < PHASH_SIZE; y++) {
+            for (int u = 0; u < PHASH_LOW; u++)
+                sum[u] += p->dct[v][y] * rows[y][u];
+        }
+        for (int u = 0; u < PHASH_LOW; u++)
+            coeffs[v * PHASH_LOW + u] = sum[u];
+    }
+
+    // The DC coefficient is not used for the median, as it only reflects the
+    // average brightness.
+    float sorted[PHASH_LOW * PHASH_LOW - 1];
+    memcpy(sorted, coeffs + 1, sizeof(sorted));
+    qsort(sorted, MP_ARRAY_SIZE(sorted), sizeof(sorted[0]), cmp_float);
+    float median = sorted[MP_ARRAY_SIZE(sorted) / 2];
+
+    uint64_t hash = 0;
+    for (int n = 0; n < PHASH_LOW * PHASH_LOW; n++)
+        hash = (hash << 1) | (coeffs[n] > median);
+    return hash;
+}
+
+// The standard (zlib) CRC-32 of the visible bytes of all lines of all planes.
+static uint32_t compute_plane_crc(struct priv *p, struct mp_image *mpi)
+{
+    uint32_t crc = UINT32_MAX;
+    for (int n = 0; n < mpi->num_planes; n++) {
+        size_t line_bytes = mp_image_plane_bytes(mpi, n, 0, mpi->w);
+        int h = mp_image_plane_h(mpi, n);
+        for (int y = 0; y < h; y++) {
+            uint8_t *line = mpi->planes[n] + y * (ptrdiff_t)mpi->stride[n];
+            crc = av_crc(p->crc_table, crc, line, line_bytes);
+        }
+    }
+    return crc ^ UINT32_MAX;
+}
+
+// Fixed size little endian records, so the file can be read with seeking.
+static void write_sidecar(struct mp_filter *f, struct print_entry *e)
+{
+    struct priv *p = f->priv;
+
+    uint8_t rec[8 + 8 + 4];
+    AV_WL64(rec + 0, av_double2int(e->pts));
+    AV_WL64(rec + 8, e->hash);
+    AV_WL32(rec + 16, e->plane_crc);
+    if (fwrite(rec, sizeof(rec), 1, p->sidecar) != 1) {
+        MP_ERR(f, "Error writing sidecar file, disabling it.\n");
+        fclose(p->sidecar);
+        p->sidecar = NULL;
+    }
+}
+
 static void f_process(struct mp_filter *f)
 {
     struct priv *p = f->priv;
@@ -116,26 +250,44 @@ static void f_process(struct mp_filter *f)
     }
 
     if (p->num_entries >= PRINT_ENTRY_NUM) {
-        talloc_free(p->entries[0].print);
-        MP_TARRAY_REMOVE_AT(p->entries, p->num_entries, 0);
+        p->first = (p->first + 1) % PRINT_ENTRY_NUM;
+        p->num_entries--;
     }
 
-    int size = p->scaled->w;
+    struct print_entry *e = get_entry(p, p->num_entries++);
+    *e = (struct print_entry){ .pts = mpi->pts };
 
-    struct print_entry *e = &p->entries[p->num_entries++];
-    e->pts = mpi->pts;
-    e->print = talloc_array(p, char, size * size * 2 + 1);
-
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            char *offs = &e->print[(y * size + x) * 2];
-            uint8_t v = p->scaled->planes[0][y * p->scaled->stride[0] + x];
-            snprintf(offs, 3, "%02x", v);
+    switch (p->opts->type) {
+    case TYPE_DHASH:
+        e->hash = compute_dhash(p->scaled);
+        break;
+    case TYPE_PHASH:
+        e->hash = compute_phash(p, p->scaled);
+        break;
+    default:
+        for (int y = 0; y < p->scaled->h; y++) {
+            memcpy(&e->gray[y * p->scaled->w],
+                   p->scaled->planes[0] + y * (ptrdiff_t)p->scaled->stride[0],
+                   p->scaled->w);
         }
+        break;
     }
 
-    if (p->opts->print)
-        MP_INFO(f, "%f: %s\n", e->pts, e->print);
+    if (p->crc_table && !(mpi->fmt.flags & MP_IMGFLAG_HWACCEL))
+        e->plane_crc = compute_plane_crc(p, mpi);
+
+    if (p->sidecar)
+        write_sidecar(f, e);
+
+    if (p->opts->print) {
+        char hex[16 * 16 * 2 + 1];
+        if (p->opts->type < 8) {
+            snprintf(hex, sizeof(hex), "%016"PRIx64, e->hash);
+        } else {
+            hex_encode(hex, e->gray, p->opts->type * p->opts->type);
+        }
+        MP_INFO(f, "%f: %s\n", e->pts, hex);
+    }
 
     mp_pin_in_write(f->ppins[1], frame);
     return;
@@ -155,13 +307,24 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
         struct mp_tags *t = talloc_zero(NULL, struct mp_tags);
 
         for (int n = 0; n < p->num_entries; n++) {
-            struct print_entry *e = &p->entries[n];
+            struct print_entry *e = get_entry(p, n);
 
             if (e->pts != MP_NOPTS_VALUE) {
                 mp_tags_set_str(t, mp_tprintf(80, "fp%d.pts", n),
                                    mp_tprintf(80, "%f", e->pts));
             }
-            mp_tags_set_str(t, mp_tprintf(80, "fp%d.hex", n), e->print);
+            if (p->opts->type < 8) {
+                mp_tags_set_str(t, mp_tprintf(80, "fp%d.hash", n),
+                                   mp_tprintf(80, "%016"PRIx64, e->hash));
+            } else {
+                char hex[16 * 16 * 2 + 1];
+                hex_encode(hex, e->gray, p->opts->type * p->opts->type);
+                mp_tags_set_str(t, mp_tprintf(80, "fp%d.hex", n), hex);
+            }
+            if (p->crc_table) {
+                mp_tags_set_str(t, mp_tprintf(80, "fp%d.crc32", n),
+                                   mp_tprintf(80, "%08"PRIx32, e->plane_crc));
+            }
         }
 
         mp_tags_set_str(t, "type", m_opt_choice_str(type_names, p->opts->type));
@@ -177,11 +340,20 @@ static bool f_command(struct mp_filter *f, struct mp_filter_command *cmd)
     }
 }
 
+static void f_destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->sidecar)
+        fclose(p->sidecar);
+}
+
 static const struct mp_filter_info filter = {
     .name = "fingerprint",
     .process = f_process,
     .command = f_command,
     .reset = f_reset,
+    .destroy = f_destroy,
     .priv_size = sizeof(struct priv),
 };
 
@@ -198,8 +370,18 @@ static struct mp_filter *f_create(struct mp_filter *parent, void *options)
 
     struct priv *p = f->priv;
     p->opts = talloc_steal(p, options);
-    int size = p->opts->type;
-    p->scaled = mp_image_alloc(IMGFMT_Y8, size, size);
+    int w = p->opts->type, h = p->opts->type;
+    if (p->opts->type == TYPE_DHASH) {
+        w = 9;
+        h = 8;
+    } else if (p->opts->type == TYPE_PHASH) {
+        w = h = PHASH_SIZE;
+        for (int u = 0; u < PHASH_LOW; u++) {
+            for (int x = 0; x < PHASH_SIZE; x++)
+                p->dct[u][x] = cos(M_PI / PHASH_SIZE * (x + 0.5) * u);
+        }
+    }
+    p->scaled = mp_image_alloc(IMGFMT_Y8, w, h);
     MP_HANDLE_OOM(p->scaled);
     talloc_steal(p, p->scaled);
     p->sws = mp_sws_alloc(p);
@@ -214,6 +396,15 @@ static struct mp_filter *f_create(struct mp_filter *parent, void *options)
         .dither = ZIMG_DITHER_NONE,
         .fast = 1,
     };
+    if (p->opts->plane_hash)
+        p->crc_table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    if (p->opts->sidecar && p->opts->sidecar[0]) {
+        char *path = mp_get_user_path(NULL, f->global, p->opts->sidecar);
+        p->sidecar = fopen(path, "wb");
+        if (!p->sidecar)
+            MP_ERR(f, "Could not open sidecar file '%s'.\n", path);
+        talloc_free(path);
+    }
     return f;
 }
 
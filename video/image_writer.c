@@ -87,12 +87,41 @@ const struct m_option image_writer_opts[] = {
     {0},
 };
 
+struct image_writer_cache {
+    struct mp_sws_context *sws;
+
+    // Encoder that was left open after the last write_lavc() call, and the
+    // parameters it was opened with. Only used for encoders without delay.
+    AVCodecContext *avctx;
+    struct image_writer_opts avctx_opts;
+    AVFrame *pic;
+    AVPacket *pkt;
+};
+
 struct image_writer_ctx {
     struct mp_log *log;
     const struct image_writer_opts *opts;
     struct mp_imgfmt_desc original_format;
+    struct image_writer_cache *cache; // can be NULL
 };
 
+static void free_cache(void *p)
+{
+    struct image_writer_cache *cache = p;
+    avcodec_free_context(&cache->avctx);
+    av_frame_free(&cache->pic);
+    av_packet_free(&cache->pkt);
+}
+
+struct image_writer_cache *image_writer_cache_alloc(void *ta_parent)
+{
+    struct image_writer_cache *cache =
+        talloc_zero(ta_parent, struct image_writer_cache);
+    talloc_set_destructor(cache, free_cache);
+    cache->sws = mp_sws_alloc(cache);
+    return cache;
+}
+
 static enum AVPixelFormat replace_j_format(enum AVPixelFormat fmt)
 {
     switch (fmt) {
@@ -103,6 +132,20 @@ static enum AVPixelFormat replace_j_format(enum AVPixelFormat fmt)
     return fmt;
 }
 
+// Whether the encoder cached from a previous image can encode this one.
+static bool can_reuse_encoder(struct image_writer_ctx *ctx,
+                              const AVCodec *codec, AVCodecContext *avctx,
+                              mp_image_t *image, enum AVPixelFormat pix_fmt)
+{
+    struct image_writer_cache *cache = ctx->cache;
+    return cache && cache->avctx && cache->avctx->codec == codec &&
+           cache->avctx->width == image->w &&
+           cache->avctx->height == image->h &&
+           cache->avctx->pix_fmt == pix_fmt &&
+           cache->avctx->color_range == avctx->color_range &&
+           memcmp(&cache->avctx_opts, ctx->opts, sizeof(*ctx->opts)) == 0;
+}
+
 static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
 {
     bool success = false;
@@ -138,6 +181,14 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
                mp_imgfmt_to_name(image->imgfmt));
         goto error_exit;
     }
+
+    if (can_reuse_encoder(ctx, codec, avctx, image, avctx->pix_fmt)) {
+        avcodec_free_context(&avctx);
+        avctx = ctx->cache->avctx;
+        ctx->cache->avctx = NULL;
+        goto encode;
+    }
+
     if (codec->id == AV_CODEC_ID_PNG) {
         avctx->compression_level = ctx->opts->png_compression;
         av_opt_set_int(avctx, "pred", ctx->opts->png_filter,
@@ -163,8 +214,19 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
         goto error_exit;
     }
 
-    pic = av_frame_alloc();
-    if (!pic)
+encode:
+    if (ctx->cache) {
+        if (!ctx->cache->pic)
+            ctx->cache->pic = av_frame_alloc();
+        if (!ctx->cache->pkt)
+            ctx->cache->pkt = av_packet_alloc();
+        pic = ctx->cache->pic;
+        pkt = ctx->cache->pkt;
+    } else {
+        pic = av_frame_alloc();
+        pkt = av_packet_alloc();
+    }
+    if (!pic || !pkt)
         goto error_exit;
     for (int n = 0; n < 4; n++) {
         pic->data[n] = image->planes[n];
@@ -181,15 +243,19 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
             mp_csp_trc_to_avcol_trc(image->params.color.gamma);
     }
 
+    // Encoders without delay return the packet right away, and can then be
+    // kept open for the next image with the same parameters. Others must be
+    // drained, which leaves them unusable.
+    bool keep_open = ctx->cache && !(codec->capabilities & AV_CODEC_CAP_DELAY);
+
     int ret = avcodec_send_frame(avctx, pic);
     if (ret < 0)
         goto error_exit;
-    ret = avcodec_send_frame(avctx, NULL); // send EOF
-    if (ret < 0)
-        goto error_exit;
-    pkt = av_packet_alloc();
-    if (!pkt)
-        goto error_exit;
+    if (!keep_open) {
+        ret = avcodec_send_frame(avctx, NULL); // send EOF
+        if (ret < 0)
+            goto error_exit;
+    }
     ret = avcodec_receive_packet(avctx, pkt);
     if (ret < 0)
         goto error_exit;
@@ -197,10 +263,24 @@ static bool write_lavc(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp
 
     fwrite(pkt->data, pkt->size, 1, fp);
 
+    if (keep_open) {
+        avcodec_free_context(&ctx->cache->avctx);
+        ctx->cache->avctx = avctx;
+        ctx->cache->avctx_opts = *ctx->opts;
+        avctx = NULL;
+    }
+
 error_exit:
     avcodec_free_context(&avctx);
-    av_frame_free(&pic);
-    av_packet_free(&pkt);
+    if (ctx->cache) {
+        if (pic)
+            av_frame_unref(pic);
+        if (pkt)
+            av_packet_unref(pkt);
+    } else {
+        av_frame_free(&pic);
+        av_packet_free(&pkt);
+    }
     return success;
 }
 
@@ -343,6 +423,7 @@ int image_writer_format_from_ext(const char *ext)
 
 static struct mp_image *convert_image(struct mp_image *image, int destfmt,
                                       enum mp_csp_levels yuv_levels,
+                                      struct mp_sws_context *cached_sws,
                                       struct mpv_global *global,
                                       struct mp_log *log)
 {
@@ -380,12 +461,15 @@ static struct mp_image *convert_image(struct mp_image *image, int destfmt,
 
     dst->params = p;
 
-    struct mp_sws_context *sws = mp_sws_alloc(NULL);
+    // A cached context keeps the swscale setup across images with the same
+    // parameters; mp_sws_scale() reinitializes it on changes.
+    struct mp_sws_context *sws = cached_sws ? cached_sws : mp_sws_alloc(NULL);
     sws->log = log;
     if (global)
         mp_sws_enable_cmdline_opts(sws, global);
     bool ok = mp_sws_scale(sws, dst, image) >= 0;
-    talloc_free(sws);
+    if (sws != cached_sws)
+        talloc_free(sws);
 
     if (!ok) {
         mp_err(log, "Error when converting image.\n");
@@ -399,12 +483,21 @@ static struct mp_image *convert_image(struct mp_image *image, int destfmt,
 bool write_image(struct mp_image *image, const struct image_writer_opts *opts,
                 const char *filename, struct mpv_global *global,
                  struct mp_log *log)
+{
+    return write_image_cached(NULL, image, opts, filename, global, log);
+}
+
+bool write_image_cached(struct image_writer_cache *cache,
+                        struct mp_image *image,
+                        const struct image_writer_opts *opts,
+                        const char *filename, struct mpv_global *global,
+                        struct mp_log *log)
 {
     struct image_writer_opts defs = image_writer_opts_defaults;
     if (!opts)
         opts = &defs;
 
-    struct image_writer_ctx ctx = { log, opts, image->fmt };
+    struct image_writer_ctx ctx = { log, opts, image->fmt, cache };
     bool (*write)(struct image_writer_ctx *, mp_image_t *, FILE *) = write_lavc;
     int destfmt = 0;
 
@@ -431,7 +524,8 @@ bool write_image(struct mp_image *image, const struct image_writer_opts *opts,
         levels = MP_CSP_LEVELS_PC;
     }
 
-    struct mp_image *dst = convert_image(image, destfmt, levels, global, log);
+    struct mp_image *dst = convert_image(image, destfmt, levels,
+                                         cache ? cache->sws : NULL, global, log);
     if (!dst)
         return false;
 
@@ -69,5 +69,19 @@ bool write_image(struct mp_image *image, const struct image_writer_opts *opts,
                 const char *filename, struct mpv_global *global,
                  struct mp_log *log);
 
+// Reusable state for repeated write_image_cached() calls, such as the swscale
+// context and encoders which can be kept open between images. Not thread-safe;
+// use one instance per thread. Free with talloc_free().
+struct image_writer_cache;
+struct image_writer_cache *image_writer_cache_alloc(void *ta_parent);
+
+// Like write_image(), but reuse the conversion and encoder setup in cache (if
+// not NULL) when the image parameters and options did not change.
+bool write_image_cached(struct image_writer_cache *cache,
+                        struct mp_image *image,
+                        const struct image_writer_opts *opts,
+                        const char *filename, struct mpv_global *global,
+                        struct mp_log *log);
+
 // Debugging helper.
 void dump_png(struct mp_image *image, const char *filename, struct mp_log *log);
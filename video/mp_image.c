@@ -1053,10 +1053,11 @@ struct mp_image *mp_image_from_av_frame(struct AVFrame *src)
 }
 
 
-// Convert the mp_image reference to a AVFrame reference.
-struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
+// Turn new_ref (a reference to src, or src itself) into an AVFrame. The buffer
+// references are moved from new_ref to the AVFrame, and new_ref is freed.
+static struct AVFrame *image_to_av_frame(struct mp_image *src,
+                                         struct mp_image *new_ref)
 {
-    struct mp_image *new_ref = mp_image_new_ref(src);
     AVFrame *dst = av_frame_alloc();
     if (!dst || !new_ref) {
         talloc_free(new_ref);
@@ -1139,9 +1140,19 @@ struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
     return dst;
 }
 
+// Convert the mp_image reference to a AVFrame reference.
+struct AVFrame *mp_image_to_av_frame(struct mp_image *src)
+{
+    return image_to_av_frame(src, mp_image_new_ref(src));
+}
+
 // Same as mp_image_to_av_frame(), but unref img. (It does so even on failure.)
+// If img is refcounted, its references are handed over to the AVFrame, instead
+// of creating new ones.
 struct AVFrame *mp_image_to_av_frame_and_unref(struct mp_image *img)
 {
+    if (img && img->bufs[0])
+        return image_to_av_frame(img, img);
     AVFrame *frame = mp_image_to_av_frame(img);
     talloc_free(img);
     return frame;
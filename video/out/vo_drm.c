@@ -30,6 +30,7 @@
 
 #include "common/msg.h"
 #include "osdep/timer.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
@@ -93,6 +94,11 @@ struct priv {
     struct mp_image *last_input;
     struct mp_image *cur_frame;
     struct mp_image *cur_frame_cropped;
+    // Frames without OSD are rendered into the dumb buffers directly, instead
+    // of into cur_frame followed by a copy. Possible if no format conversion
+    // is needed.
+    bool direct;
+    struct mp_draw_sub_cache *osd_cache;
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_osd_res osd;
@@ -311,6 +317,8 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         .p_h = 1,
     };
 
+    p->direct = p->drm_format == DRM_FORMAT_XRGB8888;
+
     talloc_free(p->cur_frame);
     p->cur_frame = mp_image_alloc(p->imgfmt, p->screen_w, p->screen_h);
     mp_image_params_guess_csp(&p->sws->dst);
@@ -364,11 +372,41 @@ static struct framebuffer *get_new_fb(struct vo *vo)
     return &p->bufs[p->front_buf];
 }
 
+// Return an image (without references) that points to the framebuffer memory.
+// Valid for XRGB8888 only.
+static struct mp_image wrap_fb(struct vo *vo, struct framebuffer *fb)
+{
+    struct priv *p = vo->priv;
+    struct mp_image img = {0};
+    mp_image_set_params(&img, &p->cur_frame->params);
+    img.planes[0] = fb->map;
+    img.stride[0] = fb->stride;
+    return img;
+}
+
 static void draw_image(struct vo *vo, mp_image_t *mpi, struct framebuffer *front_buf)
 {
     struct priv *p = vo->priv;
 
     if (p->active && front_buf != NULL) {
+        struct sub_bitmap_list *osd = osd_render(vo->osd, p->osd,
+                                                 mpi ? mpi->pts : 0, 0,
+                                                 mp_draw_sub_formats);
+        // Blending the OSD reads the destination, which is very slow on the
+        // (usually write-combined) framebuffer memory.
+        bool direct = p->direct && !osd->num_items;
+
+        struct mp_image *dst = p->cur_frame;
+        struct mp_image *dst_cropped = p->cur_frame_cropped;
+        struct mp_image fb_img, fb_img_cropped;
+        if (direct) {
+            fb_img = wrap_fb(vo, front_buf);
+            fb_img_cropped = fb_img;
+            mp_image_crop_rc(&fb_img_cropped, p->dst);
+            dst = &fb_img;
+            dst_cropped = &fb_img_cropped;
+        }
+
         if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
@@ -376,19 +414,27 @@ static void draw_image(struct vo *vo, mp_image_t *mpi, struct framebuffer *front
             src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, mpi->fmt.align_y);
             mp_image_crop_rc(&src, src_rc);
 
-            mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->dst.y0);
-            mp_image_clear(p->cur_frame, 0, p->dst.y1, p->cur_frame->w, p->cur_frame->h);
-            mp_image_clear(p->cur_frame, 0, p->dst.y0, p->dst.x0, p->dst.y1);
-            mp_image_clear(p->cur_frame, p->dst.x1, p->dst.y0, p->cur_frame->w, p->dst.y1);
+            mp_image_clear(dst, 0, 0, dst->w, p->dst.y0);
+            mp_image_clear(dst, 0, p->dst.y1, dst->w, dst->h);
+            mp_image_clear(dst, 0, p->dst.y0, p->dst.x0, p->dst.y1);
+            mp_image_clear(dst, p->dst.x1, p->dst.y0, dst->w, p->dst.y1);
 
-            mp_sws_scale(p->sws, p->cur_frame_cropped, &src);
-            osd_draw_on_image(vo->osd, p->osd, src.pts, 0, p->cur_frame);
+            mp_sws_scale(p->sws, dst_cropped, &src);
         } else {
-            mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->cur_frame->h);
-            osd_draw_on_image(vo->osd, p->osd, 0, 0, p->cur_frame);
+            mp_image_clear(dst, 0, 0, dst->w, dst->h);
+        }
+
+        if (osd->num_items) {
+            if (!p->osd_cache)
+                p->osd_cache = mp_draw_sub_alloc(p, vo->global);
+            if (!mp_draw_sub_bitmaps(p->osd_cache, dst, osd))
+                MP_WARN(vo, "Failed rendering OSD.\n");
         }
+        talloc_free(osd);
 
-        if (p->drm_format == DRM_FORMAT_XRGB2101010) {
+        if (direct) {
+            // Already rendered into the framebuffer.
+        } else if (p->drm_format == DRM_FORMAT_XRGB2101010) {
             // Pack GBRP10 image into XRGB2101010 for DRM
             const int w = p->cur_frame->w;
             const int h = p->cur_frame->h;
@@ -635,7 +681,13 @@ static int control(struct vo *vo, uint32_t request, void *arg)
     struct priv *p = vo->priv;
     switch (request) {
     case VOCTRL_SCREENSHOT_WIN:
-        *(struct mp_image**)arg = mp_image_new_copy(p->cur_frame);
+        // cur_frame is not up to date if the frame was rendered directly.
+        if (p->direct) {
+            struct mp_image img = wrap_fb(vo, &p->bufs[p->front_buf]);
+            *(struct mp_image**)arg = mp_image_new_copy(&img);
+        } else {
+            *(struct mp_image**)arg = mp_image_new_copy(p->cur_frame);
+        }
         return VO_TRUE;
     case VOCTRL_SET_PANSCAN:
         if (vo->config_ok)
@@ -18,6 +18,9 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -34,7 +37,9 @@
 #include <libswscale/swscale.h>
 #include <libavutil/base64.h>
 
+#include "misc/random.h"
 #include "options/m_config.h"
+#include "options/path.h"
 #include "osdep/terminal.h"
 #include "sub/osd.h"
 #include "vo.h"
@@ -72,25 +77,59 @@ static inline void write_str(const char *s)
 }
 
 #define KITTY_ESC_IMG        "\033_Ga=T,f=24,s=%d,v=%d,C=1,q=2,m=1;"
-#define KITTY_ESC_IMG_SHM    "\033_Ga=T,t=s,f=24,s=%d,v=%d,C=1,q=2,m=1;%s\033\\"
+#define KITTY_ESC_IMG_ID     "\033_Ga=T,i=%d,p=1,f=24,s=%d,v=%d,C=1,q=2,m=1;"
+#define KITTY_ESC_IMG_FILE   "\033_Ga=T,t=t,f=24,s=%d,v=%d,C=1,q=2,m=1;%s\033\\"
+#define KITTY_ESC_TILE       "\033_Ga=f,r=1,i=%d,x=%d,y=%d,s=%d,v=%d,f=24,q=2,m=1;"
 #define KITTY_ESC_CONTINUE   "\033_Gm=%d;"
 #define KITTY_ESC_END        "\033\\"
 #define KITTY_ESC_DELETE_ALL "\033_Ga=d;\033\\"
 
+// Image ID used with --vo-kitty-diff, so that tiles can update the image.
+#define KITTY_IMAGE_ID 0x6d7076
+
+// Maximum base64 payload per escape sequence, as required by the protocol.
+#define CHUNK_SIZE 4096
+
+#define TILE_SIZE 64
+
+// Number of buffers the terminal reads from in turn with --vo-kitty-use-shm.
+// The terminal reads them asynchronously, so a buffer must not be overwritten
+// right after it was sent.
+#define SHM_POOL_SIZE 3
+
+// The terminal deletes temporary files (t=t) only if the name contains this.
+#define SHM_LINK_PREFIX "tty-graphics-protocol-mpv-"
+
 struct vo_kitty_opts {
     int width, height, top, left, rows, cols;
     int config_clear, alt_screen;
     int use_shm;
+    int diff;
+};
+
+struct shm_buf {
+    char    *path;      // inside priv.shm_dir
+    int     fd;
+    uint8_t *data;
 };
 
 struct priv {
     struct vo_kitty_opts opts;
 
     uint8_t *buffer;
-    char    *output;
-    char    *shm_path, *shm_path_b64;
-    int     buffer_size, output_size;
-    int     shm_fd;
+    uint8_t *prev;      // with diff: the image as the terminal has it
+    bool    prev_ok;
+    uint8_t *tile;      // packed pixels of a single tile
+    char    *cmd;       // escape sequences for the current frame
+    int     cmd_len;
+    int     buffer_size;
+
+    struct shm_buf shm[SHM_POOL_SIZE];
+    int     shm_cur;    // buffer in use for the current frame
+    char    *shm_base;  // temp directory the terminal is given files in
+    char    *shm_dir;   // private directory inside shm_base with the pool
+
+    char    b64_lut[4096][2]; // 12 bit value to 2 base64 digits
 
     int left, top, width, height, cols, rows;
 
@@ -106,32 +145,123 @@ static struct sigaction saved_sigaction = {0};
 static bool resized;
 #endif
 
-static void close_shm(struct priv *p)
+static void destroy_shm_pool(struct priv *p)
 {
 #if HAVE_POSIX_SHM
-    if (p->buffer != NULL) {
-        munmap(p->buffer, p->buffer_size);
-        p->buffer = NULL;
-    }
-    if (p->shm_fd != -1) {
-        close(p->shm_fd);
-        p->shm_fd = -1;
+    for (int n = 0; n < SHM_POOL_SIZE; n++) {
+        struct shm_buf *b = &p->shm[n];
+        if (b->data)
+            munmap(b->data, p->buffer_size);
+        if (b->fd != -1)
+            close(b->fd);
+        if (b->path)
+            unlink(b->path);
+        talloc_free(b->path);
+        *b = (struct shm_buf){ .fd = -1 };
     }
+    if (p->shm_dir)
+        rmdir(p->shm_dir);
+    TA_FREEP(&p->shm_dir);
+    TA_FREEP(&p->shm_base);
 #endif
+    p->buffer = NULL;
 }
 
 static void free_bufs(struct vo* vo)
 {
     struct priv* p = vo->priv;
 
-    talloc_free(p->frame);
-    talloc_free(p->output);
+    TA_FREEP(&p->frame);
+    TA_FREEP(&p->prev);
+    TA_FREEP(&p->tile);
+    p->prev_ok = false;
 
     if (p->opts.use_shm) {
-        close_shm(p);
+        destroy_shm_pool(p);
     } else {
-        talloc_free(p->buffer);
+        TA_FREEP(&p->buffer);
+    }
+}
+
+// The terminal unlinks the file (or POSIX shared memory object) it is given
+// after reading it. To reuse the buffers for every frame, they are kept in a
+// private directory, and each frame is sent as a new hard link to the buffer,
+// which only the terminal sees (see link_shm_buf()). The files are put on a
+// tmpfs if possible, so this is still a memory transfer.
+static bool create_shm_pool(struct vo *vo)
+{
+#if HAVE_POSIX_SHM
+    struct priv *p = vo->priv;
+    p->shm_base =
+        talloc_strdup(NULL, mp_path_exists("/dev/shm") ? "/dev/shm" : "/tmp");
+
+    // mkdtemp() creates it with a random name, accessible only by us.
+    p->shm_dir = mp_path_join(NULL, p->shm_base, "mpv-kitty-XXXXXX");
+    if (!mkdtemp(p->shm_dir)) {
+        MP_ERR(vo, "Failed to create shared memory directory in '%s'\n",
+               p->shm_base);
+        TA_FREEP(&p->shm_dir);
+        goto fail;
+    }
+
+    for (int n = 0; n < SHM_POOL_SIZE; n++) {
+        struct shm_buf *b = &p->shm[n];
+        char name[16];
+        snprintf(name, sizeof(name), "%d", n);
+        b->path = mp_path_join(NULL, p->shm_dir, name);
+
+        b->fd = open(b->path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC,
+                     S_IRUSR | S_IWUSR);
+        if (b->fd == -1) {
+            MP_ERR(vo, "Failed to create shared memory file '%s'\n", b->path);
+            goto fail;
+        }
+
+        if (ftruncate(b->fd, p->buffer_size) == -1) {
+            MP_ERR(vo, "Failed to truncate shared memory file\n");
+            goto fail;
+        }
+
+        b->data = mmap(NULL, p->buffer_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, b->fd, 0);
+        if (b->data == MAP_FAILED) {
+            b->data = NULL;
+            MP_ERR(vo, "Failed to mmap shared memory file\n");
+            goto fail;
+        }
+    }
+    return true;
+
+fail:
+    destroy_shm_pool(p);
+#endif
+    return false;
+}
+
+// Create a new link to the given buffer with a random name, for the terminal
+// to read and delete. Returns the base64 encoded path, or NULL on failure.
+static char *link_shm_buf(struct vo *vo, void *ta_ctx, struct shm_buf *b)
+{
+#if HAVE_POSIX_SHM
+    struct priv *p = vo->priv;
+    for (int tries = 0; tries < 10; tries++) {
+        char name[64];
+        snprintf(name, sizeof(name), SHM_LINK_PREFIX "%016" PRIx64,
+                 mp_rand_next());
+        char *path = mp_path_join(ta_ctx, p->shm_base, name);
+        // Fails with EEXIST if the name is taken, and never follows symlinks.
+        if (link(b->path, path) == 0) {
+            int b64_size = AV_BASE64_SIZE(strlen(path));
+            char *path_b64 = talloc_array(ta_ctx, char, b64_size);
+            av_base64_encode(path_b64, b64_size, path, strlen(path));
+            return path_b64;
+        }
+        if (errno != EEXIST)
+            break;
     }
+    MP_ERR(vo, "Failed to create shared memory file in '%s'\n", p->shm_base);
+#endif
+    return NULL;
 }
 
 static void get_win_size(struct vo *vo, int *out_rows, int *out_cols,
@@ -165,7 +295,6 @@ static void set_out_params(struct vo *vo)
         p->opts.left : p->cols * p->dst.x0 / vo->dwidth;
 
     p->buffer_size = 3 * p->width * p->height;
-    p->output_size = AV_BASE64_SIZE(p->buffer_size);
 }
 
 static int reconfig(struct vo *vo, struct mp_image_params *params)
@@ -199,44 +328,18 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
-    if (!p->opts.use_shm) {
+    if (p->opts.use_shm) {
+        if (!create_shm_pool(vo))
+            return -1;
+    } else {
         p->buffer = talloc_array(NULL, uint8_t, p->buffer_size);
-        p->output = talloc_array(NULL, char, p->output_size);
-    }
-
-    return 0;
-}
-
-static int create_shm(struct vo *vo)
-{
-#if HAVE_POSIX_SHM
-    struct priv *p = vo->priv;
-    p->shm_fd = shm_open(p->shm_path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
-    if (p->shm_fd == -1) {
-        MP_ERR(vo, "Failed to create shared memory object");
-        return 0;
-    }
-
-    if (ftruncate(p->shm_fd, p->buffer_size) == -1) {
-        MP_ERR(vo, "Failed to truncate shared memory object");
-        shm_unlink(p->shm_path);
-        close(p->shm_fd);
-        return 0;
+        if (p->opts.diff) {
+            p->prev = talloc_array(NULL, uint8_t, p->buffer_size);
+            p->tile = talloc_array(NULL, uint8_t, TILE_SIZE * TILE_SIZE * 3);
+        }
     }
 
-    p->buffer = mmap(NULL, p->buffer_size,
-                        PROT_READ | PROT_WRITE, MAP_SHARED, p->shm_fd, 0);
-
-    if (p->buffer == MAP_FAILED) {
-        MP_ERR(vo, "Failed to mmap shared memory object");
-        shm_unlink(p->shm_path);
-        close(p->shm_fd);
-        return 0;
-    }
-    return 1;
-#else
     return 0;
-#endif
 }
 
 static void draw_frame(struct vo *vo, struct vo_frame *frame)
@@ -272,18 +375,131 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
     osd_draw_on_image(vo->osd, res, mpi ? mpi->pts : 0, 0, p->frame);
 
 
-    if (p->opts.use_shm && !create_shm(vo))
-        return;
+    if (p->opts.use_shm) {
+        if (!p->shm[0].data)
+            goto done;
+        p->shm_cur = (p->shm_cur + 1) % SHM_POOL_SIZE;
+        p->buffer = p->shm[p->shm_cur].data;
+    }
 
     memcpy_pic(p->buffer, p->frame->planes[0], p->width * BYTES_PER_PX,
                p->height, p->width * BYTES_PER_PX, p->frame->stride[0]);
 
-    if (!p->opts.use_shm)
-        av_base64_encode(p->output, p->output_size, p->buffer, p->buffer_size);
-
+done:
     talloc_free(mpi);
 }
 
+static void cmd_append(struct priv *p, const char *s, int len)
+{
+    MP_TARRAY_GROW(p, p->cmd, p->cmd_len + len);
+    memcpy(p->cmd + p->cmd_len, s, len);
+    p->cmd_len += len;
+}
+
+static void cmd_appendf(struct priv *p, const char *fmt, ...)
+    PRINTF_ATTRIBUTE(2, 3);
+
+static void cmd_appendf(struct priv *p, const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    cmd_append(p, buf, MPMIN(len, sizeof(buf) - 1));
+}
+
+// Like av_base64_encode(), but converts 12 bits per table lookup. Returns the
+// number of characters written to out (no terminating 0).
+static int base64_encode(struct priv *p, char *out, const uint8_t *in, int size)
+{
+    char *o = out;
+    int n = 0;
+    for (; n + 3 <= size; n += 3) {
+        uint32_t v = (in[n] << 16) | (in[n + 1] << 8) | in[n + 2];
+        memcpy(o + 0, p->b64_lut[v >> 12], 2);
+        memcpy(o + 2, p->b64_lut[v & 0xFFF], 2);
+        o += 4;
+    }
+    if (n < size) {
+        uint32_t v = in[n] << 16;
+        if (n + 1 < size)
+            v |= in[n + 1] << 8;
+        memcpy(o, p->b64_lut[v >> 12], 2);
+        o[2] = n + 1 < size ? p->b64_lut[v & 0xFFF][0] : '=';
+        o[3] = '=';
+        o += 4;
+    }
+    return o - out;
+}
+
+// Append the base64 encoded data to the command, split into chunks. The
+// command must end with a header that has "m=1;" set.
+static void cmd_append_payload(struct priv *p, const uint8_t *data, int size)
+{
+    // CHUNK_SIZE base64 digits encode 3/4 of the bytes.
+    const int in_chunk = CHUNK_SIZE / 4 * 3;
+    for (int offset = 0;; offset += in_chunk) {
+        int len = MPMIN(in_chunk, size - offset);
+        if (offset)
+            cmd_appendf(p, KITTY_ESC_CONTINUE, offset + len < size);
+        MP_TARRAY_GROW(p, p->cmd, p->cmd_len + CHUNK_SIZE);
+        p->cmd_len += base64_encode(p, p->cmd + p->cmd_len, data + offset, len);
+        cmd_append(p, KITTY_ESC_END, strlen(KITTY_ESC_END));
+        if (offset + len >= size)
+            break;
+    }
+}
+
+// Send only the tiles that differ from the previous frame as edits of the
+// existing image. Returns false if a full frame should be sent instead.
+static bool write_tiles(struct priv *p)
+{
+    const int stride = p->width * BYTES_PER_PX;
+    int tiles_x = (p->width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (p->height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Find changed tiles first; if most of the image changed, a full update
+    // is cheaper than many small ones.
+    int num_changed = 0;
+    bool *changed = talloc_zero_array(NULL, bool, tiles_x * tiles_y);
+    for (int ty = 0; ty < tiles_y; ty++) {
+        int y0 = ty * TILE_SIZE, h = MPMIN(TILE_SIZE, p->height - y0);
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x0 = tx * TILE_SIZE, w = MPMIN(TILE_SIZE, p->width - x0);
+            for (int y = y0; y < y0 + h; y++) {
+                size_t offs = (size_t)y * stride + x0 * BYTES_PER_PX;
+                if (memcmp(p->buffer + offs, p->prev + offs, w * BYTES_PER_PX)) {
+                    changed[ty * tiles_x + tx] = true;
+                    num_changed++;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (num_changed * 2 > tiles_x * tiles_y) {
+        talloc_free(changed);
+        return false;
+    }
+
+    for (int ty = 0; ty < tiles_y; ty++) {
+        int y0 = ty * TILE_SIZE, h = MPMIN(TILE_SIZE, p->height - y0);
+        for (int tx = 0; tx < tiles_x; tx++) {
+            if (!changed[ty * tiles_x + tx])
+                continue;
+            int x0 = tx * TILE_SIZE, w = MPMIN(TILE_SIZE, p->width - x0);
+            memcpy_pic(p->tile, p->buffer + (size_t)y0 * stride + x0 * BYTES_PER_PX,
+                       w * BYTES_PER_PX, h, w * BYTES_PER_PX, stride);
+            cmd_appendf(p, KITTY_ESC_TILE, KITTY_IMAGE_ID, x0, y0, w, h);
+            cmd_append_payload(p, p->tile, w * h * BYTES_PER_PX);
+        }
+    }
+
+    talloc_free(changed);
+    return true;
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv* p = vo->priv;
@@ -291,36 +507,29 @@ static void flip_page(struct vo *vo)
     if (p->buffer == NULL)
         return;
 
-    char *cmd = talloc_asprintf(NULL, TERM_ESC_GOTO_YX, p->top, p->left);
+    p->cmd_len = 0;
+    cmd_appendf(p, TERM_ESC_GOTO_YX, p->top, p->left);
 
     if (p->opts.use_shm) {
-        cmd = talloc_asprintf_append(cmd, KITTY_ESC_IMG_SHM, p->width, p->height, p->shm_path_b64);
-    } else {
-        if (p->output == NULL) {
-            talloc_free(cmd);
+        char *path_b64 = link_shm_buf(vo, p, &p->shm[p->shm_cur]);
+        if (!path_b64)
             return;
+        cmd_appendf(p, KITTY_ESC_IMG_FILE, p->width, p->height, path_b64);
+        talloc_free(path_b64);
+    } else if (p->opts.diff) {
+        if (!p->prev_ok || !write_tiles(p)) {
+            cmd_appendf(p, KITTY_ESC_IMG_ID, KITTY_IMAGE_ID, p->width, p->height);
+            cmd_append_payload(p, p->buffer, p->buffer_size);
         }
-
-        cmd = talloc_asprintf_append(cmd, KITTY_ESC_IMG, p->width, p->height);
-        for (int offset = 0, noffset;; offset += noffset) {
-            if (offset)
-                cmd = talloc_asprintf_append(cmd, KITTY_ESC_CONTINUE, offset < p->output_size);
-            noffset = MPMIN(4096, p->output_size - offset);
-            cmd = talloc_strndup_append(cmd, p->output + offset, noffset);
-            cmd = talloc_strdup_append(cmd, KITTY_ESC_END);
-
-            if (offset >= p->output_size)
-                break;
-        }
+        MPSWAP(uint8_t *, p->buffer, p->prev);
+        p->prev_ok = true;
+    } else {
+        cmd_appendf(p, KITTY_ESC_IMG, p->width, p->height);
+        cmd_append_payload(p, p->buffer, p->buffer_size);
     }
 
-    write_str(cmd);
-    talloc_free(cmd);
-
-#if HAVE_POSIX
-    if (p->opts.use_shm)
-        close_shm(p);
-#endif
+    cmd_append(p, "", 1);
+    write_str(p->cmd);
 }
 
 #if HAVE_POSIX
@@ -345,21 +554,23 @@ static int preinit(struct vo *vo)
     sigaction(SIGWINCH, &sa, &saved_sigaction);
 #endif
 
-#if HAVE_POSIX_SHM
-    if (p->opts.use_shm) {
-        p->shm_path = talloc_asprintf(vo, "/mpv-kitty-%p", vo);
-        int p_size = strlen(p->shm_path) - 1;
-        int b64_size = AV_BASE64_SIZE(p_size);
-        p->shm_path_b64 = talloc_array(vo, char, b64_size);
-        av_base64_encode(p->shm_path_b64, b64_size, p->shm_path + 1, p_size);
-    }
-#else
+#if !HAVE_POSIX_SHM
     if (p->opts.use_shm) {
         MP_ERR(vo, "Shared memory support is not available on this platform.");
         return -1;
     }
 #endif
 
+    for (int n = 0; n < SHM_POOL_SIZE; n++)
+        p->shm[n].fd = -1;
+
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int n = 0; n < 4096; n++) {
+        p->b64_lut[n][0] = digits[n >> 6];
+        p->b64_lut[n][1] = digits[n & 63];
+    }
+
     write_str(TERM_ESC_HIDE_CURSOR);
     if (p->opts.alt_screen)
         write_str(TERM_ESC_ALT_SCREEN);
@@ -413,7 +624,6 @@ const struct vo_driver video_out_kitty = {
     .uninit = uninit,
     .priv_size = sizeof(struct priv),
     .priv_defaults = &(const struct priv) {
-        .shm_fd = -1,
         .opts.config_clear = 1,
         .opts.alt_screen = 1,
     },
@@ -427,6 +637,7 @@ const struct vo_driver video_out_kitty = {
         {"config-clear", OPT_FLAG(opts.config_clear), },
         {"alt-screen", OPT_FLAG(opts.alt_screen), },
         {"use-shm", OPT_FLAG(opts.use_shm), },
+        {"diff", OPT_FLAG(opts.diff), },
         {0}
     },
     .options_prefix = "vo-kitty",
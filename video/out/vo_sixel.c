@@ -21,9 +21,11 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <libavutil/cpu.h>
 #include <libswscale/swscale.h>
 #include <sixel.h>
 
@@ -34,6 +36,8 @@
 #include "vo.h"
 #include "video/sws_utils.h"
 #include "video/mp_image.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 
 #if HAVE_POSIX
 #include <unistd.h>
@@ -48,6 +52,9 @@
 #define TERMINAL_FALLBACK_PX_WIDTH  320
 #define TERMINAL_FALLBACK_PX_HEIGHT 240
 
+// Upper bound for the number of horizontal bands the image is split into.
+#define MAX_BANDS 16
+
 struct vo_sixel_opts {
     int diffuse;
     int reqcolors;
@@ -58,6 +65,25 @@ struct vo_sixel_opts {
     int rows, cols;
     int config_clear, alt_screen;
     int buffered;
+    int threads;
+};
+
+// A horizontal slice of the image, which is encoded as separate sixel image.
+// Its height is a multiple of both the sixel and the cell height, so that it
+// can be positioned with the cursor.
+struct sixel_band {
+    struct priv *priv;
+    int y, h;       // pixel rows in priv->buffer
+    int row;        // cell row offset relative to priv->top
+    // libsixel dithers have internal caches and are not thread-safe, so each
+    // band uses its own copy of the current palette.
+    sixel_dither_t *dither;
+    int palette_id; // priv->palette_id the dither was created for
+    sixel_output_t *output;
+    char *buf;      // encoded band for the current frame
+    uint8_t *prev;  // pixels last sent to the terminal, NULL if none
+    bool changed;
+    struct mp_waiter waiter;
 };
 
 struct priv {
@@ -65,20 +91,26 @@ struct priv {
     struct vo_sixel_opts opts;
 
     // Internal data
-    sixel_output_t *output;
     sixel_dither_t *dither;
     sixel_dither_t *testdither;
     uint8_t        *buffer;
-    char           *sixel_output_buf;
     bool            skip_frame_draw;
 
     int left, top;  // image origin cell (1 based)
     int width, height;  // actual image px size - always reflects dst_rect.
     int num_cols, num_rows;  // terminal size in cells
+    int cell_height;  // cell height in pixels, 0 if unknown
     int canvas_ok;  // whether canvas vo->dwidth and vo->dheight are positive
 
     int previous_histgram_colors;
 
+    struct sixel_band *bands;
+    int num_bands;
+    struct mp_thread_pool *tp;
+    int tp_threads;
+    int palette_id;         // incremented whenever priv->dither changes
+    int sent_palette_id;    // palette currently set on the terminal, or -1
+
     struct mp_rect src_rect;
     struct mp_rect dst_rect;
     struct mp_osd_res osd;
@@ -115,10 +147,29 @@ static int detect_scene_change(struct vo* vo)
 
 }
 
+static void free_bands(struct priv *priv)
+{
+    for (int n = 0; n < priv->num_bands; n++) {
+        struct sixel_band *band = &priv->bands[n];
+        if (band->dither)
+            sixel_dither_unref(band->dither);
+        if (band->output)
+            sixel_output_unref(band->output);
+        talloc_free(band->buf);
+        talloc_free(band->prev);
+    }
+    TA_FREEP(&priv->bands);
+    priv->num_bands = 0;
+    // The terminal contents are unknown for new bands.
+    priv->sent_palette_id = -1;
+}
+
 static void dealloc_dithers_and_buffers(struct vo* vo)
 {
     struct priv* priv = vo->priv;
 
+    free_bands(priv);
+
     if (priv->buffer) {
         talloc_free(priv->buffer);
         priv->buffer = NULL;
@@ -148,6 +199,7 @@ static SIXELSTATUS prepare_static_palette(struct vo* vo)
         priv->dither = sixel_dither_get(BUILTIN_XTERM256);
         if (priv->dither == NULL)
             return SIXEL_FALSE;
+        priv->palette_id++;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opts.diffuse);
     }
@@ -178,6 +230,7 @@ static SIXELSTATUS prepare_dynamic_palette(struct vo *vo)
         }
 
         priv->dither = priv->testdither;
+        priv->palette_id++;
         status = sixel_dither_new(&priv->testdither, priv->opts.reqcolors, NULL);
 
         if (SIXEL_FAILED(status))
@@ -258,6 +311,8 @@ static void update_canvas_dimensions(struct vo *vo)
 
     priv->num_rows = num_rows;
     priv->num_cols = num_cols;
+    // Bands can be placed on cell boundaries only if the cell height is exact.
+    priv->cell_height = total_px_height % num_rows ? 0 : total_px_height / num_rows;
 
     priv->canvas_ok = vo->dwidth > 0 && vo->dheight > 0;
 }
@@ -285,6 +340,125 @@ static void set_sixel_output_parameters(struct vo *vo)
                   priv->num_cols * priv->dst_rect.x0 / vo->dwidth  + 1;
 }
 
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static inline int sixel_buffer(char *data, int size, void *priv) {
+    char **out = (char **)priv;
+    *out = talloc_strndup_append_buffer(*out, data, size);
+    return size;
+}
+
+static int setup_bands(struct vo *vo)
+{
+    struct priv *priv = vo->priv;
+
+    free_bands(priv);
+
+    // Bands must start on a cell row, and on a sixel row (6 pixels). If the
+    // cell height is unknown, encode the image as a whole.
+    int band_h = priv->height;
+    if (priv->cell_height > 0) {
+        int unit = 6 / gcd(6, priv->cell_height) * priv->cell_height;
+        int units = (priv->height + unit - 1) / unit;
+        band_h = unit * ((units + MAX_BANDS - 1) / MAX_BANDS);
+    }
+    if (band_h < 1)
+        return -1;
+
+    priv->num_bands = (priv->height + band_h - 1) / band_h;
+    priv->bands = talloc_zero_array(NULL, struct sixel_band, priv->num_bands);
+    for (int n = 0; n < priv->num_bands; n++) {
+        struct sixel_band *band = &priv->bands[n];
+        band->priv = priv;
+        band->y = n * band_h;
+        band->h = MPMIN(band_h, priv->height - band->y);
+        band->row = priv->cell_height ? band->y / priv->cell_height : 0;
+        band->palette_id = -1;
+        SIXELSTATUS status = sixel_output_new(&band->output, sixel_buffer,
+                                              &band->buf, NULL);
+        if (SIXEL_FAILED(status)) {
+            MP_ERR(vo, "Failed to create sixel output: %s\n",
+                   sixel_helper_format_error(status));
+            return -1;
+        }
+        sixel_output_set_encode_policy(band->output, SIXEL_ENCODEPOLICY_FAST);
+    }
+
+    int threads = priv->opts.threads;
+    if (threads < 1)
+        threads = av_cpu_count();
+    threads = MPCLAMP(threads, 1, priv->num_bands) - 1;
+    if (threads != priv->tp_threads) {
+        TA_FREEP(&priv->tp);
+        priv->tp_threads = 0;
+        if (threads) {
+            MP_VERBOSE(vo, "using %d threads for %d bands\n", threads,
+                       priv->num_bands);
+            priv->tp = mp_thread_pool_create(NULL, threads, threads, threads);
+            if (!priv->tp)
+                return -1;
+            priv->tp_threads = threads;
+        }
+    }
+
+    return 0;
+}
+
+// Make the band's dither use the current palette.
+static bool update_band_dither(struct priv *priv, struct sixel_band *band)
+{
+    if (band->dither && band->palette_id == priv->palette_id)
+        return true;
+
+    if (band->dither)
+        sixel_dither_unref(band->dither);
+    band->dither = NULL;
+
+    if (priv->opts.fixedpal) {
+        band->dither = sixel_dither_get(BUILTIN_XTERM256);
+        if (!band->dither)
+            return false;
+    } else {
+        int ncolors = sixel_dither_get_num_of_palette_colors(priv->dither);
+        if (SIXEL_FAILED(sixel_dither_new(&band->dither, ncolors, NULL)))
+            return false;
+        sixel_dither_set_palette(band->dither,
+                                 sixel_dither_get_palette(priv->dither));
+    }
+    sixel_dither_set_diffusion_type(band->dither, priv->opts.diffuse);
+    band->palette_id = priv->palette_id;
+    return true;
+}
+
+static void encode_band(struct sixel_band *band)
+{
+    struct priv *priv = band->priv;
+
+    band->buf = talloc_strdup(NULL, "");
+    // Each band is a separate sixel image, and terminals may reset the color
+    // registers for every image (e.g. xterm by default), so each carries the
+    // palette.
+    sixel_dither_set_body_only(band->dither, 0);
+    sixel_encode(priv->buffer + (size_t)band->y * priv->width * depth,
+                 priv->width, band->h, depth, band->dither, band->output);
+}
+
+static void encode_band_thread(void *ptr)
+{
+    struct sixel_band *band = ptr;
+
+    encode_band(band);
+    mp_waiter_wakeup(&band->waiter, 0);
+}
+
 static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *priv = vo->priv;
@@ -323,13 +497,7 @@ static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
     priv->buffer =
         talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
 
-    return 0;
-}
-
-static inline int sixel_buffer(char *data, int size, void *priv) {
-    char **out = (char **)priv;
-    *out = talloc_strndup_append_buffer(*out, data, size);
-    return size;
+    return setup_bands(vo);
 }
 
 static inline int sixel_write(char *data, int size, void *priv)
@@ -365,6 +533,14 @@ static inline void sixel_strwrite(char *s)
     sixel_write(s, strlen(s), stdout);
 }
 
+// Force all bands to be sent again with the next frame.
+static void invalidate_bands(struct priv *priv)
+{
+    for (int n = 0; n < priv->num_bands; n++)
+        TA_FREEP(&priv->bands[n].prev);
+    priv->sent_palette_id = -1;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *priv = vo->priv;
@@ -377,6 +553,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 
     if (priv->opts.config_clear)
         sixel_strwrite(TERM_ESC_CLEAR_SCREEN);
+    invalidate_bands(priv);
     vo->want_redraw = true;
 
     return ret;
@@ -407,6 +584,7 @@ static void draw_frame(struct vo *vo, struct vo_frame *frame)
 
         if (priv->opts.config_clear)
             sixel_strwrite(TERM_ESC_CLEAR_SCREEN);
+        invalidate_bands(priv);
         resized = true;
     }
 
@@ -477,20 +655,70 @@ static void flip_page(struct vo *vo)
     if (priv->buffer == NULL || priv->dither == NULL)
         return;
 
-    // Go to the offset row and column, then display the image
-    priv->sixel_output_buf = talloc_asprintf(NULL, TERM_ESC_GOTO_YX,
-                                             priv->top, priv->left);
-    if (!priv->opts.buffered)
-        sixel_strwrite(priv->sixel_output_buf);
+    // Only bands whose pixels changed since they were last sent need to be
+    // encoded. A palette change affects all of them.
+    bool new_palette = priv->sent_palette_id != priv->palette_id;
+    int num_changed = 0;
+    for (int n = 0; n < priv->num_bands; n++) {
+        struct sixel_band *band = &priv->bands[n];
+        size_t size = (size_t)band->h * priv->width * depth;
+        uint8_t *pixels = priv->buffer + (size_t)band->y * priv->width * depth;
+        band->changed = new_palette || !band->prev ||
+                        memcmp(band->prev, pixels, size) != 0;
+        if (!band->changed)
+            continue;
+        if (!update_band_dither(priv, band)) {
+            MP_ERR(vo, "flip_page: Failed to create dither for band.\n");
+            invalidate_bands(priv);
+            return;
+        }
+        if (!band->prev)
+            band->prev = talloc_size(NULL, size);
+        memcpy(band->prev, pixels, size);
+        num_changed++;
+    }
 
-    sixel_encode(priv->buffer, priv->width, priv->height,
-                 depth, priv->dither, priv->output);
+    if (!num_changed)
+        return;
 
-    if (priv->opts.buffered)
-        sixel_write(priv->sixel_output_buf,
-                    ta_get_size(priv->sixel_output_buf), stdout);
+    // Encode the changed bands in parallel. The current thread takes the
+    // first one.
+    struct sixel_band *first = NULL;
+    for (int n = 0; n < priv->num_bands; n++) {
+        struct sixel_band *band = &priv->bands[n];
+        if (!band->changed)
+            continue;
+        if (!first) {
+            first = band;
+        } else if (priv->tp) {
+            band->waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+            bool r = mp_thread_pool_queue(priv->tp, encode_band_thread, band);
+            // This is guaranteed by the API, as the pool has fixed threads.
+            assert(r);
+        } else {
+            encode_band(band);
+        }
+    }
+    encode_band(first);
+
+    // Go to the offset row and column of each band, then display it, all with
+    // a single write.
+    char *out = talloc_strdup(NULL, "");
+    for (int n = 0; n < priv->num_bands; n++) {
+        struct sixel_band *band = &priv->bands[n];
+        if (!band->changed)
+            continue;
+        if (band != first && priv->tp)
+            mp_waiter_wait(&band->waiter);
+        out = talloc_asprintf_append_buffer(out, TERM_ESC_GOTO_YX,
+                                            priv->top + band->row, priv->left);
+        out = talloc_strdup_append_buffer(out, band->buf);
+        TA_FREEP(&band->buf);
+    }
+    sixel_write(out, strlen(out), stdout);
+    talloc_free(out);
 
-    talloc_free(priv->sixel_output_buf);
+    priv->sent_palette_id = priv->palette_id;
 }
 
 static int preinit(struct vo *vo)
@@ -503,19 +731,6 @@ static int preinit(struct vo *vo)
     priv->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(priv->sws, vo->global);
 
-    if (priv->opts.buffered)
-        status = sixel_output_new(&priv->output, sixel_buffer,
-                                  &priv->sixel_output_buf, NULL);
-    else
-        status = sixel_output_new(&priv->output, sixel_write, stdout, NULL);
-    if (SIXEL_FAILED(status)) {
-        MP_ERR(vo, "preinit: Failed to create output file: %s\n",
-               sixel_helper_format_error(status));
-        return -1;
-    }
-
-    sixel_output_set_encode_policy(priv->output, SIXEL_ENCODEPOLICY_FAST);
-
     if (priv->opts.alt_screen)
         sixel_strwrite(TERM_ESC_ALT_SCREEN);
 
@@ -537,6 +752,7 @@ static int preinit(struct vo *vo)
     }
 
     priv->previous_histgram_colors = 0;
+    priv->sent_palette_id = -1;
 
     return 0;
 }
@@ -564,12 +780,8 @@ static void uninit(struct vo *vo)
         sixel_strwrite(TERM_ESC_NORMAL_SCREEN);
     fflush(stdout);
 
-    if (priv->output) {
-        sixel_output_unref(priv->output);
-        priv->output = NULL;
-    }
-
     dealloc_dithers_and_buffers(vo);
+    TA_FREEP(&priv->tp);
 }
 
 #define OPT_BASE_STRUCT struct priv
@@ -628,7 +840,9 @@ const struct vo_driver video_out_sixel = {
         {"exit-clear", OPT_FLAG(opts.alt_screen),
             .deprecation_message = "replaced by --vo-sixel-alt-screen"},
         {"alt-screen", OPT_FLAG(opts.alt_screen), },
-        {"buffered", OPT_FLAG(opts.buffered), },
+        {"buffered", OPT_FLAG(opts.buffered),
+            .deprecation_message = "output is always buffered now"},
+        {"threads", OPT_INT(opts.threads), M_RANGE(0, 64)},
         {0}
     },
     .options_prefix = "vo-sixel",
@@ -15,7 +15,9 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <config.h>
 
@@ -45,6 +47,9 @@
 #define TERM_ESC_COLOR24BIT_BG          "\033[48;2"
 #define TERM_ESC_COLOR24BIT_FG          "\033[38;2"
 
+// Never a valid color (24 bit RGB or 256 color index).
+#define COLOR_UNKNOWN 0xFFFFFFFFu
+
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 
@@ -70,6 +75,12 @@ struct priv {
     struct mp_rect dst;
     struct mp_sws_context *sws;
     struct lut_item lut[256];
+    // Colors of each cell as last written to the terminal (background and
+    // foreground, swidth * sheight * 2 entries).
+    uint32_t *cells;
+    // Escape sequences for the current frame, written at once.
+    char *out;
+    int out_len;
 };
 
 // Convert RGB24 to xterm-256 8-bit value
@@ -101,96 +112,122 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
     return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
 }
 
-static void print_seq3(struct lut_item *lut, const char* prefix,
-                       uint8_t r, uint8_t g, uint8_t b)
+static void out_append(struct priv *p, const char *s, int len)
 {
-// The fwrite implementation is about 25% faster than the printf code
-// (even if we use *.s with the lut values), however,
-// on windows we need to use printf in order to translate escape sequences and
-// UTF8 output for the console.
-#ifndef _WIN32
-    fputs(prefix, stdout);
-    fwrite(lut[r].str, lut[r].width, 1, stdout);
-    fwrite(lut[g].str, lut[g].width, 1, stdout);
-    fwrite(lut[b].str, lut[b].width, 1, stdout);
-    fputc('m', stdout);
-#else
-    printf("%s;%d;%d;%dm", prefix, (int)r, (int)g, (int)b);
-#endif
+    MP_TARRAY_GROW(p, p->out, p->out_len + len);
+    memcpy(p->out + p->out_len, s, len);
+    p->out_len += len;
 }
 
-static void print_seq1(struct lut_item *lut, const char* prefix, uint8_t c)
+static void out_append_str(struct priv *p, const char *s)
 {
-#ifndef _WIN32
-    fputs(prefix, stdout);
-    fwrite(lut[c].str, lut[c].width, 1, stdout);
-    fputc('m', stdout);
-#else
-    printf("%s;%dm", prefix, (int)c);
-#endif
+    out_append(p, s, strlen(s));
 }
 
+static void out_append_color(struct priv *p, const char *prefix, uint32_t c)
+{
+    out_append_str(p, prefix);
+    if (p->opts.term256) {
+        out_append(p, p->lut[c].str, p->lut[c].width);
+    } else {
+        struct lut_item *r = &p->lut[(c >> 16) & 0xFF];
+        struct lut_item *g = &p->lut[(c >> 8) & 0xFF];
+        struct lut_item *b = &p->lut[c & 0xFF];
+        out_append(p, r->str, r->width);
+        out_append(p, g->str, g->width);
+        out_append(p, b->str, b->width);
+    }
+    out_append(p, "m", 1);
+}
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256, struct lut_item *lut)
+static void out_flush(struct priv *p)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(TERM_ESC_GOTO_YX, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                print_seq1(lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                print_seq3(lut, TERM_ESC_COLOR24BIT_BG, r, g, b);
-            }
-            printf(" ");
+    // Escape sequences printed with stdio (e.g. on reconfig) must come first.
+    fflush(stdout);
+    // On POSIX platforms, write() is the fastest method, and writes the frame
+    // as a whole, which avoids tearing with other output to the terminal. On
+    // windows we need to use printf in order to translate escape sequences and
+    // UTF8 output for the console.
+#if HAVE_POSIX
+    const char *s = p->out;
+    size_t remain = p->out_len;
+    while (remain > 0) {
+        ssize_t written = write(STDOUT_FILENO, s, remain);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
         }
-        printf(TERM_ESC_CLEAR_COLORS);
+        remain -= written;
+        s += written;
     }
-    printf("\n");
+#else
+    printf("%.*s", (int)p->out_len, p->out);
+    fflush(stdout);
+#endif
+    p->out_len = 0;
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256, struct lut_item *lut)
+static uint32_t get_color(struct priv *p, const unsigned char *bgr)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(TERM_ESC_GOTO_YX, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                print_seq1(lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                print_seq1(lut, TERM_ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                print_seq3(lut, TERM_ESC_COLOR24BIT_BG, r_up, g_up, b_up);
-                print_seq3(lut, TERM_ESC_COLOR24BIT_FG, r_down, g_down, b_down);
+    if (p->opts.term256)
+        return rgb_to_x256(bgr[2], bgr[1], bgr[0]);
+    return ((uint32_t)bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
+}
+
+// Write the cells which changed since the last frame to the output buffer.
+// Each cell has a background color, and a foreground color for half-blocks
+// (the lower pixel). Cursor moves and color changes are only emitted where
+// they differ from the current terminal state.
+static void write_cells(struct vo *vo, bool half_blocks)
+{
+    struct priv *p = vo->priv;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+    const unsigned char *source = p->frame->planes[0];
+    const ptrdiff_t stride = p->frame->stride[0];
+    const char *glyph = half_blocks ? "\xe2\x96\x84" : " "; // U+2584 (lower half block)
+    const int glyph_len = strlen(glyph);
+
+    int cur_x = -1, cur_y = -1;
+    uint32_t cur_bg = COLOR_UNKNOWN, cur_fg = COLOR_UNKNOWN;
+
+    for (int y = 0; y < p->sheight; y++) {
+        const unsigned char *row_up = source + (half_blocks ? y * 2 : y) * stride;
+        const unsigned char *row_down = row_up + stride;
+        uint32_t *prev = &p->cells[y * p->swidth * 2];
+        for (int x = 0; x < p->swidth; x++) {
+            uint32_t bg = get_color(p, row_up + x * 3);
+            uint32_t fg = half_blocks ? get_color(p, row_down + x * 3) : 0;
+            if (prev[x * 2 + 0] == bg && prev[x * 2 + 1] == fg)
+                continue;
+            prev[x * 2 + 0] = bg;
+            prev[x * 2 + 1] = fg;
+
+            if (cur_x != tx + x || cur_y != ty + y) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), TERM_ESC_GOTO_YX, ty + y, tx + x);
+                out_append_str(p, buf);
+                cur_x = tx + x;
+                cur_y = ty + y;
+            }
+            if (cur_bg != bg) {
+                out_append_color(p, p->opts.term256 ? TERM_ESC_COLOR256_BG
+                                                    : TERM_ESC_COLOR24BIT_BG, bg);
+                cur_bg = bg;
             }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+            if (half_blocks && cur_fg != fg) {
+                out_append_color(p, p->opts.term256 ? TERM_ESC_COLOR256_FG
+                                                    : TERM_ESC_COLOR24BIT_FG, fg);
+                cur_fg = fg;
+            }
+            out_append(p, glyph, glyph_len);
+            cur_x++;
         }
-        printf(TERM_ESC_CLEAR_COLORS);
     }
-    printf("\n");
+
+    if (cur_bg != COLOR_UNKNOWN || cur_fg != COLOR_UNKNOWN)
+        out_append_str(p, TERM_ESC_CLEAR_COLORS);
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -236,6 +273,12 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (mp_sws_reinit(p->sws) < 0)
         return -1;
 
+    // The screen is cleared, so the next frame must write all cells.
+    talloc_free(p->cells);
+    p->cells = talloc_array(p, uint32_t, p->swidth * p->sheight * 2);
+    for (int n = 0; n < p->swidth * p->sheight * 2; n++)
+        p->cells[n] = COLOR_UNKNOWN;
+
     printf(TERM_ESC_CLEAR_SCREEN);
 
     vo->want_redraw = true;
@@ -261,18 +304,8 @@ static void flip_page(struct vo *vo)
     if (vo->dwidth != width || vo->dheight != height)
         reconfig(vo, vo->params);
 
-    if (p->opts.algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts.term256, p->lut);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts.term256, p->lut);
-    }
-    fflush(stdout);
+    write_cells(vo, p->opts.algo == ALGO_HALF_BLOCKS);
+    out_flush(p);
 }
 
 static void uninit(struct vo *vo)
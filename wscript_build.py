@@ -317,6 +317,7 @@ def build(ctx):
         ( "demux/timeline.c" ),
 
         ( "filters/f_async_queue.c" ),
+        ( "filters/f_audio_meter.c" ),
         ( "filters/f_autoconvert.c" ),
         ( "filters/f_auto_filters.c" ),
         ( "filters/f_decoder_wrapper.c" ),
@@ -416,17 +417,25 @@ def build(ctx):
         ( "sub/sd_lavc.c" ),
 
         ## Tests
+        ( "test/async_queue.c",                  "tests" ),
+        ( "test/audio_bench.c",                  "tests" ),
+        ( "test/audio_gain.c",                   "tests" ),
+        ( "test/audio_meter.c",                  "tests" ),
         ( "test/chmap.c",                        "tests" ),
         ( "test/gl_video.c",                     "tests" ),
         ( "test/img_format.c",                   "tests" ),
         ( "test/json.c",                         "tests" ),
+        ( "test/lavfi.c",                        "tests" ),
         ( "test/linked_list.c",                  "tests" ),
         ( "test/paths.c",                        "tests" ),
         ( "test/repack.c",                       "tests && zimg" ),
         ( "test/scale_sws.c",                    "tests" ),
         ( "test/scale_test.c",                   "tests" ),
         ( "test/scale_zimg.c",                   "tests && zimg" ),
+        ( "test/scaletempo2.c",                  "tests" ),
+        ( "test/test_filters.c",                 "tests" ),
         ( "test/tests.c",                        "tests" ),
+        ( "test/video_bench.c",                  "tests" ),
 
         ## Video
         ( "video/csputils.c" ),